@@ -0,0 +1,343 @@
+#include "CatalogGenerator.hpp"
+#include <iostream>
+#include <iterator>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const char *const LANGUAGE_CODES[] = {"enUs", "ptBr", "esEs", "frFr",
+                                      "deDe", "itIt", "jaJp", "zhCn"};
+const char *const COMPONENT_TYPES[] = {"Integer",   "Decimal", "Spinner",
+                                       "ComboBox",  "Date",    "Time",
+                                       "TextField", "CheckBox"};
+const char *const LIMIT_KEYS[] = {"MIN_VALUE", "MAX_VALUE", "DEFAULT_VALUE",
+                                  "STEP",      "MAX_CHAR",  "MIN_CHAR"};
+const char *const WORDS[] = {"Phase",   "Ground",   "Current",   "Voltage",
+                             "Delay",   "Pickup",   "Curve",     "Reclose",
+                             "Trip",    "Timer",    "Frequency", "Breaker",
+                             "Reset",   "Sequence", "Fault",     "Threshold"};
+
+uint64_t mix(uint64_t x) {
+  // splitmix64 finalizer
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// FNV-1a; std::hash differs between standard libraries
+uint64_t hashKey(const std::string &key) {
+  uint64_t h = 0xCBF29CE484222325ULL;
+  for (unsigned char c : key) {
+    h = (h ^ c) * 0x100000001B3ULL;
+  }
+  return h;
+}
+
+uint64_t mix(uint64_t seed, std::initializer_list<uint64_t> values) {
+  uint64_t h = mix(seed);
+  for (uint64_t v : values) {
+    h = mix(h ^ v);
+  }
+  return h;
+}
+
+std::string languageCode(int i) {
+  return i < static_cast<int>(std::size(LANGUAGE_CODES))
+             ? LANGUAGE_CODES[i]
+             : "lang" + std::to_string(i);
+}
+
+class Generator {
+public:
+  Generator(RecloserManager &manager, const CatalogShape &shape)
+      : manager(manager), shape(shape) {
+    for (int i = 0; i < shape.languages; ++i) {
+      languages.push_back(languageCode(i));
+    }
+  }
+
+  bool run() {
+    RecloserManager::Transaction transaction(manager);
+    for (const auto &code : languages) {
+      ok = manager.addLanguage(code, "Language " + code) && ok;
+    }
+    for (int r = 0; ok && r < shape.reclosers; ++r) {
+      addRecloser(r);
+    }
+    return ok && transaction.commit();
+  }
+
+private:
+  // Two words and a number from the key's hash, tagged with the language
+  // past the first one, e.g. "Phase Delay 17" or "Phase Delay 17 (ptBr)"
+  void addKey(const std::string &key) {
+    uint64_t h = mix(shape.seed, {hashKey(key)});
+    std::string text = std::string(WORDS[h % std::size(WORDS)]) + " " +
+                       WORDS[(h >> 8) % std::size(WORDS)] + " " +
+                       std::to_string((h >> 16) % 100);
+    std::vector<std::pair<std::string, std::string>> translations;
+    for (size_t i = 0; i < languages.size(); ++i) {
+      std::string value = text;
+      if (i > 0) {
+        value += " (" + languages[i] + ")";
+      }
+      translations.emplace_back(languages[i], std::move(value));
+    }
+    ok = manager.addKeyWithTranslations(key, translations) && ok;
+  }
+
+  void addRecloser(int r) {
+    std::string key = "BENCH_R" + std::to_string(r);
+    addKey(key);
+    int recloserId = manager.addRecloser(key);
+    ok = recloserId > 0 && ok;
+
+    firmwareIds.clear();
+    for (int m = 0; ok && m < shape.firmwaresPerRecloser; ++m) {
+      int id = manager.addFirmwareVersion("v" + std::to_string(m + 1) + ".0.0",
+                                          recloserId);
+      ok = id > 0 && ok;
+      firmwareIds.push_back(id);
+    }
+    addServices(key + "_S", 0, 1);
+  }
+
+  void addServices(const std::string &prefix, int parentId, int level) {
+    for (int i = 0; ok && i < shape.fanOut; ++i) {
+      std::string key = prefix + std::to_string(i);
+      addKey(key);
+      int serviceId = manager.addService(key, parentId);
+      ok = serviceId > 0 && ok;
+
+      for (int f = 0; f < shape.featuresPerService; ++f) {
+        addKey(key + "_F" + std::to_string(f));
+      }
+      for (size_t m = 0; ok && m < firmwareIds.size(); ++m) {
+        int sfId = manager.linkServiceToFirmware(serviceId, firmwareIds[m]);
+        ok = sfId > 0 && ok;
+        for (int f = 0; ok && f < shape.featuresPerService; ++f) {
+          addFeature(key + "_F" + std::to_string(f), serviceId, sfId, f,
+                     static_cast<int>(m));
+        }
+      }
+
+      if (level < shape.depth) {
+        addServices(key + "_", serviceId, level + 1);
+      }
+    }
+  }
+
+  void addFeature(const std::string &key, int serviceId, int sfId, int f,
+                  int m) {
+    uint64_t h = mix(shape.seed, {static_cast<uint64_t>(serviceId),
+                                  static_cast<uint64_t>(f)});
+    // Later firmwares drop about one feature in eight
+    if (m > 0 && mix(h, {static_cast<uint64_t>(m)}) % 8 == 0) {
+      return;
+    }
+    int featureId = manager.addFeature(key, sfId);
+    int componentId = manager.linkFeatureToComponent(
+        featureId, COMPONENT_TYPES[h % std::size(COMPONENT_TYPES)]);
+    ok = featureId > 0 && componentId > 0 && ok;
+
+    for (int k = 0; ok && k < shape.limitsPerFeature; ++k) {
+      uint64_t value = mix(h, {static_cast<uint64_t>(k)}) % 1000;
+      // and change about one limit in five
+      uint64_t change =
+          mix(h, {static_cast<uint64_t>(k), static_cast<uint64_t>(m)});
+      if (m > 0 && change % 5 == 0) {
+        value += static_cast<uint64_t>(m) * 10;
+      }
+      ok = manager.addComponentLimit(componentId, LIMIT_KEYS[k],
+                                     std::to_string(value)) &&
+           ok;
+    }
+  }
+
+  RecloserManager &manager;
+  const CatalogShape &shape;
+  std::vector<std::string> languages;
+  std::vector<int> firmwareIds; // of the recloser being generated
+  bool ok = true;
+};
+
+} // namespace
+
+void removeDatabase(const std::filesystem::path &path) {
+  for (const char *suffix : {"", "-wal", "-shm"}) {
+    std::error_code ec;
+    std::filesystem::remove(path.string() + suffix, ec);
+  }
+}
+
+TempDatabase::TempDatabase(const std::string &fileName,
+                           size_t readConnections,
+                           const ConnectionProfile &profile)
+    : path(std::filesystem::temp_directory_path() / fileName) {
+  removeDatabase(path);
+  manager = std::make_unique<RecloserManager>(path.string(), readConnections,
+                                              profile);
+  if (!manager->initialize()) {
+    manager.reset();
+  }
+}
+
+TempDatabase::~TempDatabase() {
+  manager.reset();
+  removeDatabase(path);
+}
+
+CatalogShape CatalogShape::rows1k() {
+  CatalogShape shape;
+  shape.reclosers = 1;
+  shape.depth = 2;
+  shape.fanOut = 3;
+  return shape;
+}
+
+CatalogShape CatalogShape::rows100k() {
+  CatalogShape shape;
+  shape.reclosers = 8;
+  shape.depth = 3;
+  shape.fanOut = 5;
+  return shape;
+}
+
+CatalogShape CatalogShape::rows1M() {
+  CatalogShape shape;
+  shape.reclosers = 16;
+  shape.depth = 4;
+  shape.fanOut = 5;
+  return shape;
+}
+
+CatalogShape CatalogShape::forRows(int64_t rows) {
+  if (rows < 10000) {
+    return rows1k();
+  }
+  return rows < 300000 ? rows100k() : rows1M();
+}
+
+int64_t CatalogShape::servicesPerRecloser() const {
+  int64_t services = 0;
+  int64_t level = 1;
+  for (int d = 0; d < depth; ++d) {
+    level *= fanOut;
+    services += level;
+  }
+  return services;
+}
+
+int64_t CatalogShape::rowCount() const {
+  int64_t s = servicesPerRecloser();
+  int64_t f = featuresPerService;
+  int64_t keys = 1 + s + s * f; // recloser, services, features
+  int64_t perFirmware = s + s * f * (2 + limitsPerFeature);
+  return languages +
+         reclosers * (keys * (1 + languages) + firmwaresPerRecloser +
+                      firmwaresPerRecloser * perFirmware + 1);
+}
+
+std::string CatalogShape::name() const {
+  return "r" + std::to_string(reclosers) + "_m" +
+         std::to_string(firmwaresPerRecloser) + "_d" + std::to_string(depth) +
+         "_f" + std::to_string(fanOut) + "_s" +
+         std::to_string(featuresPerService) + "_k" +
+         std::to_string(limitsPerFeature) + "_l" + std::to_string(languages) +
+         "_seed" + std::to_string(seed);
+}
+
+bool generateCatalog(RecloserManager &manager, const CatalogShape &shape) {
+  return Generator(manager, shape).run();
+}
+
+std::unique_ptr<RecloserManager>
+openGeneratedCatalog(const CatalogShape &shape, size_t readConnections,
+                     const std::filesystem::path &copyTo) {
+  std::filesystem::path path = std::filesystem::temp_directory_path() /
+                               ("recloser_bench_" + shape.name() + ".db");
+
+  if (!std::filesystem::exists(path)) {
+    // Built under another name and renamed once complete, so an
+    // interrupted run never leaves a partial catalog behind
+    std::filesystem::path partial = path.string() + ".partial";
+    removeDatabase(partial);
+    std::cerr << "Generating " << shape.rowCount() << " rows into " << path
+              << std::endl;
+    {
+      RecloserManager builder(partial.string(), 0,
+                              ConnectionProfile::throughput());
+      if (!builder.initialize() || !generateCatalog(builder, shape)) {
+        return nullptr;
+      }
+    }
+    std::error_code ec;
+    std::filesystem::rename(partial, path, ec);
+    if (ec) {
+      removeDatabase(partial);
+      return nullptr;
+    }
+  }
+
+  if (!copyTo.empty()) {
+    removeDatabase(copyTo);
+    std::error_code ec;
+    std::filesystem::copy_file(path, copyTo, ec);
+    if (ec) {
+      return nullptr;
+    }
+    path = copyTo;
+  }
+
+  auto manager = std::make_unique<RecloserManager>(
+      path.string(), readConnections, ConnectionProfile::balanced());
+  if (!manager->initialize()) {
+    return nullptr;
+  }
+  return manager;
+}
+
+CatalogSample sampleCatalog(RecloserManager &manager) {
+  CatalogSample sample;
+  auto reclosers = manager.getAllReclosers();
+  if (reclosers.empty()) {
+    return sample;
+  }
+  sample.recloserId = reclosers[reclosers.size() / 2].id;
+
+  auto firmwares = manager.getFirmwareVersionsForRecloser(sample.recloserId);
+  if (firmwares.size() < 2) {
+    return sample;
+  }
+  sample.firmwareId = firmwares[0].id;
+  sample.otherFirmwareId = firmwares[1].id;
+
+  auto topLevel = manager.getServicesByParentAndFirmware(0, sample.firmwareId);
+  if (topLevel.empty()) {
+    return sample;
+  }
+  sample.topServiceId = topLevel.front().id;
+  sample.serviceKey = topLevel.front().description_key;
+
+  // Depth order, so the last one is as deep as the tree goes
+  auto subtree = manager.getServiceSubtree(sample.topServiceId);
+  if (subtree.empty()) {
+    return sample;
+  }
+  sample.leafServiceId = subtree.back().id;
+  sample.topServiceFirmwareId =
+      manager.getServiceFirmwareId(sample.topServiceId, sample.firmwareId);
+  sample.leafServiceFirmwareId =
+      manager.getServiceFirmwareId(sample.leafServiceId, sample.firmwareId);
+
+  auto features =
+      manager.getFeaturesByServiceFirmware(sample.leafServiceFirmwareId);
+  if (!features.empty()) {
+    sample.featureId = features.front().id;
+    sample.featureKey = features.front().description_key;
+  }
+  return sample;
+}
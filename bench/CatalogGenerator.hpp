@@ -0,0 +1,92 @@
+#pragma once
+
+#include "RecloserManager.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+// Size and shape of a synthetic catalog.
+//
+// Each recloser has its own service tree, shared by all its firmwares:
+// fanOut top-level services, each with fanOut children, depth levels deep.
+// Every (service, firmware) link carries featuresPerService features, each
+// with one component and limitsPerFeature limits, and every description
+// key has a translation in each of the languages. Later firmwares of a
+// recloser lose about one feature in eight and change some limits, so
+// comparisons find differences.
+struct CatalogShape {
+  int reclosers = 1;
+  int firmwaresPerRecloser = 4;
+  int depth = 2;
+  int fanOut = 3;
+  int featuresPerService = 4;
+  int limitsPerFeature = 2; // at most 6, the limit keys of the schema
+  int languages = 2;
+  uint64_t seed = 1;
+
+  // About 1k, 100k and 1M rows over the catalog tables
+  static CatalogShape rows1k();
+  static CatalogShape rows100k();
+  static CatalogShape rows1M();
+  // rows1k(), rows100k() or rows1M() by the nearest row count
+  static CatalogShape forRows(int64_t rows);
+
+  int64_t servicesPerRecloser() const;
+  // Rows of every catalog table except the ServiceClosure index
+  int64_t rowCount() const;
+  // Distinguishes the database files of different shapes
+  std::string name() const;
+};
+
+// Fills an empty, initialized database with the catalog of a shape, in one
+// transaction. The same shape always produces the same rows and ids.
+bool generateCatalog(RecloserManager &manager, const CatalogShape &shape);
+
+// Opens the generated database of a shape in the temp directory, building
+// it first if no earlier run left one. With copyTo, opens a copy of it
+// there instead, for benchmarks that write; the caller removes the copy.
+// Null if the database cannot be built or copied.
+std::unique_ptr<RecloserManager>
+openGeneratedCatalog(const CatalogShape &shape, size_t readConnections = 4,
+                     const std::filesystem::path &copyTo = {});
+
+// Deletes a database file with its WAL and shared-memory files
+void removeDatabase(const std::filesystem::path &path);
+
+// An empty, initialized database of its own in the temp directory for a
+// benchmark fixture to seed, deleted with the manager. Fixtures derive from
+// it, so whatever they build on the manager is gone before it is. manager
+// is null if the database could not be initialized.
+struct TempDatabase {
+  std::filesystem::path path;
+  std::unique_ptr<RecloserManager> manager;
+
+  TempDatabase(const std::string &fileName, size_t readConnections,
+               const ConnectionProfile &profile);
+  ~TempDatabase();
+
+  TempDatabase(const TempDatabase &) = delete;
+  TempDatabase &operator=(const TempDatabase &) = delete;
+};
+
+// Rows of a generated catalog for the benchmarks to query: the middle
+// recloser, its first two firmwares, and its first top-level service and
+// one of the deepest services below it
+struct CatalogSample {
+  int recloserId = 0;
+  int firmwareId = 0;
+  int otherFirmwareId = 0;
+  int topServiceId = 0;
+  int leafServiceId = 0;
+  int topServiceFirmwareId = 0;  // topServiceId in firmwareId
+  int leafServiceFirmwareId = 0; // leafServiceId in firmwareId
+  int featureId = 0;             // first feature of leafServiceFirmwareId
+  std::string serviceKey;        // of topServiceId
+  std::string featureKey;        // of featureId
+
+  bool valid() const { return leafServiceFirmwareId > 0 && featureId > 0; }
+};
+
+CatalogSample sampleCatalog(RecloserManager &manager);
@@ -0,0 +1,110 @@
+#include "CatalogGenerator.hpp"
+#include <benchmark/benchmark.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Read throughput of RecloserManager against the thread count, with every
+// read on the writer connection (readers=0) versus a pool of read-only WAL
+// connections. Run with --benchmark_counters_tabular=true and compare the
+// items_per_second column across threads.
+
+namespace {
+
+constexpr int SERVICE_COUNT = 200;
+constexpr int FEATURES_PER_SERVICE = 10;
+
+struct Fixture : TempDatabase {
+  std::vector<int> serviceFirmwareIds;
+
+  explicit Fixture(size_t readConnections)
+      : TempDatabase("recloser_pool_bench_" +
+                         std::to_string(readConnections) + ".db",
+                     readConnections, ConnectionProfile::throughput()) {
+    if (!manager) {
+      return;
+    }
+
+    manager->addDescriptionKey("BENCH_RECLOSER");
+    manager->addRecloser("BENCH_RECLOSER");
+    manager->addFirmwareVersion("v1.0.0", 1);
+
+    for (int s = 0; s < SERVICE_COUNT; ++s) {
+      std::string serviceKey = "BENCH_SERVICE_" + std::to_string(s);
+      manager->addDescriptionKey(serviceKey);
+      int sfId =
+          manager->linkServiceToFirmware(manager->addService(serviceKey), 1);
+      serviceFirmwareIds.push_back(sfId);
+
+      for (int f = 0; f < FEATURES_PER_SERVICE; ++f) {
+        std::string featureKey = serviceKey + "_FEATURE_" + std::to_string(f);
+        manager->addDescriptionKey(featureKey);
+        manager->addFeature(featureKey, sfId);
+      }
+    }
+  }
+};
+
+// One seeded database per pool size, shared by every benchmark thread
+Fixture &sharedFixture(size_t readConnections) {
+  static std::mutex mutex;
+  static std::map<size_t, std::unique_ptr<Fixture>> fixtures;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &fixture = fixtures[readConnections];
+  if (!fixture) {
+    fixture = std::make_unique<Fixture>(readConnections);
+  }
+  return *fixture;
+}
+
+void BM_FeaturesByServiceFirmware(benchmark::State &state) {
+  Fixture &fixture = sharedFixture(static_cast<size_t>(state.range(0)));
+  const auto &ids = fixture.serviceFirmwareIds;
+  if (ids.empty()) {
+    state.SkipWithError("failed to seed the benchmark database");
+    return;
+  }
+
+  size_t next = static_cast<size_t>(state.thread_index());
+  for (auto _ : state) {
+    auto features =
+        fixture.manager->getFeaturesByServiceFirmware(ids[next++ % ids.size()]);
+    benchmark::DoNotOptimize(features);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_ServicesByParentAndFirmware(benchmark::State &state) {
+  Fixture &fixture = sharedFixture(static_cast<size_t>(state.range(0)));
+  if (fixture.serviceFirmwareIds.empty()) {
+    state.SkipWithError("failed to seed the benchmark database");
+    return;
+  }
+
+  for (auto _ : state) {
+    auto services = fixture.manager->getServicesByParentAndFirmware(0, 1);
+    benchmark::DoNotOptimize(services);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+BENCHMARK(BM_FeaturesByServiceFirmware)
+    ->ArgName("readers")
+    ->Arg(0)
+    ->Arg(8)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+BENCHMARK(BM_ServicesByParentAndFirmware)
+    ->ArgName("readers")
+    ->Arg(0)
+    ->Arg(8)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
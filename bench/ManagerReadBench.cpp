@@ -0,0 +1,216 @@
+#include "CatalogGenerator.hpp"
+#include <benchmark/benchmark.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Every RecloserManager read against generated catalogs of about 1k, 100k
+// and 1M rows (the rows argument; see CatalogShape). Each call reads the
+// middle recloser, its first firmware and the first service tree of it, so
+// the cost of a lookup shows against the size of the tables around it. The
+// databases are generated on first use and kept in the temp directory.
+
+namespace {
+
+struct Fixture {
+  std::unique_ptr<RecloserManager> manager;
+  CatalogSample sample;
+  std::vector<std::string> subtreeKeys; // of the sample's top service
+
+  explicit Fixture(int64_t rows) {
+    manager = openGeneratedCatalog(CatalogShape::forRows(rows));
+    if (!manager) {
+      return;
+    }
+    sample = sampleCatalog(*manager);
+    for (const auto &s : manager->getServiceSubtree(sample.topServiceId)) {
+      subtreeKeys.push_back(s.description_key);
+    }
+  }
+
+  bool ready() const { return manager && sample.valid(); }
+};
+
+Fixture *fixture(benchmark::State &state) {
+  static std::map<int64_t, std::unique_ptr<Fixture>> fixtures;
+  auto &f = fixtures[state.range(0)];
+  if (!f) {
+    f = std::make_unique<Fixture>(state.range(0));
+  }
+  if (!f->ready()) {
+    state.SkipWithError("failed to generate the catalog");
+    return nullptr;
+  }
+  return f.get();
+}
+
+// Runs read(manager, sample) once per iteration
+template <typename Read>
+void runRead(benchmark::State &state, Read read) {
+  Fixture *f = fixture(state);
+  if (!f) {
+    return;
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(read(*f->manager, f->sample));
+  }
+}
+
+void BM_GetTranslation(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &s) {
+    return m.getTranslation(s.featureKey, "ptBr");
+  });
+}
+
+void BM_GetTranslationsForKey(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &s) {
+    return m.getTranslationsForKey(s.featureKey);
+  });
+}
+
+void BM_ResolveTranslations(benchmark::State &state) {
+  Fixture *f = fixture(state);
+  if (!f) {
+    return;
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(f->manager->resolveTranslations(f->subtreeKeys));
+  }
+  state.counters["keys"] = static_cast<double>(f->subtreeKeys.size());
+}
+
+void BM_GetAllReclosers(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &) {
+    return m.getAllReclosers();
+  });
+}
+
+void BM_GetRecloserById(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &s) {
+    return m.getRecloserById(s.recloserId);
+  });
+}
+
+void BM_GetFirmwareVersionsForRecloser(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &s) {
+    return m.getFirmwareVersionsForRecloser(s.recloserId);
+  });
+}
+
+void BM_GetFirmwareVersionById(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &s) {
+    return m.getFirmwareVersionById(s.firmwareId);
+  });
+}
+
+void BM_GetServiceFirmwareId(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &s) {
+    return m.getServiceFirmwareId(s.leafServiceId, s.firmwareId);
+  });
+}
+
+void BM_GetAllServices(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &) {
+    return m.getAllServices();
+  });
+}
+
+void BM_GetServicesByParentAndFirmware(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &s) {
+    return m.getServicesByParentAndFirmware(s.topServiceId, s.firmwareId);
+  });
+}
+
+void BM_GetServiceById(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &s) {
+    return m.getServiceById(s.leafServiceId);
+  });
+}
+
+void BM_GetServiceSubtree(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &s) {
+    return m.getServiceSubtree(s.topServiceId);
+  });
+}
+
+void BM_GetServiceAncestors(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &s) {
+    return m.getServiceAncestors(s.leafServiceId);
+  });
+}
+
+void BM_GetServiceDepth(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &s) {
+    return m.getServiceDepth(s.leafServiceId);
+  });
+}
+
+void BM_GetFeaturesByServiceFirmware(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &s) {
+    return m.getFeaturesByServiceFirmware(s.leafServiceFirmwareId);
+  });
+}
+
+void BM_GetFeatureById(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &s) {
+    return m.getFeatureById(s.featureId);
+  });
+}
+
+void BM_GetScreenLayout(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &s) {
+    return m.getScreenLayout(s.topServiceFirmwareId);
+  });
+}
+
+void BM_SearchCatalog(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &) {
+    return m.searchCatalog("phase del", "", 20);
+  });
+}
+
+void BM_CatalogRevision(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &) {
+    return m.catalogRevision();
+  });
+}
+
+void BM_BuildCatalogSnapshot(benchmark::State &state) {
+  runRead(state, [](RecloserManager &m, const CatalogSample &) {
+    return m.buildCatalogSnapshot(1);
+  });
+}
+
+} // namespace
+
+#define CATALOG_BENCHMARK(name)                                                \
+  BENCHMARK(name)                                                              \
+      ->ArgName("rows")                                                        \
+      ->Arg(1000)                                                              \
+      ->Arg(100000)                                                            \
+      ->Arg(1000000)                                                           \
+      ->Unit(benchmark::kMicrosecond)
+
+CATALOG_BENCHMARK(BM_GetTranslation);
+CATALOG_BENCHMARK(BM_GetTranslationsForKey);
+CATALOG_BENCHMARK(BM_ResolveTranslations);
+CATALOG_BENCHMARK(BM_GetAllReclosers);
+CATALOG_BENCHMARK(BM_GetRecloserById);
+CATALOG_BENCHMARK(BM_GetFirmwareVersionsForRecloser);
+CATALOG_BENCHMARK(BM_GetFirmwareVersionById);
+CATALOG_BENCHMARK(BM_GetServiceFirmwareId);
+CATALOG_BENCHMARK(BM_GetAllServices);
+CATALOG_BENCHMARK(BM_GetServicesByParentAndFirmware);
+CATALOG_BENCHMARK(BM_GetServiceById);
+CATALOG_BENCHMARK(BM_GetServiceSubtree);
+CATALOG_BENCHMARK(BM_GetServiceAncestors);
+CATALOG_BENCHMARK(BM_GetServiceDepth);
+CATALOG_BENCHMARK(BM_GetFeaturesByServiceFirmware);
+CATALOG_BENCHMARK(BM_GetFeatureById);
+CATALOG_BENCHMARK(BM_GetScreenLayout);
+CATALOG_BENCHMARK(BM_SearchCatalog);
+CATALOG_BENCHMARK(BM_CatalogRevision);
+CATALOG_BENCHMARK(BM_BuildCatalogSnapshot);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,151 @@
+#include "CatalogGenerator.hpp"
+#include "RecloserServiceImpl.hpp"
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <streambuf>
+#include <string>
+
+// GetFullInventory on a 50k-node catalog, built the way the typed handler
+// did before (each message and repeated field on the heap, freed one by
+// one) versus the raw-message path (everything on one per-call arena whose
+// first block is sized from the previous response). Both serialize the
+// response once. The allocs counter is calls to operator new per response;
+// long strings still get heap buffers of their own on the arena.
+
+namespace {
+
+std::atomic<uint64_t> allocations{0};
+
+// Swallows the handlers' per-call logging while they are measured
+class NullBuffer : public std::streambuf {
+protected:
+  int overflow(int c) override { return c; }
+};
+
+constexpr int TOP_LEVEL_SERVICES = 500;
+constexpr int CHILDREN_PER_SERVICE = 99; // 50k nodes in all
+
+struct Fixture : TempDatabase {
+  std::unique_ptr<CatalogStore> catalog;
+  std::unique_ptr<CompareCache> compareCache;
+  std::unique_ptr<ResponseCache> responseCache;
+  std::unique_ptr<recloser::RecloserServiceImpl> service;
+
+  Fixture()
+      : TempDatabase("recloser_response_arena_bench.db", 1,
+                     ConnectionProfile::throughput()) {
+    if (!manager) {
+      return;
+    }
+
+    RecloserManager::Transaction transaction(*manager);
+    manager->addLanguage("enUs", "English");
+    manager->addLanguage("ptBr", "Português");
+    manager->addDescriptionKey("BENCH_RECLOSER");
+    int firmwareId = manager->addFirmwareVersion(
+        "v1.0.0", manager->addRecloser("BENCH_RECLOSER"));
+
+    auto addNode = [&](const std::string &key, int parentId) {
+      manager->addKeyWithTranslations(
+          key, {{"enUs", "Service " + key}, {"ptBr", "Serviço " + key}});
+      int id = manager->addService(key, parentId);
+      int sfId = manager->linkServiceToFirmware(id, firmwareId);
+      manager->addKeyWithTranslations(key + "_F",
+                                      {{"enUs", "Setting of " + key},
+                                       {"ptBr", "Ajuste de " + key}});
+      manager->addFeature(key + "_F", sfId);
+      return id;
+    };
+    for (int i = 0; i < TOP_LEVEL_SERVICES; ++i) {
+      std::string key = "BENCH_SVC_" + std::to_string(i);
+      int parentId = addNode(key, 0);
+      for (int c = 0; c < CHILDREN_PER_SERVICE; ++c) {
+        addNode(key + "_" + std::to_string(c), parentId);
+      }
+    }
+    if (!transaction.commit()) {
+      return;
+    }
+
+    catalog = std::make_unique<CatalogStore>(manager.get());
+    compareCache = std::make_unique<CompareCache>(0);
+    responseCache = std::make_unique<ResponseCache>(0);
+    if (!catalog->load()) {
+      catalog.reset();
+      return;
+    }
+    service = std::make_unique<recloser::RecloserServiceImpl>(
+        manager.get(), catalog.get(), compareCache.get(), responseCache.get());
+  }
+
+  bool ready() const { return service != nullptr; }
+};
+
+Fixture &fixture() {
+  static Fixture instance;
+  return instance;
+}
+
+template <typename Build>
+void runInventory(benchmark::State &state, Build build) {
+  Fixture &f = fixture();
+  if (!f.ready()) {
+    state.SkipWithError("failed to create the benchmark database");
+    return;
+  }
+  NullBuffer discard;
+  std::streambuf *console = std::cout.rdbuf(&discard);
+  build(f); // warms the arena size hint
+  uint64_t before = allocations.load();
+  size_t bytes = 0;
+  for (auto _ : state) {
+    bytes = build(f);
+  }
+  std::cout.rdbuf(console);
+  state.counters["allocs"] = benchmark::Counter(
+      static_cast<double>(allocations.load() - before),
+      benchmark::Counter::kAvgIterations);
+  state.counters["bytes"] = static_cast<double>(bytes);
+}
+
+void BM_InventoryHeap(benchmark::State &state) {
+  runInventory(state, [](Fixture &f) {
+    recloser::FullInventoryRequest request;
+    recloser::FullInventoryResponse response;
+    f.service->GetFullInventory(nullptr, &request, &response);
+    std::string payload = response.SerializeAsString();
+    return payload.size();
+  });
+}
+
+void BM_InventoryArena(benchmark::State &state) {
+  std::string key = recloser::RecloserServiceImpl::rawReadKey(
+      recloser::RawRead::FULL_INVENTORY, grpc::ByteBuffer());
+  runInventory(state, [&key](Fixture &f) {
+    grpc::ByteBuffer payload;
+    f.service->buildRawRead(key, &payload);
+    return payload.Length();
+  });
+}
+
+} // namespace
+
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+BENCHMARK(BM_InventoryHeap)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_InventoryArena)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
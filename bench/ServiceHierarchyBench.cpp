@@ -0,0 +1,219 @@
+#include "CatalogGenerator.hpp"
+#include <benchmark/benchmark.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Service hierarchy queries through the ServiceClosure table versus a
+// recursive CTE walking Services.parent_id, on a chain of services 5, 20
+// and 100 levels deep (each level with a few leaf siblings) among a few
+// thousand unrelated services. Subtree moves and whole screen layouts, which
+// read the closure too, are measured on their own.
+
+namespace {
+
+constexpr int BACKGROUND_SERVICES = 5000;
+constexpr int LEAVES_PER_LEVEL = 3;
+
+const char *SUBTREE_WALK_SQL =
+    "WITH RECURSIVE walk(id, depth) AS (SELECT ?, 0 UNION ALL SELECT s.id, "
+    "w.depth + 1 FROM walk w JOIN Services s ON s.parent_id = w.id) "
+    "SELECT s.id, s.description_key, IFNULL(s.parent_id, 0) FROM walk w "
+    "JOIN Services s ON s.id = w.id ORDER BY w.depth, s.id;";
+
+const char *ANCESTORS_WALK_SQL =
+    "WITH RECURSIVE walk(id, depth) AS (SELECT parent_id, 1 FROM Services "
+    "WHERE id = ? UNION ALL SELECT s.parent_id, w.depth + 1 FROM walk w "
+    "JOIN Services s ON s.id = w.id WHERE s.parent_id IS NOT NULL) "
+    "SELECT s.id, s.description_key, IFNULL(s.parent_id, 0) FROM walk w "
+    "JOIN Services s ON s.id = w.id ORDER BY w.depth DESC;";
+
+const char *DEPTH_WALK_SQL =
+    "WITH RECURSIVE walk(id, depth) AS (SELECT parent_id, 0 FROM Services "
+    "WHERE id = ? UNION ALL SELECT s.parent_id, w.depth + 1 FROM walk w "
+    "JOIN Services s ON s.id = w.id) SELECT MAX(depth) FROM walk;";
+
+struct Fixture : TempDatabase {
+  sqlite3 *reader = nullptr; // parent_id walks, outside the manager
+  std::vector<int> chain;    // chain[d] is the chain service at depth d
+  int rootServiceFirmwareId = 0;
+  int spareParent = 0; // moves alternate between it and the chain
+
+  explicit Fixture(int depth)
+      : TempDatabase("recloser_hierarchy_bench_" + std::to_string(depth) +
+                         ".db",
+                     1, ConnectionProfile::throughput()) {
+    if (!manager) {
+      return;
+    }
+
+    RecloserManager::Transaction transaction(*manager);
+    manager->addDescriptionKey("BENCH_RECLOSER");
+    int firmwareId = manager->addFirmwareVersion(
+        "v1.0.0", manager->addRecloser("BENCH_RECLOSER"));
+
+    auto addService = [&](const std::string &key, int parentId) {
+      manager->addDescriptionKey(key);
+      int id = manager->addService(key, parentId);
+      int sfId = manager->linkServiceToFirmware(id, firmwareId);
+      manager->addDescriptionKey(key + "_FEATURE");
+      manager->addFeature(key + "_FEATURE", sfId);
+      return std::make_pair(id, sfId);
+    };
+
+    // Unrelated services, two levels deep, interleaved with the chain so
+    // its rows are spread over the tables
+    int backgroundParent = 0;
+    for (int i = 0; i < BACKGROUND_SERVICES; ++i) {
+      int parentId = i % 10 == 0 ? 0 : backgroundParent;
+      int id = addService("BENCH_BG_" + std::to_string(i), parentId).first;
+      if (i % 10 == 0) {
+        backgroundParent = id;
+      }
+      if (i % (BACKGROUND_SERVICES / (depth + 1)) == 0 &&
+          static_cast<int>(chain.size()) < depth + 1) {
+        std::string key = "BENCH_CHAIN_" + std::to_string(chain.size());
+        auto [chainId, sfId] =
+            addService(key, chain.empty() ? 0 : chain.back());
+        if (chain.empty()) {
+          rootServiceFirmwareId = sfId;
+        }
+        chain.push_back(chainId);
+        for (int l = 0; l < LEAVES_PER_LEVEL; ++l) {
+          addService(key + "_LEAF_" + std::to_string(l), chainId);
+        }
+      }
+    }
+    spareParent = addService("BENCH_SPARE", 0).first;
+    if (!transaction.commit() ||
+        static_cast<int>(chain.size()) != depth + 1) {
+      chain.clear();
+      return;
+    }
+
+    sqlite3_open_v2(path.string().c_str(), &reader, SQLITE_OPEN_READONLY,
+                    nullptr);
+  }
+
+  ~Fixture() { sqlite3_close(reader); }
+
+  bool ready() const { return reader && !chain.empty(); }
+
+  // Runs a parent_id walk to completion and returns its row count
+  int walk(const char *sql, int id) {
+    sqlite3_stmt *stmt = nullptr;
+    sqlite3_prepare_v3(reader, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt,
+                       nullptr);
+    sqlite3_bind_int(stmt, 1, id);
+    int rows = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      benchmark::DoNotOptimize(sqlite3_column_text(stmt, 1));
+      rows++;
+    }
+    sqlite3_finalize(stmt);
+    return rows;
+  }
+};
+
+// One fixture per depth, shared by every benchmark of that depth
+Fixture &fixtureFor(int depth) {
+  static std::map<int, std::unique_ptr<Fixture>> fixtures;
+  auto &fixture = fixtures[depth];
+  if (!fixture) {
+    fixture = std::make_unique<Fixture>(depth);
+  }
+  return *fixture;
+}
+
+template <typename Query>
+void runQuery(benchmark::State &state, Query query) {
+  Fixture &fixture = fixtureFor(static_cast<int>(state.range(0)));
+  if (!fixture.ready()) {
+    state.SkipWithError("failed to create the benchmark database");
+    return;
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(query(fixture));
+  }
+}
+
+void BM_SubtreeClosure(benchmark::State &state) {
+  runQuery(state, [](Fixture &f) {
+    return f.manager->getServiceSubtree(f.chain.front()).size();
+  });
+}
+
+void BM_SubtreeParentWalk(benchmark::State &state) {
+  runQuery(state, [](Fixture &f) {
+    return f.walk(SUBTREE_WALK_SQL, f.chain.front());
+  });
+}
+
+void BM_AncestorsClosure(benchmark::State &state) {
+  runQuery(state, [](Fixture &f) {
+    return f.manager->getServiceAncestors(f.chain.back()).size();
+  });
+}
+
+void BM_AncestorsParentWalk(benchmark::State &state) {
+  runQuery(state, [](Fixture &f) {
+    return f.walk(ANCESTORS_WALK_SQL, f.chain.back());
+  });
+}
+
+void BM_DepthClosure(benchmark::State &state) {
+  runQuery(state, [](Fixture &f) {
+    return f.manager->getServiceDepth(f.chain.back());
+  });
+}
+
+void BM_DepthParentWalk(benchmark::State &state) {
+  runQuery(state, [](Fixture &f) {
+    return f.walk(DEPTH_WALK_SQL, f.chain.back());
+  });
+}
+
+void BM_ScreenLayout(benchmark::State &state) {
+  runQuery(state, [](Fixture &f) {
+    return f.manager->getScreenLayout(f.rootServiceFirmwareId).has_value();
+  });
+}
+
+// Moves the lower half of the chain, with its leaves, to a spare top-level
+// service and back; two moves per iteration
+void BM_MoveSubtree(benchmark::State &state) {
+  Fixture &fixture = fixtureFor(static_cast<int>(state.range(0)));
+  if (!fixture.ready()) {
+    state.SkipWithError("failed to create the benchmark database");
+    return;
+  }
+  size_t middle = fixture.chain.size() / 2;
+  int id = fixture.chain[middle];
+  int parentId = fixture.chain[middle - 1];
+  for (auto _ : state) {
+    if (!fixture.manager->moveService(id, fixture.spareParent) ||
+        !fixture.manager->moveService(id, parentId)) {
+      state.SkipWithError("move failed");
+      return;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+
+} // namespace
+
+#define HIERARCHY_BENCHMARK(name)                                              \
+  BENCHMARK(name)->ArgName("depth")->Arg(5)->Arg(20)->Arg(100)->Unit(          \
+      benchmark::kMicrosecond)
+
+HIERARCHY_BENCHMARK(BM_SubtreeClosure);
+HIERARCHY_BENCHMARK(BM_SubtreeParentWalk);
+HIERARCHY_BENCHMARK(BM_AncestorsClosure);
+HIERARCHY_BENCHMARK(BM_AncestorsParentWalk);
+HIERARCHY_BENCHMARK(BM_DepthClosure);
+HIERARCHY_BENCHMARK(BM_DepthParentWalk);
+HIERARCHY_BENCHMARK(BM_ScreenLayout);
+HIERARCHY_BENCHMARK(BM_MoveSubtree);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,587 @@
+#include "CatalogGenerator.hpp"
+#include "RecloserServiceImpl.hpp"
+#include "ServerMetrics.hpp"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// Every RecloserServiceImpl RPC, called in-process against generated
+// catalogs of about 1k, 100k and 1M rows (the rows argument; see
+// CatalogShape). Reads go through the same paths as the server:
+// GetServiceTree, GetScreenLayout and GetFullInventory as raw reads, which
+// build and serialize the response, with the response and compare caches
+// off so every call does the work. Writes run on a copy of the generated
+// database and include republishing the catalog snapshot, as in the
+// server; whatever a write adds or removes is put back untimed before the
+// next call.
+
+namespace {
+
+// Swallows the handlers' per-call logging while they are measured
+class NullBuffer : public std::streambuf {
+protected:
+  int overflow(int c) override { return c; }
+};
+
+class QuietOutput {
+public:
+  QuietOutput() : console(std::cout.rdbuf(&discard)) {}
+  ~QuietOutput() { std::cout.rdbuf(console); }
+
+private:
+  NullBuffer discard;
+  std::streambuf *console;
+};
+
+// Description key the write benchmarks rename rows to
+const char *const SPARE_KEY = "BENCH_SPARE";
+
+grpc::ByteBuffer serialize(const google::protobuf::Message &message) {
+  grpc::Slice slice(message.SerializeAsString());
+  return grpc::ByteBuffer(&slice, 1);
+}
+
+struct Fixture {
+  std::filesystem::path path;
+  std::unique_ptr<RecloserManager> manager;
+  std::unique_ptr<CatalogStore> catalog;
+  std::unique_ptr<CompareCache> compareCache;
+  std::unique_ptr<ResponseCache> responseCache;
+  std::unique_ptr<recloser::ServerMetrics> metrics;
+  std::unique_ptr<recloser::RecloserServiceImpl> service;
+  CatalogSample sample;
+  std::vector<int32_t> firmwareIds; // of the sample recloser
+  std::string recloserKey;
+  std::string firmwareVersion;
+  std::string leafServiceKey;
+  int leafParentId = 0;
+
+  explicit Fixture(int64_t rows) {
+    path = std::filesystem::temp_directory_path() /
+           ("recloser_rpc_bench_" + std::to_string(rows) + ".db");
+    manager = openGeneratedCatalog(CatalogShape::forRows(rows), 4, path);
+    if (!manager) {
+      return;
+    }
+    sample = sampleCatalog(*manager);
+    if (!sample.valid() || !manager->addDescriptionKey(SPARE_KEY)) {
+      return;
+    }
+    recloserKey = manager->getRecloserById(sample.recloserId)->description_key;
+    for (const auto &f :
+         manager->getFirmwareVersionsForRecloser(sample.recloserId)) {
+      firmwareIds.push_back(f.id);
+    }
+    firmwareVersion =
+        manager->getFirmwareVersionById(sample.firmwareId)->version;
+    auto leaf = manager->getServiceById(sample.leafServiceId);
+    leafServiceKey = leaf->description_key;
+    leafParentId = leaf->parent_id;
+
+    QuietOutput quiet;
+    catalog = std::make_unique<CatalogStore>(manager.get());
+    if (!catalog->load()) {
+      return;
+    }
+    compareCache = std::make_unique<CompareCache>(0);
+    responseCache = std::make_unique<ResponseCache>(0);
+    metrics = std::make_unique<recloser::ServerMetrics>(
+        manager.get(), catalog.get(), compareCache.get(), responseCache.get());
+    service = std::make_unique<recloser::RecloserServiceImpl>(
+        manager.get(), catalog.get(), compareCache.get(), responseCache.get(),
+        metrics.get());
+  }
+
+  ~Fixture() {
+    service.reset();
+    metrics.reset();
+    catalog.reset();
+    manager.reset();
+    removeDatabase(path);
+  }
+
+  bool ready() const { return service != nullptr; }
+};
+
+Fixture *fixture(benchmark::State &state) {
+  static std::map<int64_t, std::unique_ptr<Fixture>> fixtures;
+  auto &f = fixtures[state.range(0)];
+  if (!f) {
+    f = std::make_unique<Fixture>(state.range(0));
+  }
+  if (!f->ready()) {
+    state.SkipWithError("failed to generate the catalog");
+    return nullptr;
+  }
+  return f.get();
+}
+
+// Times call(fixture), which returns whether the RPC succeeded.
+// runWrite() runs undo(fixture) untimed after each call; runDelete() runs
+// setup(fixture) untimed before it, for the id to delete.
+template <typename Call>
+void runCall(benchmark::State &state, Call call) {
+  Fixture *f = fixture(state);
+  if (!f) {
+    return;
+  }
+  QuietOutput quiet;
+  for (auto _ : state) {
+    if (!call(*f)) {
+      state.SkipWithError("RPC failed");
+      break;
+    }
+  }
+}
+
+template <typename Call, typename Undo>
+void runWrite(benchmark::State &state, Call call, Undo undo) {
+  Fixture *f = fixture(state);
+  if (!f) {
+    return;
+  }
+  QuietOutput quiet;
+  for (auto _ : state) {
+    bool ok = call(*f);
+    state.PauseTiming();
+    ok = ok && undo(*f);
+    state.ResumeTiming();
+    if (!ok) {
+      state.SkipWithError("RPC failed");
+      break;
+    }
+  }
+}
+
+template <typename Setup, typename Call>
+void runDelete(benchmark::State &state, Setup setup, Call call) {
+  Fixture *f = fixture(state);
+  if (!f) {
+    return;
+  }
+  QuietOutput quiet;
+  for (auto _ : state) {
+    state.PauseTiming();
+    int id = setup(*f);
+    state.ResumeTiming();
+    if (id <= 0 || !call(*f, id)) {
+      state.SkipWithError("RPC failed");
+      break;
+    }
+  }
+}
+
+// The raw reads, as the server runs them on a cache miss
+bool rawRead(Fixture &f, recloser::RawRead method,
+             const google::protobuf::Message &request) {
+  std::string key =
+      recloser::RecloserServiceImpl::rawReadKey(method, serialize(request));
+  grpc::ByteBuffer payload;
+  return f.service->buildRawRead(key, &payload).ok();
+}
+
+int newestId(const std::vector<int> &ids) {
+  return ids.empty() ? 0 : *std::max_element(ids.begin(), ids.end());
+}
+
+void BM_GetServiceTree(benchmark::State &state) {
+  runCall(state, [](Fixture &f) {
+    recloser::ServiceTreeRequest request;
+    request.set_firmware_id(f.sample.firmwareId);
+    return rawRead(f, recloser::RawRead::SERVICE_TREE, request);
+  });
+}
+
+void BM_GetScreenLayout(benchmark::State &state) {
+  runCall(state, [](Fixture &f) {
+    recloser::ScreenLayoutRequest request;
+    request.set_service_id(f.sample.topServiceFirmwareId);
+    return rawRead(f, recloser::RawRead::SCREEN_LAYOUT, request);
+  });
+}
+
+void BM_GetFullInventory(benchmark::State &state) {
+  runCall(state, [](Fixture &f) {
+    return rawRead(f, recloser::RawRead::FULL_INVENTORY,
+                   recloser::FullInventoryRequest());
+  });
+}
+
+void BM_StreamFullInventory(benchmark::State &state) {
+  runCall(state, [](Fixture &f) {
+    recloser::InventoryCursor cursor =
+        f.service->startInventory(recloser::FullInventoryRequest());
+    recloser::InventoryChunk chunk;
+    size_t bytes = 0;
+    while (f.service->nextInventoryChunk(cursor, &chunk)) {
+      bytes += chunk.ByteSizeLong();
+      chunk.Clear();
+    }
+    return bytes > 0;
+  });
+}
+
+void BM_CompareServiceTrees(benchmark::State &state) {
+  runCall(state, [](Fixture &f) {
+    recloser::CompareServiceTreesRequest request;
+    request.set_firmware_id_1(f.sample.firmwareId);
+    request.set_firmware_id_2(f.sample.otherFirmwareId);
+    request.set_language_code("enUs");
+    recloser::CompareServiceTreesResponse response;
+    return f.service->CompareServiceTrees(nullptr, &request, &response).ok();
+  });
+}
+
+void BM_CompareFirmwareSet(benchmark::State &state) {
+  runCall(state, [](Fixture &f) {
+    recloser::CompareFirmwareSetRequest request;
+    for (int32_t id : f.firmwareIds) {
+      request.add_firmware_ids(id);
+    }
+    request.set_language_code("enUs");
+    recloser::CompareFirmwareSetResponse response;
+    return f.service->CompareFirmwareSet(nullptr, &request, &response).ok();
+  });
+}
+
+void BM_SearchCatalog(benchmark::State &state) {
+  runCall(state, [](Fixture &f) {
+    recloser::SearchCatalogRequest request;
+    request.set_query("phase del");
+    recloser::SearchCatalogResponse response;
+    return f.service->SearchCatalog(nullptr, &request, &response).ok();
+  });
+}
+
+void BM_GetServerStats(benchmark::State &state) {
+  runCall(state, [](Fixture &f) {
+    recloser::ServerStatsRequest request;
+    recloser::ServerStatsResponse response;
+    return f.service->GetServerStats(nullptr, &request, &response).ok();
+  });
+}
+
+void BM_CreateRecloser(benchmark::State &state) {
+  runWrite(
+      state,
+      [](Fixture &f) {
+        recloser::RecloserRecord request;
+        request.set_description_key(SPARE_KEY);
+        recloser::GenericResponse response;
+        f.service->CreateRecloser(nullptr, &request, &response);
+        return response.success();
+      },
+      [](Fixture &f) {
+        std::vector<int> ids;
+        for (const auto &r : f.manager->getAllReclosers()) {
+          ids.push_back(r.id);
+        }
+        return f.manager->deleteRecloser(newestId(ids));
+      });
+}
+
+void BM_UpdateRecloser(benchmark::State &state) {
+  bool renamed = false;
+  runCall(state, [&renamed](Fixture &f) {
+    renamed = !renamed;
+    recloser::RecloserRecord request;
+    request.set_id(f.sample.recloserId);
+    request.set_description_key(renamed ? SPARE_KEY : f.recloserKey);
+    recloser::GenericResponse response;
+    f.service->UpdateRecloser(nullptr, &request, &response);
+    return response.success();
+  });
+  if (renamed) { // put the original back for the next run
+    QuietOutput quiet;
+    Fixture *f = fixture(state);
+    f->manager->updateRecloser(f->sample.recloserId, f->recloserKey);
+    f->catalog->publish();
+  }
+}
+
+void BM_DeleteRecloser(benchmark::State &state) {
+  runDelete(
+      state, [](Fixture &f) { return f.manager->addRecloser(SPARE_KEY); },
+      [](Fixture &f, int id) {
+        recloser::DeleteRequest request;
+        request.set_id(id);
+        recloser::GenericResponse response;
+        f.service->DeleteRecloser(nullptr, &request, &response);
+        return response.success();
+      });
+}
+
+void BM_CreateFirmware(benchmark::State &state) {
+  runWrite(
+      state,
+      [](Fixture &f) {
+        recloser::FirmwareRecord request;
+        request.set_version("bench");
+        request.set_recloser_id(f.sample.recloserId);
+        recloser::GenericResponse response;
+        f.service->CreateFirmware(nullptr, &request, &response);
+        return response.success();
+      },
+      [](Fixture &f) {
+        std::vector<int> ids;
+        for (const auto &fw :
+             f.manager->getFirmwareVersionsForRecloser(f.sample.recloserId)) {
+          ids.push_back(fw.id);
+        }
+        return f.manager->deleteFirmwareVersion(newestId(ids));
+      });
+}
+
+void BM_UpdateFirmware(benchmark::State &state) {
+  bool renamed = false;
+  runCall(state, [&renamed](Fixture &f) {
+    renamed = !renamed;
+    recloser::FirmwareRecord request;
+    request.set_id(f.sample.firmwareId);
+    request.set_version(renamed ? "bench" : f.firmwareVersion);
+    request.set_recloser_id(f.sample.recloserId);
+    recloser::GenericResponse response;
+    f.service->UpdateFirmware(nullptr, &request, &response);
+    return response.success();
+  });
+  if (renamed) { // put the original back for the next run
+    QuietOutput quiet;
+    Fixture *f = fixture(state);
+    f->manager->updateFirmwareVersion(f->sample.firmwareId, f->firmwareVersion,
+                                      f->sample.recloserId);
+    f->catalog->publish();
+  }
+}
+
+void BM_DeleteFirmware(benchmark::State &state) {
+  runDelete(
+      state,
+      [](Fixture &f) {
+        return f.manager->addFirmwareVersion("bench", f.sample.recloserId);
+      },
+      [](Fixture &f, int id) {
+        recloser::DeleteRequest request;
+        request.set_id(id);
+        recloser::GenericResponse response;
+        f.service->DeleteFirmware(nullptr, &request, &response);
+        return response.success();
+      });
+}
+
+void BM_CloneFirmware(benchmark::State &state) {
+  int cloneId = 0;
+  runWrite(
+      state,
+      [&cloneId](Fixture &f) {
+        recloser::CloneFirmwareRequest request;
+        request.set_source_firmware_id(f.sample.firmwareId);
+        request.set_version("bench");
+        recloser::CloneFirmwareResponse response;
+        f.service->CloneFirmware(nullptr, &request, &response);
+        cloneId = response.firmware_id();
+        return cloneId > 0;
+      },
+      [&cloneId](Fixture &f) {
+        return f.manager->deleteFirmwareVersion(cloneId);
+      });
+}
+
+void BM_AddServiceNode(benchmark::State &state) {
+  runWrite(
+      state,
+      [](Fixture &f) {
+        recloser::ServiceRecord request;
+        request.set_description_key(SPARE_KEY);
+        request.set_parent_id(f.sample.leafServiceId);
+        request.set_firmware_id(f.sample.firmwareId);
+        recloser::GenericResponse response;
+        f.service->AddServiceNode(nullptr, &request, &response);
+        return response.success();
+      },
+      [](Fixture &f) {
+        bool ok = true;
+        for (const auto &s : f.manager->getServicesByParentAndFirmware(
+                 f.sample.leafServiceId, f.sample.firmwareId)) {
+          ok = f.manager->deleteService(s.id) && ok;
+        }
+        return ok;
+      });
+}
+
+void BM_UpdateServiceNode(benchmark::State &state) {
+  bool renamed = false;
+  runCall(state, [&renamed](Fixture &f) {
+    renamed = !renamed;
+    recloser::ServiceRecord request;
+    request.set_id(f.sample.leafServiceId);
+    request.set_description_key(renamed ? SPARE_KEY : f.leafServiceKey);
+    request.set_parent_id(f.leafParentId);
+    recloser::GenericResponse response;
+    f.service->UpdateServiceNode(nullptr, &request, &response);
+    return response.success();
+  });
+  if (renamed) { // put the original back for the next run
+    QuietOutput quiet;
+    Fixture *f = fixture(state);
+    f->manager->updateService(f->sample.leafServiceId, f->leafServiceKey,
+                              f->leafParentId);
+    f->catalog->publish();
+  }
+}
+
+void BM_DeleteServiceNode(benchmark::State &state) {
+  runDelete(
+      state,
+      [](Fixture &f) {
+        return f.manager->addService(SPARE_KEY, f.sample.leafServiceId);
+      },
+      [](Fixture &f, int id) {
+        recloser::DeleteRequest request;
+        request.set_id(id);
+        recloser::GenericResponse response;
+        f.service->DeleteServiceNode(nullptr, &request, &response);
+        return response.success();
+      });
+}
+
+void BM_CreateFeature(benchmark::State &state) {
+  runWrite(
+      state,
+      [](Fixture &f) {
+        recloser::FeatureRecord request;
+        request.set_description_key(SPARE_KEY);
+        request.set_service_id(f.sample.leafServiceFirmwareId);
+        recloser::GenericResponse response;
+        f.service->CreateFeature(nullptr, &request, &response);
+        return response.success();
+      },
+      [](Fixture &f) {
+        std::vector<int> ids;
+        for (const auto &feature : f.manager->getFeaturesByServiceFirmware(
+                 f.sample.leafServiceFirmwareId)) {
+          ids.push_back(feature.id);
+        }
+        return f.manager->deleteFeature(newestId(ids));
+      });
+}
+
+void BM_UpdateFeature(benchmark::State &state) {
+  bool renamed = false;
+  runCall(state, [&renamed](Fixture &f) {
+    renamed = !renamed;
+    recloser::FeatureRecord request;
+    request.set_id(f.sample.featureId);
+    request.set_description_key(renamed ? SPARE_KEY : f.sample.featureKey);
+    request.set_service_id(f.sample.leafServiceFirmwareId);
+    recloser::GenericResponse response;
+    f.service->UpdateFeature(nullptr, &request, &response);
+    return response.success();
+  });
+  if (renamed) { // put the original back for the next run
+    QuietOutput quiet;
+    Fixture *f = fixture(state);
+    f->manager->updateFeature(f->sample.featureId, f->sample.featureKey,
+                              f->sample.leafServiceFirmwareId);
+    f->catalog->publish();
+  }
+}
+
+void BM_DeleteFeature(benchmark::State &state) {
+  runDelete(
+      state,
+      [](Fixture &f) {
+        return f.manager->addFeature(SPARE_KEY,
+                                     f.sample.leafServiceFirmwareId);
+      },
+      [](Fixture &f, int id) {
+        recloser::DeleteRequest request;
+        request.set_id(id);
+        recloser::GenericResponse response;
+        f.service->DeleteFeature(nullptr, &request, &response);
+        return response.success();
+      });
+}
+
+// A new service under the sample leaf with four features, each with a
+// component and a limit: 13 steps in one transaction
+void BM_ApplyChangeSet(benchmark::State &state) {
+  int serviceId = 0;
+  runWrite(
+      state,
+      [&serviceId](Fixture &f) {
+        recloser::ChangeSetRequest request;
+        auto *op = request.add_operations();
+        op->set_action(recloser::CHANGE_CREATE);
+        op->set_temp_id(1);
+        op->mutable_service()->set_description_key(SPARE_KEY);
+        op->mutable_service()->set_parent_id(f.sample.leafServiceId);
+        op->mutable_service()->set_firmware_id(f.sample.firmwareId);
+        for (int i = 0; i < 4; ++i) {
+          int featureTempId = 2 + 2 * i;
+          op = request.add_operations();
+          op->set_action(recloser::CHANGE_CREATE);
+          op->set_temp_id(featureTempId);
+          op->mutable_feature()->set_description_key(f.sample.featureKey);
+          op->mutable_feature()->set_service_id(-1);
+
+          op = request.add_operations();
+          op->set_action(recloser::CHANGE_CREATE);
+          op->set_temp_id(featureTempId + 1);
+          op->mutable_feature_component()->set_feature_id(-featureTempId);
+          op->mutable_feature_component()->set_component_type("Integer");
+
+          op = request.add_operations();
+          op->set_action(recloser::CHANGE_CREATE);
+          auto *limit = op->mutable_component_limit();
+          limit->set_feature_component_id(-(featureTempId + 1));
+          limit->set_limit_key("MIN_VALUE");
+          limit->set_value("1");
+        }
+        recloser::ChangeSetResponse response;
+        f.service->ApplyChangeSet(nullptr, &request, &response);
+        serviceId = response.results_size() > 0 ? response.results(0).id() : 0;
+        return response.success();
+      },
+      [&serviceId](Fixture &f) { return f.manager->deleteService(serviceId); });
+}
+
+} // namespace
+
+#define CATALOG_BENCHMARK(name)                                                \
+  BENCHMARK(name)                                                              \
+      ->ArgName("rows")                                                        \
+      ->Arg(1000)                                                              \
+      ->Arg(100000)                                                            \
+      ->Arg(1000000)                                                           \
+      ->Unit(benchmark::kMillisecond)
+
+CATALOG_BENCHMARK(BM_GetServiceTree);
+CATALOG_BENCHMARK(BM_GetScreenLayout);
+CATALOG_BENCHMARK(BM_GetFullInventory);
+CATALOG_BENCHMARK(BM_StreamFullInventory);
+CATALOG_BENCHMARK(BM_CompareServiceTrees);
+CATALOG_BENCHMARK(BM_CompareFirmwareSet);
+CATALOG_BENCHMARK(BM_SearchCatalog);
+CATALOG_BENCHMARK(BM_GetServerStats);
+CATALOG_BENCHMARK(BM_CreateRecloser);
+CATALOG_BENCHMARK(BM_UpdateRecloser);
+CATALOG_BENCHMARK(BM_DeleteRecloser);
+CATALOG_BENCHMARK(BM_CreateFirmware);
+CATALOG_BENCHMARK(BM_UpdateFirmware);
+CATALOG_BENCHMARK(BM_DeleteFirmware);
+CATALOG_BENCHMARK(BM_CloneFirmware);
+CATALOG_BENCHMARK(BM_AddServiceNode);
+CATALOG_BENCHMARK(BM_UpdateServiceNode);
+CATALOG_BENCHMARK(BM_DeleteServiceNode);
+CATALOG_BENCHMARK(BM_CreateFeature);
+CATALOG_BENCHMARK(BM_UpdateFeature);
+CATALOG_BENCHMARK(BM_DeleteFeature);
+CATALOG_BENCHMARK(BM_ApplyChangeSet);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,97 @@
+#include "CatalogGenerator.hpp"
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <optional>
+#include <string>
+
+// Inserting features one autocommit at a time versus inside a single
+// RecloserManager::Transaction, under the durable profile (an fsync per
+// commit) and the balanced one (WAL with synchronous NORMAL). Each run
+// starts from an empty database.
+
+namespace {
+
+constexpr int FEATURE_COUNT = 100000;
+
+ConnectionProfile profileFor(int64_t index) {
+  return index == 0 ? ConnectionProfile::durable()
+                    : ConnectionProfile::balanced();
+}
+
+struct Fixture : TempDatabase {
+  int serviceFirmwareId = 0;
+
+  explicit Fixture(const ConnectionProfile &profile)
+      : TempDatabase("recloser_tx_bench.db", 0, profile) {
+    if (!manager) {
+      return;
+    }
+    manager->addDescriptionKey("BENCH_RECLOSER");
+    manager->addDescriptionKey("BENCH_SERVICE");
+    manager->addDescriptionKey("BENCH_FEATURE");
+    int firmwareId = manager->addFirmwareVersion(
+        "v1.0.0", manager->addRecloser("BENCH_RECLOSER"));
+    serviceFirmwareId = manager->linkServiceToFirmware(
+        manager->addService("BENCH_SERVICE"), firmwareId);
+  }
+};
+
+void insertFeatures(benchmark::State &state, bool inTransaction) {
+  ConnectionProfile profile = profileFor(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto fixture = std::make_unique<Fixture>(profile);
+    if (fixture->serviceFirmwareId == 0) {
+      state.SkipWithError("failed to create the benchmark database");
+      return;
+    }
+    RecloserManager &manager = *fixture->manager;
+    state.ResumeTiming();
+
+    std::optional<RecloserManager::Transaction> transaction;
+    if (inTransaction) {
+      transaction.emplace(manager);
+    }
+    for (int i = 0; i < FEATURE_COUNT; ++i) {
+      manager.addFeature("BENCH_FEATURE", fixture->serviceFirmwareId);
+    }
+    if (transaction && !transaction->commit()) {
+      state.SkipWithError("commit failed");
+      return;
+    }
+
+    state.PauseTiming();
+    fixture.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * FEATURE_COUNT);
+  state.SetLabel(profile.name);
+}
+
+void BM_InsertFeaturesAutocommit(benchmark::State &state) {
+  insertFeatures(state, false);
+}
+
+void BM_InsertFeaturesTransaction(benchmark::State &state) {
+  insertFeatures(state, true);
+}
+
+} // namespace
+
+BENCHMARK(BM_InsertFeaturesAutocommit)
+    ->ArgName("profile")
+    ->Arg(0)
+    ->Arg(1)
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_InsertFeaturesTransaction)
+    ->ArgName("profile")
+    ->Arg(0)
+    ->Arg(1)
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -100,3 +100,164 @@ CREATE TABLE IF NOT EXISTS FeatureComponentLimits (
     FOREIGN KEY (feature_component_id) REFERENCES FeatureComponent(id) ON DELETE CASCADE,
     FOREIGN KEY (limit_id) REFERENCES Limits(id) ON DELETE CASCADE
 );
+
+-- Secondary indexes on the hot foreign keys (migration version 2)
+CREATE INDEX IF NOT EXISTS idx_firmware_versions_recloser_id ON FirmwareVersions (recloser_id);
+CREATE INDEX IF NOT EXISTS idx_services_parent_id ON Services (parent_id);
+CREATE INDEX IF NOT EXISTS idx_service_firmware_firmware_id ON ServiceFirmware (firmware_id);
+CREATE INDEX IF NOT EXISTS idx_features_service_firmware_id ON Features (service_firmware_id);
+CREATE INDEX IF NOT EXISTS idx_feature_component_feature_id ON FeatureComponent (feature_id);
+CREATE INDEX IF NOT EXISTS idx_feature_component_limits_fc_id ON FeatureComponentLimits (feature_component_id);
+
+-- Catalog revision, bumped on every change to a catalog table so a saved
+-- snapshot file can tell whether it still matches (migrations 3 and 5)
+CREATE TABLE IF NOT EXISTS CatalogRevision (
+    id INTEGER PRIMARY KEY CHECK (id = 1),
+    origin INTEGER NOT NULL,
+    revision INTEGER NOT NULL,
+    tracking INTEGER NOT NULL DEFAULT 1
+);
+INSERT OR IGNORE INTO CatalogRevision (id, origin, revision) VALUES (1, random(), 0);
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Descriptions_INSERT AFTER INSERT ON Descriptions
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Descriptions_UPDATE AFTER UPDATE ON Descriptions
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Descriptions_DELETE AFTER DELETE ON Descriptions
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Translations_INSERT AFTER INSERT ON Translations
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Translations_UPDATE AFTER UPDATE ON Translations
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Translations_DELETE AFTER DELETE ON Translations
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Reclosers_INSERT AFTER INSERT ON Reclosers
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Reclosers_UPDATE AFTER UPDATE ON Reclosers
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Reclosers_DELETE AFTER DELETE ON Reclosers
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_FirmwareVersions_INSERT AFTER INSERT ON FirmwareVersions
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_FirmwareVersions_UPDATE AFTER UPDATE ON FirmwareVersions
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_FirmwareVersions_DELETE AFTER DELETE ON FirmwareVersions
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Services_INSERT AFTER INSERT ON Services
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Services_UPDATE AFTER UPDATE ON Services
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Services_DELETE AFTER DELETE ON Services
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_ServiceFirmware_INSERT AFTER INSERT ON ServiceFirmware
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_ServiceFirmware_UPDATE AFTER UPDATE ON ServiceFirmware
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_ServiceFirmware_DELETE AFTER DELETE ON ServiceFirmware
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Features_INSERT AFTER INSERT ON Features
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Features_UPDATE AFTER UPDATE ON Features
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Features_DELETE AFTER DELETE ON Features
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Component_INSERT AFTER INSERT ON Component
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Component_UPDATE AFTER UPDATE ON Component
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Component_DELETE AFTER DELETE ON Component
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_FeatureComponent_INSERT AFTER INSERT ON FeatureComponent
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_FeatureComponent_UPDATE AFTER UPDATE ON FeatureComponent
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_FeatureComponent_DELETE AFTER DELETE ON FeatureComponent
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Limits_INSERT AFTER INSERT ON Limits
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Limits_UPDATE AFTER UPDATE ON Limits
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_Limits_DELETE AFTER DELETE ON Limits
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_FeatureComponentLimits_INSERT AFTER INSERT ON FeatureComponentLimits
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_FeatureComponentLimits_UPDATE AFTER UPDATE ON FeatureComponentLimits
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+CREATE TRIGGER IF NOT EXISTS catalog_revision_FeatureComponentLimits_DELETE AFTER DELETE ON FeatureComponentLimits
+    WHEN (SELECT tracking FROM CatalogRevision WHERE id = 1)
+    BEGIN UPDATE CatalogRevision SET revision = revision + 1 WHERE id = 1; END;
+
+-- Service hierarchy closure, one row per (ancestor, descendant) pair with
+-- every service its own ancestor at depth 0 (migration version 4)
+CREATE TABLE IF NOT EXISTS ServiceClosure (
+    ancestor_id INTEGER NOT NULL,
+    descendant_id INTEGER NOT NULL,
+    depth INTEGER NOT NULL,
+    PRIMARY KEY (ancestor_id, descendant_id),
+    FOREIGN KEY (ancestor_id) REFERENCES Services(id) ON DELETE CASCADE,
+    FOREIGN KEY (descendant_id) REFERENCES Services(id) ON DELETE CASCADE
+) WITHOUT ROWID;
+CREATE INDEX IF NOT EXISTS idx_service_closure_descendant_id ON ServiceClosure (descendant_id, depth);
+
+-- Full-text search over translation values and description keys (migration
+-- version 5)
+CREATE INDEX IF NOT EXISTS idx_features_description_key ON Features (description_key);
+CREATE VIRTUAL TABLE IF NOT EXISTS TranslationSearch USING fts5(
+    value, content = 'Translations', content_rowid = 'id',
+    tokenize = 'unicode61 remove_diacritics 2', prefix = '2 3 4 5 6 7 8'
+);
+CREATE VIRTUAL TABLE IF NOT EXISTS DescriptionSearch USING fts5(
+    key, content = 'Descriptions',
+    tokenize = 'unicode61 remove_diacritics 2', prefix = '2 3 4 5 6 7 8'
+);
+CREATE TRIGGER IF NOT EXISTS TranslationSearch_insert AFTER INSERT ON Translations BEGIN
+    INSERT INTO TranslationSearch (rowid, value) VALUES (new.id, new.value);
+END;
+CREATE TRIGGER IF NOT EXISTS TranslationSearch_delete AFTER DELETE ON Translations BEGIN
+    INSERT INTO TranslationSearch (TranslationSearch, rowid, value) VALUES ('delete', old.id, old.value);
+END;
+CREATE TRIGGER IF NOT EXISTS TranslationSearch_update AFTER UPDATE OF value ON Translations BEGIN
+    INSERT INTO TranslationSearch (TranslationSearch, rowid, value) VALUES ('delete', old.id, old.value);
+    INSERT INTO TranslationSearch (rowid, value) VALUES (new.id, new.value);
+END;
+CREATE TRIGGER IF NOT EXISTS DescriptionSearch_insert AFTER INSERT ON Descriptions BEGIN
+    INSERT INTO DescriptionSearch (rowid, key) VALUES (new.rowid, new.key);
+END;
+CREATE TRIGGER IF NOT EXISTS DescriptionSearch_delete AFTER DELETE ON Descriptions BEGIN
+    INSERT INTO DescriptionSearch (DescriptionSearch, rowid, key) VALUES ('delete', old.rowid, old.key);
+END;
+CREATE TRIGGER IF NOT EXISTS DescriptionSearch_update AFTER UPDATE OF key ON Descriptions BEGIN
+    INSERT INTO DescriptionSearch (DescriptionSearch, rowid, key) VALUES ('delete', old.rowid, old.key);
+    INSERT INTO DescriptionSearch (rowid, key) VALUES (new.rowid, new.key);
+END;
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <google/protobuf/arena.h>
+
+// Sizes the per-call arena of one kind of response from the last one built.
+//
+// A response about as large as the previous one then fits in the arena's
+// first block: one allocation instead of a chain of blocks growing from the
+// default 256 bytes, freed in one go with the arena instead of message by
+// message. Shared by concurrent calls; racing updates only lose a sample.
+class ArenaSizeHint {
+public:
+  google::protobuf::ArenaOptions options() const;
+
+  // Remembers how much of the arena the finished response used
+  void record(const google::protobuf::Arena &arena);
+
+  size_t lastBytes() const { return bytes.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<size_t> bytes{0};
+};
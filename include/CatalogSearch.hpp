@@ -0,0 +1,32 @@
+#pragma once
+
+#include "ConnectionPool.hpp"
+#include "RecloserManager.hpp"
+#include <string>
+#include <vector>
+
+// Full-text search over the TranslationSearch and DescriptionSearch FTS5
+// indexes. Free text is split into words that must all match, the last one
+// as a prefix so results follow the user's typing. Each feature or service
+// whose description key matched, through the key itself or one of its
+// translations, is one hit per firmware it appears in, ranked by the
+// length of the key's shortest matched text.
+class CatalogSearch {
+public:
+  explicit CatalogSearch(ConnectionPool &connections);
+
+  RecloserManager::CatalogSearchResult search(const std::string &text,
+                                              const std::string &languageCode,
+                                              int limit, int offset);
+
+  // FTS5 MATCH expression for free text, empty if it holds no words, and a
+  // LIKE pattern the matched text must also satisfy
+  struct Query {
+    std::string match;
+    std::string like;
+  };
+  static Query parseQuery(const std::string &text);
+
+private:
+  ConnectionPool &connections;
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include "MappedFile.hpp"
+#include "StatementCache.hpp"
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Immutable, in-memory copy of the whole catalog.
+//
+// Every table lives in a flat array. Rows that belong to a parent are stored
+// contiguously in the order the SQL read paths return them (features by id
+// within their ServiceFirmware, limits by id within their component, ...),
+// so a parent only needs a Range into the child array. Firmwares and
+// ServiceFirmware nodes are additionally indexed by their database id.
+// Strings are interned into a single string table.
+//
+// A snapshot is never modified after build(); readers share it through a
+// std::shared_ptr and never touch SQLite.
+//
+// The same arrays can be written to a snapshot file with save() and served
+// straight from a read-only mapping of that file with open(), see
+// src/CatalogSnapshotFile.cpp for the format.
+class CatalogSnapshot {
+public:
+  using StringId = uint32_t;
+
+  struct Range {
+    uint32_t begin = 0;
+    uint32_t count = 0;
+  };
+
+  struct TranslationEntry {
+    StringId languageCode;
+    StringId value;
+  };
+
+  struct LimitEntry {
+    StringId key;
+    StringId value;
+  };
+
+  struct ComponentEntry {
+    int32_t id;
+    StringId type;
+    Range limits;
+  };
+
+  struct FeatureEntry {
+    int32_t id;
+    StringId descriptionKey;
+    Range components;
+  };
+
+  // One ServiceFirmware row: a service as it appears in one firmware
+  struct ServiceNodeEntry {
+    int32_t id = 0; // ServiceFirmware id, 0 if the slot is unused
+    int32_t serviceId = 0;
+    int32_t firmwareId = 0;
+    int32_t parentNodeId = 0; // 0 for top-level or orphaned nodes
+    StringId descriptionKey = 0;
+    Range features;
+    Range children; // into childNodeIds and childNodeIdsByKey
+    uint32_t reserved = 0; // spells out the padding, which save() writes
+    // Content hash of the whole subtree: description key and its
+    // translations, features with their components and limits, and the
+    // children's hashes. Equal hashes mean equal subtrees, in this snapshot
+    // or any other. 0 for nodes not reachable from a firmware's top level.
+    uint64_t subtreeHash = 0;
+  };
+
+  struct FirmwareEntry {
+    int32_t id = 0; // 0 if the slot is unused
+    int32_t recloserId = 0;
+    StringId version = 0;
+    Range topLevelNodes; // into childNodeIds and childNodeIdsByKey
+    uint32_t reserved = 0; // spells out the padding, which save() writes
+    // Revision of the firmware's service tree: a hash over its top-level
+    // subtree hashes, stable across snapshots while the tree is unchanged
+    uint64_t contentHash = 0;
+  };
+
+  struct RecloserEntry {
+    int32_t id;
+    StringId descriptionKey;
+    Range firmwares; // into firmwareIds
+  };
+
+  // Identifies the database state a snapshot was built from: the random
+  // origin tells databases apart, the revision counts catalog changes
+  struct Revision {
+    int64_t origin = 0;
+    int64_t revision = 0;
+    bool operator==(const Revision &other) const {
+      return origin == other.origin && revision == other.revision;
+    }
+  };
+
+  template <typename T> struct View {
+    const T *first;
+    const T *last;
+    const T *begin() const { return first; }
+    const T *end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+    const T &operator[](size_t index) const { return first[index]; }
+  };
+
+  CatalogSnapshot();
+  ~CatalogSnapshot();
+
+  // Loads every catalog table through the given connection
+  static std::shared_ptr<const CatalogSnapshot> build(StatementCache &statements,
+                                                      uint64_t version);
+
+  // Reads the CatalogRevision row; nullopt if the query fails
+  static std::optional<Revision> readRevision(StatementCache &statements);
+
+  // Maps a file written by save(). Returns nullptr, logging why, if the file
+  // is missing, damaged, from another format version or byte order, or was
+  // not saved from the expected revision.
+  static std::shared_ptr<const CatalogSnapshot>
+  open(const std::string &path, uint64_t version, const Revision &expected);
+
+  // Writes the snapshot to a temporary file and renames it over path
+  bool save(const std::string &path) const;
+
+  uint64_t version() const { return version_; }
+  const Revision &revision() const { return revision_; }
+  // True if the arrays live in a mapped snapshot file
+  bool mapped() const { return file != nullptr; }
+
+  std::string_view string(StringId id) const;
+
+  View<RecloserEntry> reclosers() const { return reclosers_; }
+
+  const FirmwareEntry *firmware(int32_t id) const;
+  const ServiceNodeEntry *node(int32_t serviceFirmwareId) const;
+
+  // Range resolution helpers
+
+  View<int32_t> firmwareIdsOf(const RecloserEntry &recloser) const;
+  View<int32_t> topLevelNodeIdsOf(const FirmwareEntry &firmware) const;
+  View<int32_t> childNodeIdsOf(const ServiceNodeEntry &node) const;
+  // Same nodes as above, ordered by description key instead of service id
+  View<int32_t> topLevelNodeIdsByKeyOf(const FirmwareEntry &firmware) const;
+  View<int32_t> childNodeIdsByKeyOf(const ServiceNodeEntry &node) const;
+  View<FeatureEntry> featuresOf(const ServiceNodeEntry &node) const;
+  View<ComponentEntry> componentsOf(const FeatureEntry &feature) const;
+  View<LimitEntry> limitsOf(const ComponentEntry &component) const;
+  // Translations of a description key, in language code order
+  View<TranslationEntry> translationsOf(StringId descriptionKey) const;
+
+  // Translation of a description key in one language, empty if missing
+  std::string_view translation(StringId descriptionKey,
+                               std::string_view languageCode) const;
+
+  size_t nodeCount() const { return nodeCount_; }
+  size_t featureCount() const { return features_.size(); }
+
+private:
+  class Builder;
+  struct Tables;
+
+  template <typename T> static View<T> slice(View<T> items, Range range) {
+    return View<T>{items.first + range.begin,
+                   items.first + range.begin + range.count};
+  }
+
+  // Points the views below at the owned tables
+  void bind();
+
+  // What makes the views of a mapped file unsafe to read, such as a range,
+  // node id or string id past its table; nullptr if they match what build()
+  // produces
+  const char *inconsistency() const;
+
+  uint64_t version_ = 0;
+  Revision revision_;
+  size_t nodeCount_ = 0;
+
+  // Backing storage: tables built from SQLite, or a mapped snapshot file
+  std::unique_ptr<Tables> tables;
+  std::unique_ptr<MappedFile> file;
+
+  View<char> stringData{};
+  View<uint32_t> stringOffsets{}; // size() == string count + 1
+  View<RecloserEntry> reclosers_{};
+  View<int32_t> firmwareIds{};
+  View<FirmwareEntry> firmwaresById{};
+  View<ServiceNodeEntry> nodesById{};
+  View<int32_t> childNodeIds{};
+  View<int32_t> childNodeIdsByKey{};
+  View<FeatureEntry> features_{};
+  View<ComponentEntry> components_{};
+  View<LimitEntry> limits_{};
+  View<TranslationEntry> translations_{};
+  View<Range> translationsByString{}; // indexed by StringId
+};
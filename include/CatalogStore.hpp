@@ -0,0 +1,64 @@
+#pragma once
+
+#include "CatalogSnapshot.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class RecloserManager;
+
+// Holds the current CatalogSnapshot behind an atomically swapped pointer.
+//
+// Readers call current() and keep the returned pointer for the duration of a
+// request; writers call publish() after a successful change, which rebuilds
+// the snapshot from SQLite and swaps it in with the next version number.
+//
+// With a snapshot file configured, published snapshots are also saved to
+// it by a background thread, after they are swapped in; a burst of
+// publishes saves only the latest. load() maps that file at startup instead
+// of reading SQLite as long as the catalog has not changed since.
+class CatalogStore {
+public:
+  explicit CatalogStore(RecloserManager *manager,
+                        std::string snapshotFile = {});
+  ~CatalogStore(); // saves a pending snapshot, then stops the saver
+
+  CatalogStore(const CatalogStore &) = delete;
+  CatalogStore &operator=(const CatalogStore &) = delete;
+
+  std::shared_ptr<const CatalogSnapshot> current() const;
+
+  // Publishes the first snapshot: the mapped snapshot file if it is current,
+  // otherwise one built from SQLite
+  bool load();
+
+  // Rebuilds and swaps in a new snapshot; returns false (keeping the
+  // previous snapshot) if the rebuild fails
+  bool publish();
+
+  uint64_t version() const;
+
+private:
+  void swapIn(std::shared_ptr<const CatalogSnapshot> next);
+  void saveLatest();
+
+  RecloserManager *manager;
+  std::string snapshotFile;
+  std::mutex publishMutex;
+  uint64_t nextVersion = 1;
+#if defined(__cpp_lib_atomic_shared_ptr)
+  std::atomic<std::shared_ptr<const CatalogSnapshot>> snapshot;
+#else
+  std::shared_ptr<const CatalogSnapshot> snapshot;
+#endif
+
+  std::mutex saveMutex;
+  std::condition_variable saveWake;
+  std::shared_ptr<const CatalogSnapshot> pendingSave; // guarded by saveMutex
+  bool stopping = false;                              // guarded by saveMutex
+  std::thread saver; // only with a snapshot file
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct CompareCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t invalidations = 0; // lookups that found an outdated revision
+  uint64_t evictions = 0;
+  size_t entries = 0;
+  size_t bytes = 0;
+  size_t capacityBytes = 0;
+};
+
+// LRU cache of serialized CompareServiceTreesResponse messages.
+//
+// Entries are keyed by (firmware_id_1, firmware_id_2, language_code) and
+// remember the content revision of both firmwares they were computed from;
+// a lookup with a different revision for either firmware drops the entry.
+// The total size of keys and payloads (plus a fixed per-entry overhead) is
+// kept under the byte capacity by evicting least recently used entries.
+class CompareCache {
+public:
+  struct Key {
+    int32_t firmwareId1;
+    int32_t firmwareId2;
+    std::string languageCode;
+
+    bool operator==(const Key &other) const {
+      return firmwareId1 == other.firmwareId1 &&
+             firmwareId2 == other.firmwareId2 &&
+             languageCode == other.languageCode;
+    }
+  };
+
+  explicit CompareCache(size_t capacityBytes);
+
+  // Returns nullptr on a miss
+  std::shared_ptr<const std::string> lookup(const Key &key, uint64_t revision1,
+                                            uint64_t revision2);
+
+  void store(const Key &key, uint64_t revision1, uint64_t revision2,
+             std::string payload);
+
+  CompareCacheStats stats() const;
+
+private:
+  struct KeyHash {
+    size_t operator()(const Key &key) const;
+  };
+
+  struct Entry {
+    Key key;
+    uint64_t revision1;
+    uint64_t revision2;
+    std::shared_ptr<const std::string> payload;
+    size_t bytes;
+  };
+
+  using EntryList = std::list<Entry>;
+
+  void erase(EntryList::iterator entry);
+
+  size_t capacityBytes;
+  mutable std::mutex mutex;
+  EntryList lru; // most recently used first
+  std::unordered_map<Key, EntryList::iterator, KeyHash> index;
+  size_t bytes = 0;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t invalidations = 0;
+  uint64_t evictions = 0;
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "StatementCache.hpp"
+#include "StatementMetrics.hpp"
+#include "sqlite3.h"
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// PRAGMA settings applied to the connections of a ConnectionPool
+struct ConnectionProfile {
+  std::string name;
+  std::string synchronous; // OFF, NORMAL or FULL (writer only)
+  int cacheSizeKiB = 2000; // page cache of each connection
+  int64_t mmapSizeBytes = 0; // 0 disables memory-mapped I/O
+
+  // fsync on every commit, default cache, no mmap
+  static ConnectionProfile durable();
+  // WAL-safe NORMAL sync, 16 MiB cache, 64 MiB mmap
+  static ConnectionProfile balanced();
+  // No fsync, 64 MiB cache, 256 MiB mmap; for benchmarks and bulk loads
+  static ConnectionProfile throughput();
+
+  static std::optional<ConnectionProfile> byName(const std::string &name);
+};
+
+struct ConnectionPoolStats {
+  size_t readers = 0;
+  size_t leased = 0;   // readers currently handed out
+  uint64_t leases = 0; // acquireReader() calls that took a reader
+  uint64_t waits = 0;  // of those, calls that found every reader leased
+};
+
+// Opens one database in WAL mode with a single writer connection and a fixed
+// set of read-only connections.
+//
+// The writer keeps SQLite's serialized threading mode and may be used from
+// any thread. A reader is owned by exactly one thread while it is leased, so
+// readers are opened with SQLITE_OPEN_NOMUTEX and each has its own
+// StatementCache. Leases are reentrant per thread: a nested acquireReader()
+// returns the connection the thread already holds, so one operation sees a
+// single read transaction and cannot deadlock on an exhausted pool. With zero
+// readers, or while the calling thread has the writer pinned, every lease
+// hands out the writer. Writes hold writerMutex(), and so does a writer lease
+// taken by a thread that has not pinned the writer, so a read never lands
+// inside another thread's open write transaction.
+class ConnectionPool {
+private:
+  struct Connection {
+    sqlite3 *db = nullptr;
+    std::unique_ptr<StatementCache> statements;
+  };
+
+public:
+  class ReadLease {
+  public:
+    ReadLease(ConnectionPool *owner, Connection *connection,
+              std::unique_lock<std::recursive_mutex> writerLock = {})
+        : owner(owner), connection(connection),
+          writerLock(std::move(writerLock)) {}
+    ReadLease(ReadLease &&other) noexcept
+        : owner(other.owner), connection(other.connection),
+          writerLock(std::move(other.writerLock)) {
+      other.owner = nullptr;
+    }
+    ReadLease(const ReadLease &) = delete;
+    ReadLease &operator=(const ReadLease &) = delete;
+    ReadLease &operator=(ReadLease &&) = delete;
+    ~ReadLease();
+
+    sqlite3 *db() const { return connection->db; }
+    StatementCache &statements() const { return *connection->statements; }
+
+  private:
+    ConnectionPool *owner; // nullptr for nested or moved-from leases
+    Connection *connection;
+    std::unique_lock<std::recursive_mutex> writerLock; // writer leases only
+  };
+
+  ConnectionPool(const std::string &dbPath, size_t readConnections,
+                 ConnectionProfile profile);
+  ~ConnectionPool();
+
+  ConnectionPool(const ConnectionPool &) = delete;
+  ConnectionPool &operator=(const ConnectionPool &) = delete;
+
+  bool open();
+
+  sqlite3 *writer() const { return writerConnection.db; }
+  StatementCache &writerStatements() { return *writerConnection.statements; }
+  // Held by every statement run on the writer
+  std::recursive_mutex &writerMutex() { return writerMutex_; }
+
+  // Blocks until a read connection is free
+  ReadLease acquireReader();
+
+  // Between these, acquireReader() on the calling thread returns the
+  // writer, so reads inside a write transaction see its uncommitted rows.
+  // Only for the thread that owns the writer's open transaction, which
+  // holds writerMutex() throughout.
+  void pinWriter();
+  void unpinWriter();
+
+  size_t readerCount() const { return readers.size(); }
+  const ConnectionProfile &profile() const { return profile_; }
+
+  // Statement cache counters summed over every connection
+  StatementStats statementStats() const;
+
+  // Distinct SQL text cached on any connection, sorted
+  std::vector<std::string> preparedSql() const;
+
+  // Execution times of the statements of every connection
+  std::vector<StatementTiming> statementTimings() const {
+    return statementMetrics.timings();
+  }
+
+  ConnectionPoolStats stats() const;
+
+private:
+  bool openConnection(Connection &connection, int flags);
+  bool applyPragmas(sqlite3 *db, bool writer);
+  void release(Connection *connection);
+  bool pinnedByThisThread() const;
+
+  std::string dbPath;
+  size_t readConnections;
+  ConnectionProfile profile_;
+
+  // Outlives the statement caches recording into it
+  StatementMetrics statementMetrics;
+
+  Connection writerConnection;
+  std::recursive_mutex writerMutex_;
+  std::vector<Connection> readers;
+
+  mutable std::mutex mutex;
+  std::condition_variable available;
+  std::vector<Connection *> idle;
+  uint64_t leases = 0;
+  uint64_t waits = 0;
+
+  // Per thread and keyed by pool, as a thread may use several pools: the
+  // reader it has leased from each, and the pools whose writer it pinned
+  struct HeldReader {
+    const ConnectionPool *pool;
+    Connection *connection;
+  };
+  static thread_local std::vector<HeldReader> heldReaders;
+  static thread_local std::vector<const ConnectionPool *> pinnedPools;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct DatabaseExecutorStats {
+  size_t workers = 0;
+  size_t queueCapacity = 0;
+  size_t queueDepth = 0;
+  size_t maxQueueDepth = 0; // high-water mark since startup
+  size_t busyWorkers = 0;
+  uint64_t submitted = 0;
+  uint64_t completed = 0;
+  uint64_t rejected = 0; // submitted while the queue was full
+  uint64_t totalWaitMicros = 0;
+  uint64_t maxWaitMicros = 0;
+};
+
+// Fixed pool of worker threads that runs request handlers which touch the
+// database, so a burst of RPCs queues up here instead of spawning threads
+// that all contend for SQLite.
+//
+// At most queueCapacity tasks wait at a time; submit() returns false once
+// the queue is full so the caller can shed the request. The time each task
+// spent queued is recorded in the stats.
+class DatabaseExecutor {
+public:
+  DatabaseExecutor(size_t workers, size_t queueCapacity);
+  ~DatabaseExecutor(); // runs the queued tasks, then joins the workers
+
+  DatabaseExecutor(const DatabaseExecutor &) = delete;
+  DatabaseExecutor &operator=(const DatabaseExecutor &) = delete;
+
+  bool submit(std::function<void()> task);
+
+  DatabaseExecutorStats stats() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Task {
+    std::function<void()> run;
+    Clock::time_point queuedAt;
+  };
+
+  void work();
+
+  size_t queueCapacity;
+  std::vector<std::thread> threads;
+  mutable std::mutex mutex;
+  std::condition_variable available;
+  std::deque<Task> queue;
+  bool stopping = false;
+  size_t maxQueueDepth = 0;
+  size_t busyWorkers = 0;
+  uint64_t submitted = 0;
+  uint64_t completed = 0;
+  uint64_t rejected = 0;
+  uint64_t totalWaitMicros = 0;
+  uint64_t maxWaitMicros = 0;
+};
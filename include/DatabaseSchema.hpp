@@ -92,8 +92,151 @@ const std::vector<std::string> INITIALIZATION_SQL = {
     "FOREIGN KEY (limit_id) REFERENCES Limits(id) ON DELETE CASCADE);",
     "INSERT OR IGNORE INTO Migrations (version) VALUES (1);"};
 
+// Connection-local scratch tables RecloserManager::cloneFirmware maps old
+// row ids to new ones with
+const std::string CLONE_MAPS_SQL =
+    "CREATE TEMP TABLE IF NOT EXISTS CloneFeatureMap (old_id INTEGER PRIMARY "
+    "KEY, new_id INTEGER NOT NULL);"
+    "CREATE TEMP TABLE IF NOT EXISTS CloneComponentMap (old_id INTEGER "
+    "PRIMARY KEY, new_id INTEGER NOT NULL);";
+
+// Catalog tables a CatalogSnapshot is built from
+const std::vector<std::string> CATALOG_TABLES = {
+    "Descriptions",     "Translations", "Reclosers",
+    "FirmwareVersions", "Services",     "ServiceFirmware",
+    "Features",         "Component",    "FeatureComponent",
+    "Limits",           "FeatureComponentLimits"};
+
+// Version 3: a single-row CatalogRevision whose revision is bumped by a
+// trigger on every change to a catalog table, so a saved snapshot file can
+// tell whether it still matches the database. The random origin tells a
+// recreated database apart from the one the file was saved from.
+inline std::vector<std::string> catalogRevisionMigration() {
+  std::vector<std::string> sql = {
+      "CREATE TABLE IF NOT EXISTS CatalogRevision (id INTEGER PRIMARY KEY "
+      "CHECK (id = 1), origin INTEGER NOT NULL, revision INTEGER NOT NULL);",
+      "INSERT OR IGNORE INTO CatalogRevision (id, origin, revision) VALUES "
+      "(1, random(), 0);"};
+  for (const auto &table : CATALOG_TABLES) {
+    for (const char *event : {"INSERT", "UPDATE", "DELETE"}) {
+      sql.push_back("CREATE TRIGGER IF NOT EXISTS catalog_revision_" + table +
+                    "_" + event + " AFTER " + event + " ON " + table +
+                    " BEGIN UPDATE CatalogRevision SET revision = revision + "
+                    "1 WHERE id = 1; END;");
+    }
+  }
+  return sql;
+}
+
+// Version 5: full-text search over translation values and description
+// keys. TranslationSearch and DescriptionSearch are external-content FTS5
+// indexes kept in sync by triggers; unicode61 splits keys such as
+// TC_NUMERATOR at the underscores, and prefix indexes of 2 to 8 characters
+// serve type-ahead queries (longer prefixes merge every matching doclist).
+// An UPDATE trigger covers upserts, but INSERT OR REPLACE deletes without
+// firing DELETE triggers and must not be used on Translations or
+// Descriptions. DescriptionSearch follows the implicit rowid of
+// Descriptions, which VACUUM may renumber; run its 'rebuild' command after
+// one.
+//
+// Triggers stay enabled inside RecloserManager transactions from now on, so
+// the search index follows bulk writes too. The revision triggers are
+// recreated with a guard on CatalogRevision.tracking instead, which a
+// transaction clears while it runs and bumps the revision once at commit.
+inline std::vector<std::string> catalogSearchMigration() {
+  std::vector<std::string> sql = {
+      "ALTER TABLE CatalogRevision ADD COLUMN tracking INTEGER NOT NULL "
+      "DEFAULT 1;"};
+  for (const auto &table : CATALOG_TABLES) {
+    for (const char *event : {"INSERT", "UPDATE", "DELETE"}) {
+      std::string name =
+          "catalog_revision_" + table + "_" + std::string(event);
+      sql.push_back("DROP TRIGGER IF EXISTS " + name + ";");
+      sql.push_back("CREATE TRIGGER " + name + " AFTER " + event + " ON " +
+                    table +
+                    " WHEN (SELECT tracking FROM CatalogRevision WHERE id = "
+                    "1) BEGIN UPDATE CatalogRevision SET revision = revision "
+                    "+ 1 WHERE id = 1; END;");
+    }
+  }
+
+  // Search results are joined back to the features using a matched key
+  sql.push_back("CREATE INDEX IF NOT EXISTS idx_features_description_key ON "
+                "Features (description_key);");
+
+  const std::string options =
+      "tokenize = 'unicode61 remove_diacritics 2', prefix = '2 3 4 5 6 7 8'";
+  sql.push_back("CREATE VIRTUAL TABLE IF NOT EXISTS TranslationSearch USING "
+                "fts5(value, content = 'Translations', content_rowid = 'id', " +
+                options + ");");
+  sql.push_back("CREATE VIRTUAL TABLE IF NOT EXISTS DescriptionSearch USING "
+                "fts5(key, content = 'Descriptions', " +
+                options + ");");
+
+  // Index entries are removed by handing FTS5 the old column values
+  struct Source {
+    std::string table, index, rowid, column;
+  };
+  for (const Source &source :
+       {Source{"Translations", "TranslationSearch", "id", "value"},
+        Source{"Descriptions", "DescriptionSearch", "rowid", "key"}}) {
+    std::string insert = "INSERT INTO " + source.index + " (rowid, " +
+                         source.column + ") VALUES (new." + source.rowid +
+                         ", new." + source.column + ");";
+    std::string remove = "INSERT INTO " + source.index + " (" +
+                         source.index + ", rowid, " + source.column +
+                         ") VALUES ('delete', old." + source.rowid +
+                         ", old." + source.column + ");";
+    std::string prefix = "CREATE TRIGGER IF NOT EXISTS " + source.index;
+    sql.push_back(prefix + "_insert AFTER INSERT ON " + source.table +
+                  " BEGIN " + insert + " END;");
+    sql.push_back(prefix + "_delete AFTER DELETE ON " + source.table +
+                  " BEGIN " + remove + " END;");
+    sql.push_back(prefix + "_update AFTER UPDATE OF " + source.column +
+                  " ON " + source.table +
+                  " BEGIN " + remove + " " + insert + " END;");
+    sql.push_back("INSERT INTO " + source.index + " (" + source.index +
+                  ") VALUES ('rebuild');");
+  }
+  return sql;
+}
+
 const std::map<int, std::vector<std::string>> MIGRATIONS_SQL = {
-    // Example for version 2:
-    // {2, {"ALTER TABLE ...", "UPDATE ..."}}
+    // Version 2: indexes on the foreign keys every child lookup filters on
+    {2,
+     {"CREATE INDEX IF NOT EXISTS idx_firmware_versions_recloser_id ON "
+      "FirmwareVersions (recloser_id);",
+      "CREATE INDEX IF NOT EXISTS idx_services_parent_id ON Services "
+      "(parent_id);",
+      "CREATE INDEX IF NOT EXISTS idx_service_firmware_firmware_id ON "
+      "ServiceFirmware (firmware_id);",
+      "CREATE INDEX IF NOT EXISTS idx_features_service_firmware_id ON "
+      "Features (service_firmware_id);",
+      "CREATE INDEX IF NOT EXISTS idx_feature_component_feature_id ON "
+      "FeatureComponent (feature_id);",
+      "CREATE INDEX IF NOT EXISTS idx_feature_component_limits_fc_id ON "
+      "FeatureComponentLimits (feature_component_id);"}},
+    {3, catalogRevisionMigration()},
+    // Version 4: ServiceClosure holds one row per (ancestor, descendant) pair
+    // of the service hierarchy, every service being its own ancestor at depth
+    // 0, so subtree, ancestor and depth lookups are single index ranges. The
+    // service methods of RecloserManager keep it in step with parent_id; the
+    // backfill stops at cycles by capping the depth at the service count.
+    {4,
+     {"CREATE TABLE IF NOT EXISTS ServiceClosure (ancestor_id INTEGER NOT "
+      "NULL, descendant_id INTEGER NOT NULL, depth INTEGER NOT NULL, "
+      "PRIMARY KEY (ancestor_id, descendant_id), FOREIGN KEY (ancestor_id) "
+      "REFERENCES Services(id) ON DELETE CASCADE, FOREIGN KEY "
+      "(descendant_id) REFERENCES Services(id) ON DELETE CASCADE) "
+      "WITHOUT ROWID;",
+      "CREATE INDEX IF NOT EXISTS idx_service_closure_descendant_id ON "
+      "ServiceClosure (descendant_id, depth);",
+      "INSERT OR IGNORE INTO ServiceClosure (ancestor_id, descendant_id, "
+      "depth) WITH RECURSIVE walk(ancestor_id, descendant_id, depth) AS ("
+      "SELECT id, id, 0 FROM Services UNION ALL SELECT w.ancestor_id, s.id, "
+      "w.depth + 1 FROM walk w JOIN Services s ON s.parent_id = "
+      "w.descendant_id WHERE w.depth < (SELECT COUNT(*) FROM Services)) "
+      "SELECT ancestor_id, descendant_id, depth FROM walk;"}},
+    {5, catalogSearchMigration()},
 };
 } // namespace Schema
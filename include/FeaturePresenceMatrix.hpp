@@ -0,0 +1,37 @@
+#pragma once
+
+#include "CatalogSnapshot.hpp"
+#include "ParallelPool.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Which firmwares of a set carry each feature, for CompareFirmwareSet.
+//
+// A feature is identified by the description keys of the services above it,
+// top level first, and its own key, the same way CompareServiceTrees pairs
+// services and features up. Each firmware's tree is flattened into sorted
+// (service path, feature key) entries as a task of the pool, straight from
+// the shared snapshot, and the sorted lists are merged into one row per
+// entry with a presence bit per firmware.
+class FeaturePresenceMatrix {
+public:
+  static constexpr size_t MAX_FIRMWARES = 64; // one bit each
+
+  struct Row {
+    std::vector<CatalogSnapshot::StringId> servicePath;
+    CatalogSnapshot::StringId featureKey;
+    uint64_t presence; // bit i: the feature is in firmwareIds[i]
+  };
+
+  struct Result {
+    std::vector<Row> rows; // by service path, then feature key
+    size_t common = 0;     // entries every firmware has
+  };
+
+  // Rows for entries every firmware has are only kept with includeCommon.
+  // Unknown firmware ids count as empty trees.
+  static Result build(const CatalogSnapshot &catalog,
+                      const std::vector<int32_t> &firmwareIds,
+                      ParallelPool &pool, bool includeCommon);
+};
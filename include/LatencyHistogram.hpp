@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Count, total, max and approximate percentiles of one latency, in
+// nanoseconds
+struct LatencySummary {
+  uint64_t count = 0;
+  uint64_t totalNanos = 0;
+  uint64_t p50Nanos = 0;
+  uint64_t p90Nanos = 0;
+  uint64_t p99Nanos = 0;
+  uint64_t maxNanos = 0;
+};
+
+// Lock-free latency histogram shared by any number of recording threads.
+//
+// Durations land in log-linear buckets: 8 per power of two, so a reported
+// percentile is within 1/16 of the true value. Recording is two relaxed
+// atomic adds and never blocks or allocates; summary() reads the buckets
+// without stopping writers, so a summary taken under load may be off by the
+// events recorded while it ran.
+class LatencyHistogram {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  void record(uint64_t nanos);
+  void recordSince(Clock::time_point start) {
+    auto elapsed = Clock::now() - start;
+    record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+            .count()));
+  }
+
+  LatencySummary summary() const;
+
+private:
+  static constexpr int SUB_BUCKET_BITS = 3;
+  static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  // Values below 2 * SUB_BUCKETS get a bucket each; every power of two
+  // above that is split into SUB_BUCKETS
+  static constexpr int BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  static int bucketOf(uint64_t nanos);
+  static uint64_t bucketMidpoint(int bucket);
+
+  std::atomic<uint64_t> total{0};
+  std::atomic<uint64_t> max{0};
+  std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+};
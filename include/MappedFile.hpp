@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// Read-only memory mapping of a whole file. The mapping stays valid until the
+// MappedFile is destroyed, even if the file is replaced on disk meanwhile.
+class MappedFile {
+public:
+  // Returns nullptr if the file cannot be opened, is empty or cannot be
+  // mapped
+  static std::unique_ptr<MappedFile> open(const std::string &path);
+
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *data() const { return bytes; }
+  size_t size() const { return length; }
+
+private:
+  MappedFile() = default;
+
+  const char *bytes = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  void *mapping = nullptr;
+#endif
+};
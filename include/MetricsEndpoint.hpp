@@ -0,0 +1,34 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+// Minimal HTTP/1.0 server for a Prometheus scraper on 127.0.0.1.
+//
+// GET /metrics answers with whatever render() returns; any other path gets
+// a 404. One thread serves one connection at a time, which is plenty for a
+// scrape every few seconds, and drops clients that stall for two seconds.
+class MetricsEndpoint {
+public:
+  MetricsEndpoint(uint16_t port, std::function<std::string()> render);
+  ~MetricsEndpoint(); // stops listening and joins the thread
+
+  MetricsEndpoint(const MetricsEndpoint &) = delete;
+  MetricsEndpoint &operator=(const MetricsEndpoint &) = delete;
+
+  // Binds the port and starts serving; false if the port is unavailable
+  bool start();
+
+private:
+  void serve();
+  void respond(intptr_t client);
+
+  uint16_t port;
+  std::function<std::string()> render;
+  intptr_t listener = -1;
+  std::atomic<bool> stopping{false};
+  std::thread thread;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of helper threads that CPU-bound fan-out work, such as the
+// comparisons of CompareFirmwareSet, is spread over, so a call borrows
+// threads instead of starting its own.
+//
+// run() hands its tasks to whichever helpers are free and works through them
+// on the calling thread too. It never waits for a helper to come free, so
+// concurrent or nested calls still finish when every helper is busy.
+class ParallelPool {
+public:
+  explicit ParallelPool(size_t helpers);
+  ~ParallelPool(); // joins the helpers
+
+  ParallelPool(const ParallelPool &) = delete;
+  ParallelPool &operator=(const ParallelPool &) = delete;
+
+  // Runs task(0) to task(count - 1) and returns once every task has finished
+  void run(size_t count, const std::function<void(size_t)> &task);
+
+  size_t helpers() const { return threads.size(); }
+
+private:
+  // One run() call; lives on the caller's stack
+  struct Batch {
+    const std::function<void(size_t)> &task;
+    size_t count;
+    std::atomic<size_t> next{0};
+    size_t active = 0; // helpers working on it, under the pool mutex
+  };
+
+  static void drain(Batch &batch);
+  void work();
+
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable available;
+  std::condition_variable finished;
+  std::deque<Batch *> queue; // batches more helpers could join
+  bool stopping = false;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "DatabaseExecutor.hpp"
+#include "RecloserServiceImpl.hpp"
+#include "recloser.grpc.pb.h"
+#include <grpcpp/grpcpp.h>
+
+namespace recloser {
+
+// Callback-API front end for RecloserServiceImpl.
+//
+// gRPC's callback threads only hand each call over to the DatabaseExecutor,
+// whose fixed set of workers runs the same handlers as the sync server and
+// finishes the reactor. When the executor's queue is full the call fails
+// fast with RESOURCE_EXHAUSTED instead of piling up more threads.
+//
+// GetServiceTree, GetScreenLayout and GetFullInventory are raw-message
+// methods, as in RecloserServiceImpl: ResponseCache hits are answered on the
+// callback thread, only misses go to the executor.
+class RecloserCallbackService final
+    : public RecloserService::WithRawCallbackMethod_GetServiceTree<
+          RecloserService::WithRawCallbackMethod_GetScreenLayout<
+              RecloserService::WithRawCallbackMethod_GetFullInventory<
+                  RecloserService::CallbackService>>> {
+public:
+  RecloserCallbackService(RecloserServiceImpl *handlers,
+                          DatabaseExecutor *executor);
+
+  grpc::ServerUnaryReactor *GetServiceTree(grpc::CallbackServerContext *context,
+                                           const grpc::ByteBuffer *request,
+                                           grpc::ByteBuffer *response) override;
+
+  grpc::ServerUnaryReactor *
+  CompareServiceTrees(grpc::CallbackServerContext *context,
+                      const CompareServiceTreesRequest *request,
+                      CompareServiceTreesResponse *response) override;
+
+  grpc::ServerUnaryReactor *
+  CompareFirmwareSet(grpc::CallbackServerContext *context,
+                     const CompareFirmwareSetRequest *request,
+                     CompareFirmwareSetResponse *response) override;
+
+  grpc::ServerUnaryReactor *
+  GetScreenLayout(grpc::CallbackServerContext *context,
+                  const grpc::ByteBuffer *request,
+                  grpc::ByteBuffer *response) override;
+
+  grpc::ServerUnaryReactor *
+  GetFullInventory(grpc::CallbackServerContext *context,
+                   const grpc::ByteBuffer *request,
+                   grpc::ByteBuffer *response) override;
+
+  grpc::ServerWriteReactor<InventoryChunk> *
+  StreamFullInventory(grpc::CallbackServerContext *context,
+                      const FullInventoryRequest *request) override;
+
+  grpc::ServerUnaryReactor *
+  SearchCatalog(grpc::CallbackServerContext *context,
+                const SearchCatalogRequest *request,
+                SearchCatalogResponse *response) override;
+
+  // CRUD Operations
+  grpc::ServerUnaryReactor *CreateRecloser(grpc::CallbackServerContext *context,
+                                           const RecloserRecord *request,
+                                           GenericResponse *response) override;
+  grpc::ServerUnaryReactor *UpdateRecloser(grpc::CallbackServerContext *context,
+                                           const RecloserRecord *request,
+                                           GenericResponse *response) override;
+  grpc::ServerUnaryReactor *DeleteRecloser(grpc::CallbackServerContext *context,
+                                           const DeleteRequest *request,
+                                           GenericResponse *response) override;
+
+  grpc::ServerUnaryReactor *CreateFirmware(grpc::CallbackServerContext *context,
+                                           const FirmwareRecord *request,
+                                           GenericResponse *response) override;
+  grpc::ServerUnaryReactor *UpdateFirmware(grpc::CallbackServerContext *context,
+                                           const FirmwareRecord *request,
+                                           GenericResponse *response) override;
+  grpc::ServerUnaryReactor *DeleteFirmware(grpc::CallbackServerContext *context,
+                                           const DeleteRequest *request,
+                                           GenericResponse *response) override;
+  grpc::ServerUnaryReactor *
+  CloneFirmware(grpc::CallbackServerContext *context,
+                const CloneFirmwareRequest *request,
+                CloneFirmwareResponse *response) override;
+
+  grpc::ServerUnaryReactor *AddServiceNode(grpc::CallbackServerContext *context,
+                                           const ServiceRecord *request,
+                                           GenericResponse *response) override;
+  grpc::ServerUnaryReactor *
+  UpdateServiceNode(grpc::CallbackServerContext *context,
+                    const ServiceRecord *request,
+                    GenericResponse *response) override;
+  grpc::ServerUnaryReactor *
+  DeleteServiceNode(grpc::CallbackServerContext *context,
+                    const DeleteRequest *request,
+                    GenericResponse *response) override;
+
+  grpc::ServerUnaryReactor *CreateFeature(grpc::CallbackServerContext *context,
+                                          const FeatureRecord *request,
+                                          GenericResponse *response) override;
+  grpc::ServerUnaryReactor *UpdateFeature(grpc::CallbackServerContext *context,
+                                          const FeatureRecord *request,
+                                          GenericResponse *response) override;
+  grpc::ServerUnaryReactor *DeleteFeature(grpc::CallbackServerContext *context,
+                                          const DeleteRequest *request,
+                                          GenericResponse *response) override;
+
+  grpc::ServerUnaryReactor *
+  ApplyChangeSet(grpc::CallbackServerContext *context,
+                 const ChangeSetRequest *request,
+                 ChangeSetResponse *response) override;
+
+  // Answered on the callback thread, so it still works with a full queue
+  grpc::ServerUnaryReactor *
+  GetServerStats(grpc::CallbackServerContext *context,
+                 const ServerStatsRequest *request,
+                 ServerStatsResponse *response) override;
+
+private:
+  // Runs handler(nullptr, request, response) on the executor and finishes
+  // the call with its status
+  template <typename Request, typename Response>
+  grpc::ServerUnaryReactor *
+  dispatch(grpc::CallbackServerContext *context,
+           grpc::Status (RecloserServiceImpl::*handler)(grpc::ServerContext *,
+                                                        const Request *,
+                                                        Response *),
+           const Request *request, Response *response);
+
+  grpc::ServerUnaryReactor *
+  dispatchRawRead(grpc::CallbackServerContext *context, RawRead method,
+                  const grpc::ByteBuffer *request, grpc::ByteBuffer *response);
+
+  RecloserServiceImpl *handlers_;
+  DatabaseExecutor *executor_;
+};
+
+} // namespace recloser
@@ -1,12 +1,20 @@
 #pragma once
 
+#include "CatalogSnapshot.hpp"
+#include "ConnectionPool.hpp"
+#include "StatementCache.hpp"
+#include "TranslationDictionary.hpp"
 #include "sqlite3.h"
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <utility>
 #include <vector>
 
+class CatalogSearch;
+class ScreenLayoutEngine;
+
 struct TranslationRecord {
   std::string description_key;
   std::string language_code;
@@ -24,6 +32,16 @@ struct FirmwareVersionRecord {
   int recloser_id;
 };
 
+// Outcome of RecloserManager::cloneFirmware: the new firmware id (0 if the
+// clone failed) and how many rows were copied per table
+struct FirmwareCloneRecord {
+  int firmware_id = 0;
+  int services = 0;
+  int features = 0;
+  int components = 0;
+  int limits = 0;
+};
+
 struct ServiceRecord {
   int id;
   std::string description_key;
@@ -38,12 +56,70 @@ struct FeatureRecord {
 
 class RecloserManager {
 public:
-  RecloserManager(const std::string &dbPath);
+  // Scoped unit of work on the writer connection.
+  //
+  // The outermost Transaction on a thread runs BEGIN IMMEDIATE and keeps
+  // other writers out until it ends; Transactions opened inside it, by the
+  // caller or by RecloserManager's own methods, become SAVEPOINTs. Every
+  // mutator runs inside the caller's open Transaction, if any. Work is kept
+  // only by commit(); a Transaction destroyed without it rolls back its part.
+  //
+  // While it is open, reads on the owning thread run on the writer and see
+  // its uncommitted rows; other threads keep reading the last commit.
+  // Translations are staged and reach the in-memory dictionary, which
+  // getTranslation() and the layouts read, only when the outermost
+  // Transaction commits.
+  //
+  // Outside a Transaction each changed catalog row bumps CatalogRevision
+  // through a trigger. The outermost Transaction clears
+  // CatalogRevision.tracking, which those triggers check, and bumps the
+  // revision once when committing changes instead; other triggers, such as
+  // the search index's, keep firing.
+  class Transaction {
+  public:
+    explicit Transaction(RecloserManager &manager);
+    ~Transaction();
+
+    Transaction(const Transaction &) = delete;
+    Transaction &operator=(const Transaction &) = delete;
+
+    // False if BEGIN or SAVEPOINT failed; commit() then returns false
+    bool active() const { return open; }
+
+    bool commit();
+    void rollback();
+
+    // Checks foreign keys when the outermost transaction commits instead of
+    // after every statement, so rows may arrive before the rows they
+    // reference. SQLite turns this off again when the transaction ends.
+    bool deferForeignKeys();
+
+  private:
+    bool exec(const std::string &sql);
+
+    RecloserManager &manager;
+    std::unique_lock<std::recursive_mutex> lock;
+    int depth; // 0 for the outermost transaction
+    bool open = false;
+    int changesAtBegin = 0;
+    size_t stagedAtBegin = 0; // of manager.stagedTranslations
+  };
+
+  RecloserManager(const std::string &dbPath, size_t readConnections = 4,
+                  ConnectionProfile profile = ConnectionProfile::balanced());
   ~RecloserManager();
 
   bool initialize();
   bool migrate();
 
+  // Prepared statement cache counters (process-wide totals)
+  StatementStats statementStats() const;
+  // Every distinct statement issued so far, see tools/QueryPlanAudit.cpp
+  std::vector<std::string> preparedSql() const;
+  // Execution count and latency of each of those statements
+  std::vector<StatementTiming> statementTimings() const;
+  ConnectionPoolStats connectionPoolStats() const;
+
   // Translation methods
   bool addLanguage(const std::string &code, const std::string &name);
   bool addDescriptionKey(const std::string &key);
@@ -52,29 +128,41 @@ public:
   bool addKeyWithTranslations(
       const std::string &key,
       const std::vector<std::pair<std::string, std::string>> &translations);
+  // Translation reads are served from the in-memory TranslationDictionary
   std::string getTranslation(const std::string &key,
                              const std::string &langCode);
   std::vector<TranslationRecord> getTranslationsForKey(const std::string &key);
+  // Bulk lookup, one result per key in request order
+  std::vector<std::vector<TranslationRecord>>
+  resolveTranslations(const std::vector<std::string> &keys);
 
   // Recloser methods
-  bool addRecloser(const std::string &key);
+  int addRecloser(const std::string &key);
   bool updateRecloser(int id, const std::string &key);
   bool deleteRecloser(int id);
   std::vector<RecloserRecord> getAllReclosers();
   std::optional<RecloserRecord> getRecloserById(int id);
 
   // Firmware methods
-  bool addFirmwareVersion(const std::string &version, int recloserId);
+  int addFirmwareVersion(const std::string &version, int recloserId);
   bool updateFirmwareVersion(int id, const std::string &version,
                              int recloserId);
   bool deleteFirmwareVersion(int id);
   std::vector<FirmwareVersionRecord>
   getFirmwareVersionsForRecloser(int recloserId);
   std::optional<FirmwareVersionRecord> getFirmwareVersionById(int id);
+  // Copies every ServiceFirmware link, feature, component and limit of a
+  // firmware into a new firmware version of recloserId (0: the source's
+  // recloser), with one INSERT ... SELECT per table in one transaction
+  FirmwareCloneRecord cloneFirmware(int sourceFirmwareId,
+                                    const std::string &version,
+                                    int recloserId = 0);
 
   // Service methods
   int addService(const std::string &descKey, int parentId = 0);
+  // Changing parentId moves the whole subtree, see moveService
   bool updateService(int id, const std::string &descKey, int parentId = 0);
+  // Deletes the service and its whole subtree
   bool deleteService(int id);
   int linkServiceToFirmware(int serviceId, int firmwareId);
   bool unlinkServiceFromFirmware(int serviceId, int firmwareId);
@@ -83,6 +171,15 @@ public:
   std::vector<ServiceRecord> getServicesByParentAndFirmware(int parentId,
                                                             int firmwareId);
   std::optional<ServiceRecord> getServiceById(int id);
+  // Hierarchy queries, each one index range on ServiceClosure: the service
+  // and everything below it in depth order, its ancestors from the top
+  // level down, and its depth (0 at the top level, -1 if unknown)
+  std::vector<ServiceRecord> getServiceSubtree(int id);
+  std::vector<ServiceRecord> getServiceAncestors(int id);
+  int getServiceDepth(int id);
+  // Re-parents a service with its subtree (newParentId 0: top level);
+  // fails if newParentId lies inside that subtree
+  bool moveService(int id, int newParentId);
 
   // Feature methods
   int addFeature(const std::string &descKey, int serviceFirmwareId);
@@ -94,8 +191,13 @@ public:
 
   // Component methods
   int linkFeatureToComponent(int featureId, const std::string &componentType);
+  bool deleteFeatureComponent(int id);
   bool addComponentLimit(int featureComponentId, const std::string &limitKey,
                          const std::string &value);
+  bool updateComponentLimit(int featureComponentId, const std::string &limitKey,
+                            const std::string &value);
+  bool deleteComponentLimit(int featureComponentId,
+                            const std::string &limitKey);
 
   struct ComponentLimitRecord {
     std::string key;
@@ -118,14 +220,59 @@ public:
     std::vector<ServiceLayoutRecord> children;
   };
 
+  // Whole subtree rooted at one ServiceFirmware row, see ScreenLayoutEngine
   std::optional<ServiceLayoutRecord> getScreenLayout(int serviceFirmwareId);
 
+  struct CatalogSearchRecord {
+    bool is_service; // false for a feature
+    int id;          // feature or service id
+    std::string description_key;
+    std::string language_code; // of matched_text, empty if the key matched
+    std::string matched_text;
+    int service_id; // the feature's service, or the service itself
+    int firmware_id;
+    std::string firmware_version;
+    int recloser_id;
+    std::string recloser_key;
+    int score; // length of matched_text, lower ranks first
+  };
+
+  struct CatalogSearchResult {
+    std::vector<CatalogSearchRecord> hits;
+    // More rows matched than were ranked; a longer query narrows it down
+    bool truncated = false;
+  };
+
+  // One page of ranked full-text matches for free text, see CatalogSearch.
+  // languageCode limits the translations searched (empty: every language).
+  CatalogSearchResult searchCatalog(const std::string &text,
+                                    const std::string &languageCode,
+                                    int limit, int offset = 0);
+
+  // Loads the whole catalog into an immutable snapshot, see CatalogStore
+  std::shared_ptr<const CatalogSnapshot> buildCatalogSnapshot(uint64_t version);
+  // Current CatalogRevision, compared against a saved snapshot file
+  std::optional<CatalogSnapshot::Revision> catalogRevision();
+
   // Population method
   bool populateSampleLayoutData();
 
 private:
   std::string dbPath;
+  std::unique_ptr<ConnectionPool> connections;
+  // Writer connection and its statements; reads lease a pooled connection
   sqlite3 *db;
+  StatementCache *statements;
+  // The pool's writer mutex, held by every write, so a transaction never
+  // picks up another thread's statements on the shared writer connection
+  std::recursive_mutex &writeMutex;
+  int transactionDepth = 0; // guarded by writeMutex
+  // Translations written inside the open Transaction, applied to the
+  // dictionary when the outermost one commits; guarded by writeMutex
+  std::vector<TranslationRecord> stagedTranslations;
+  std::unique_ptr<ScreenLayoutEngine> layoutEngine;
+  std::unique_ptr<CatalogSearch> search;
+  TranslationDictionary translations;
 
   bool runSchema();
   int getCurrentVersion();
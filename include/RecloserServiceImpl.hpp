@@ -1,25 +1,85 @@
 #pragma once
 
+#include "ArenaSizeHint.hpp"
+#include "CatalogStore.hpp"
+#include "CompareCache.hpp"
+#include "ParallelPool.hpp"
 #include "RecloserManager.hpp"
+#include "ResponseCache.hpp"
+#include "ServerMetrics.hpp"
 #include "recloser.grpc.pb.h"
 #include <grpcpp/grpcpp.h>
-#include <map>
 #include <memory>
-#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace recloser {
 
-// Helper structure for comparison
-struct ServiceTreeNode {
-  std::string description_key;
-  std::string display_name;
-  std::set<std::string> features;
-  std::map<std::string, ServiceTreeNode> children;
+// Languages and depth a tree query asked for. Whatever falls outside them is
+// left out of the reply and tallied, so the handler can log how much smaller
+// the payload got.
+class TreeFilter {
+public:
+  TreeFilter(
+      const google::protobuf::RepeatedPtrField<std::string> &languageCodes,
+      int32_t maxDepth);
+
+  bool active() const { return !languages.empty() || maxDepth > 0; }
+  bool includesLanguage(std::string_view languageCode) const;
+  // Whether the children of a node at this depth (top level is 1) are sent
+  bool expandsBelow(int depth) const {
+    return maxDepth <= 0 || depth < maxDepth;
+  }
+
+  void omitTranslation(size_t wireBytes) {
+    omittedTranslations++;
+    omittedTranslationBytes += wireBytes;
+  }
+  void omitNodes(size_t count) { omittedNodes += count; }
+
+  size_t omittedTranslations = 0;
+  size_t omittedTranslationBytes = 0;
+  size_t omittedNodes = 0;
+
+private:
+  std::vector<std::string> languages;
+  int32_t maxDepth;
+};
+
+// Position of a StreamFullInventory call within the snapshot it started on
+struct InventoryCursor {
+  std::shared_ptr<const CatalogSnapshot> catalog;
+  TreeFilter filter;
+  size_t recloser = 0;
+  size_t firmware = 0; // next firmware of the current recloser
+  bool recloserSent = false;
+  size_t payloadBytes = 0; // counted only when the filter is active
+};
+
+// GetServiceTree and GetScreenLayout take gRPC's raw-message path: their
+// requests arrive as bytes, their responses are built on a per-call arena
+// and serialized by the handler, and a response found in the ResponseCache
+// goes out as the cached bytes without building or serializing any message.
+// GetFullInventory, never cached and as large as the catalog, stays a sync
+// method here; RecloserCallbackService reads it raw on its executor.
+using RawReadService = RecloserService::WithRawCallbackMethod_GetServiceTree<
+    RecloserService::WithRawCallbackMethod_GetScreenLayout<
+        RecloserService::Service>>;
+
+// The method part of a raw read's key. Full inventories are not cached.
+enum class RawRead : char {
+  SERVICE_TREE = 'T',
+  SCREEN_LAYOUT = 'L',
+  FULL_INVENTORY = 'I'
 };
 
-class RecloserServiceImpl final : public RecloserService::Service {
+class RecloserServiceImpl final : public RawReadService {
 public:
-  explicit RecloserServiceImpl(RecloserManager *manager);
+  RecloserServiceImpl(RecloserManager *manager, CatalogStore *catalog,
+                      CompareCache *compareCache,
+                      ResponseCache *responseCache,
+                      ServerMetrics *metrics = nullptr);
 
   grpc::Status GetServiceTree(grpc::ServerContext *context,
                               const ServiceTreeRequest *request,
@@ -30,6 +90,11 @@ public:
                       const CompareServiceTreesRequest *request,
                       CompareServiceTreesResponse *response) override;
 
+  grpc::Status
+  CompareFirmwareSet(grpc::ServerContext *context,
+                     const CompareFirmwareSetRequest *request,
+                     CompareFirmwareSetResponse *response) override;
+
   grpc::Status GetScreenLayout(grpc::ServerContext *context,
                                const ScreenLayoutRequest *request,
                                ScreenLayoutResponse *response) override;
@@ -38,6 +103,40 @@ public:
                                 const FullInventoryRequest *request,
                                 FullInventoryResponse *response) override;
 
+  grpc::Status
+  StreamFullInventory(grpc::ServerContext *context,
+                      const FullInventoryRequest *request,
+                      grpc::ServerWriter<InventoryChunk> *writer) override;
+
+  grpc::Status SearchCatalog(grpc::ServerContext *context,
+                             const SearchCatalogRequest *request,
+                             SearchCatalogResponse *response) override;
+
+  // Raw-message reads of the sync server. A miss only reads the snapshot
+  // for one firmware, so it is built on the callback thread.
+  grpc::ServerUnaryReactor *GetServiceTree(grpc::CallbackServerContext *context,
+                                           const grpc::ByteBuffer *request,
+                                           grpc::ByteBuffer *response) override;
+  grpc::ServerUnaryReactor *
+  GetScreenLayout(grpc::CallbackServerContext *context,
+                  const grpc::ByteBuffer *request,
+                  grpc::ByteBuffer *response) override;
+
+  // Shared by the sync and callback raw reads: findCachedRead() fills the
+  // response on a cache hit; on a miss buildRawRead() runs the typed
+  // handler on a per-call arena and serializes its response once, into the
+  // cache
+  static std::string rawReadKey(RawRead method,
+                                const grpc::ByteBuffer &request);
+  bool findCachedRead(const std::string &key, grpc::ByteBuffer *response);
+  grpc::Status buildRawRead(const std::string &key,
+                            grpc::ByteBuffer *response);
+
+  // Shared by the sync and callback StreamFullInventory: fills the next
+  // message of the stream, or returns false once the inventory is complete
+  InventoryCursor startInventory(const FullInventoryRequest &request);
+  bool nextInventoryChunk(InventoryCursor &cursor, InventoryChunk *chunk);
+
   // CRUD Operations
   grpc::Status CreateRecloser(grpc::ServerContext *context,
                               const RecloserRecord *request,
@@ -58,6 +157,9 @@ public:
   grpc::Status DeleteFirmware(grpc::ServerContext *context,
                               const DeleteRequest *request,
                               GenericResponse *response) override;
+  grpc::Status CloneFirmware(grpc::ServerContext *context,
+                             const CloneFirmwareRequest *request,
+                             CloneFirmwareResponse *response) override;
 
   grpc::Status AddServiceNode(grpc::ServerContext *context,
                               const ServiceRecord *request,
@@ -79,27 +181,60 @@ public:
                              const DeleteRequest *request,
                              GenericResponse *response) override;
 
-private:
-  RecloserManager *manager_;
+  grpc::Status ApplyChangeSet(grpc::ServerContext *context,
+                              const ChangeSetRequest *request,
+                              ChangeSetResponse *response) override;
 
-  // Helper to build service tree recursively
-  void buildServiceNode(int parentId, int firmwareId, ServiceNode *node);
+  // UNIMPLEMENTED when the server was started without metrics
+  grpc::Status GetServerStats(grpc::ServerContext *context,
+                              const ServerStatsRequest *request,
+                              ServerStatsResponse *response) override;
 
-  // Helper to build internal tree structure for comparison
-  void buildInternalTree(int parentId, int firmwareId,
-                         const std::string &languageCode,
-                         std::map<std::string, ServiceTreeNode> &tree);
+private:
+  grpc::ServerUnaryReactor *serveRawRead(grpc::CallbackServerContext *context,
+                                         RawRead method,
+                                         const grpc::ByteBuffer *request,
+                                         grpc::ByteBuffer *response);
 
-  // Helper to compare two trees recursively
+  RecloserManager *manager_;
+  CatalogStore *catalog_;
+  CompareCache *compareCache_;
+  ResponseCache *responseCache_;
+  ServerMetrics *metrics_;
+  // Helpers for the comparisons of CompareFirmwareSet, one per core besides
+  // the calling thread; apart from the DatabaseExecutor, whose handlers
+  // would otherwise wait on their own queue
+  ParallelPool comparePool_;
+  // First arena block of the next response of each raw read
+  ArenaSizeHint serviceTreeArena_;
+  ArenaSizeHint screenLayoutArena_;
+  ArenaSizeHint inventoryArena_;
+
+  // Helper to build service tree recursively from the snapshot
+  void buildServiceNode(const CatalogSnapshot &catalog,
+                        const CatalogSnapshot::ServiceNodeEntry &entry,
+                        ServiceNode *node, TreeFilter &filter, int depth);
+
+  // Compares two firmwares through the compare cache, shared by
+  // CompareServiceTrees and CompareFirmwareSet. Returns whether the result
+  // came from the cache. Safe to call from several threads at once.
+  bool compareFirmwares(const CatalogSnapshot &catalog, int32_t firmwareId1,
+                        int32_t firmwareId2, const std::string &languageCode,
+                        CompareServiceTreesResponse *response);
+
+  // Helper to compare two sibling lists (ordered by description key)
+  // recursively, skipping subtrees with equal content hashes
   void compareNodes(
-      const std::map<std::string, ServiceTreeNode> &tree1,
-      const std::map<std::string, ServiceTreeNode> &tree2,
+      const CatalogSnapshot &catalog, CatalogSnapshot::View<int32_t> nodes1,
+      CatalogSnapshot::View<int32_t> nodes2, const std::string &languageCode,
       google::protobuf::RepeatedPtrField<ServiceDifference> *differences,
       int &added, int &removed, int &modified);
 
   // Helper to build screen layout recursively
-  void populateServiceLayout(const RecloserManager::ServiceLayoutRecord &rec,
-                             ServiceLayout *layout);
+  void populateServiceLayout(const CatalogSnapshot &catalog,
+                             const CatalogSnapshot::ServiceNodeEntry &entry,
+                             ServiceLayout *layout, TreeFilter &filter,
+                             int depth);
 };
 
 } // namespace recloser
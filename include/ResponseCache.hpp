@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <grpcpp/support/slice.h>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+struct ResponseCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t invalidations = 0; // lookups that found an older catalog version
+  uint64_t evictions = 0;
+  size_t entries = 0;
+  size_t bytes = 0;
+  size_t capacityBytes = 0;
+};
+
+// LRU cache of serialized GetServiceTree and GetScreenLayout responses.
+//
+// Entries are keyed by the method and the request exactly as it came off
+// the wire, and remember the catalog snapshot version they were built from;
+// a lookup under another version drops the entry. Payloads are grpc::Slices,
+// so a hit hands the cached bytes to gRPC by reference instead of copying
+// them. The total size of keys and payloads (plus a fixed per-entry
+// overhead) is kept under the byte capacity by evicting least recently used
+// entries.
+class ResponseCache {
+public:
+  explicit ResponseCache(size_t capacityBytes);
+
+  // Returns nullopt on a miss
+  std::optional<grpc::Slice> lookup(const std::string &key, uint64_t version);
+
+  void store(const std::string &key, uint64_t version, grpc::Slice payload);
+
+  ResponseCacheStats stats() const;
+
+private:
+  struct Entry {
+    std::string key;
+    uint64_t version;
+    grpc::Slice payload;
+    size_t bytes;
+  };
+
+  using EntryList = std::list<Entry>;
+
+  void erase(EntryList::iterator entry);
+
+  size_t capacityBytes;
+  mutable std::mutex mutex;
+  EntryList lru; // most recently used first
+  std::unordered_map<std::string, EntryList::iterator> index;
+  size_t bytes = 0;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t invalidations = 0;
+  uint64_t evictions = 0;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "ConnectionPool.hpp"
+#include "RecloserManager.hpp"
+#include "TranslationDictionary.hpp"
+#include <optional>
+
+// Assembles a whole screen layout subtree with a fixed number of set-based
+// queries (one ServiceClosure range over the service hierarchy of a
+// firmware), instead of one round trip per service, feature and component.
+// Translations come from the dictionary in a single bulk lookup.
+class ScreenLayoutEngine {
+public:
+  ScreenLayoutEngine(ConnectionPool &connections,
+                     const TranslationDictionary &translations);
+
+  std::optional<RecloserManager::ServiceLayoutRecord>
+  build(int serviceFirmwareId);
+
+private:
+  ConnectionPool &connections;
+  const TranslationDictionary &translations;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "CatalogStore.hpp"
+#include "CompareCache.hpp"
+#include "DatabaseExecutor.hpp"
+#include "LatencyHistogram.hpp"
+#include "RecloserManager.hpp"
+#include "ResponseCache.hpp"
+#include "recloser.pb.h"
+#include <atomic>
+#include <chrono>
+#include <grpcpp/support/server_interceptor.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace recloser {
+
+// Latency and outcome of every call to one RecloserService method
+struct RpcMetrics {
+  std::string name; // method name, e.g. "GetServiceTree"
+  LatencyHistogram latency;
+  std::atomic<uint64_t> errors{0}; // calls that ended with a non-OK status
+};
+
+// Process-wide server metrics: a latency histogram per RPC, the statement
+// timings collected by RecloserManager, and the counters of the caches, the
+// read pool and the callback executor.
+//
+// RPCs are timed by a server interceptor from the start of the call until
+// its status is sent, in either server mode and whether the handler runs
+// on gRPC's thread or on the executor. Served by GetServerStats and, as
+// Prometheus text, by a MetricsEndpoint.
+class ServerMetrics {
+public:
+  ServerMetrics(RecloserManager *manager, CatalogStore *catalog,
+                CompareCache *compareCache, ResponseCache *responseCache);
+
+  ServerMetrics(const ServerMetrics &) = delete;
+  ServerMetrics &operator=(const ServerMetrics &) = delete;
+
+  // Callback mode only; nullptr once the executor is gone
+  void setExecutor(const DatabaseExecutor *executor) {
+    executor_.store(executor, std::memory_order_release);
+  }
+
+  // For ServerBuilder::experimental().SetInterceptorCreators(); the server
+  // must not outlive this object
+  std::unique_ptr<grpc::experimental::ServerInterceptorFactoryInterface>
+  interceptorFactory();
+
+  // By full method path ("/recloser.RecloserService/GetServiceTree"); null
+  // for methods of other services
+  RpcMetrics *rpc(std::string_view method);
+
+  void fill(ServerStatsResponse *response) const;
+  // Prometheus text exposition format, version 0.0.4
+  std::string prometheusText() const;
+
+private:
+  struct Gauge {
+    const char *name; // a _total suffix marks a counter
+    const char *help;
+    double value;
+  };
+
+  struct PathHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view path) const {
+      return std::hash<std::string_view>{}(path);
+    }
+  };
+
+  std::vector<Gauge> gauges() const;
+  double uptimeSeconds() const;
+
+  RecloserManager *manager_;
+  CatalogStore *catalog_;
+  CompareCache *compareCache_;
+  ResponseCache *responseCache_;
+  std::atomic<const DatabaseExecutor *> executor_{nullptr};
+  std::chrono::steady_clock::time_point started_;
+  // One entry per method of the service, in declaration order; neither
+  // container changes after the constructor, so lookups take no lock
+  std::vector<std::unique_ptr<RpcMetrics>> rpcs_;
+  std::unordered_map<std::string, RpcMetrics *, PathHash, std::equal_to<>>
+      rpcsByPath_;
+};
+
+} // namespace recloser
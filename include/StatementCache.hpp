@@ -0,0 +1,104 @@
+#pragma once
+
+#include "StatementMetrics.hpp"
+#include "sqlite3.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct StatementStats {
+  uint64_t hits = 0;
+  uint64_t prepares = 0;
+};
+
+// Caches prepared statements of one connection, keyed by SQL text.
+//
+// A statement is checked out for exclusive use and handed back reset and
+// with its bindings cleared when the CachedStatement goes out of scope, so
+// nested or concurrent callers of the same query simply prepare a second
+// copy instead of clobbering each other. With a StatementMetrics registry,
+// the time each statement is checked out is recorded there.
+class StatementCache {
+public:
+  class CachedStatement {
+  public:
+    CachedStatement() = default;
+    CachedStatement(StatementCache *owner, sqlite3_stmt *stmt,
+                    LatencyHistogram *timing)
+        : owner(owner), stmt(stmt), timing(timing) {
+      if (timing) {
+        start = LatencyHistogram::Clock::now();
+      }
+    }
+    CachedStatement(CachedStatement &&other) noexcept
+        : owner(other.owner), stmt(other.stmt), timing(other.timing),
+          start(other.start) {
+      other.stmt = nullptr;
+    }
+    CachedStatement &operator=(CachedStatement &&other) noexcept;
+    CachedStatement(const CachedStatement &) = delete;
+    CachedStatement &operator=(const CachedStatement &) = delete;
+    ~CachedStatement();
+
+    sqlite3_stmt *get() const { return stmt; }
+    explicit operator bool() const { return stmt != nullptr; }
+
+  private:
+    void finish();
+
+    StatementCache *owner = nullptr;
+    sqlite3_stmt *stmt = nullptr;
+    LatencyHistogram *timing = nullptr;
+    LatencyHistogram::Clock::time_point start;
+  };
+
+  explicit StatementCache(sqlite3 *db, StatementMetrics *metrics = nullptr,
+                          size_t maxIdlePerSql = 4);
+  ~StatementCache();
+
+  StatementCache(const StatementCache &) = delete;
+  StatementCache &operator=(const StatementCache &) = delete;
+
+  // Returns an empty handle if the statement fails to prepare.
+  CachedStatement acquire(std::string_view sql);
+
+  // Finalizes every idle statement; must run before the connection closes.
+  void clear();
+
+  // SQL text of every statement handed back to the cache so far
+  std::vector<std::string> sqlTexts() const;
+
+  StatementStats stats() const;
+
+  // Counters of the calling thread only; diffing two readings taken around
+  // an RPC handler gives the statement activity of that RPC.
+  static StatementStats threadStats();
+
+private:
+  struct SqlHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view sql) const {
+      return std::hash<std::string_view>{}(sql);
+    }
+  };
+
+  struct IdleStatements {
+    std::vector<sqlite3_stmt *> stmts;
+    LatencyHistogram *timing = nullptr;
+  };
+
+  void release(sqlite3_stmt *stmt, LatencyHistogram *timing);
+
+  sqlite3 *db;
+  StatementMetrics *metrics;
+  size_t maxIdlePerSql;
+  mutable std::mutex mutex;
+  std::unordered_map<std::string, IdleStatements, SqlHash, std::equal_to<>>
+      idle;
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> prepares{0};
+};
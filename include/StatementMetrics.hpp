@@ -0,0 +1,43 @@
+#pragma once
+
+#include "LatencyHistogram.hpp"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct StatementTiming {
+  std::string sql;
+  LatencySummary latency;
+};
+
+// Execution times of every SQL statement checked out of the StatementCaches
+// of one ConnectionPool, keyed by SQL text.
+//
+// A statement is timed from acquire() until its CachedStatement hands it
+// back, which covers binding, every step and reading the rows. Caches look a
+// histogram up once, when they prepare the statement, and record into it
+// without taking this registry's lock.
+class StatementMetrics {
+public:
+  // Never null; valid for the lifetime of the registry
+  LatencyHistogram *histogram(std::string_view sql);
+
+  // Every statement run at least once, the most total time first
+  std::vector<StatementTiming> timings() const;
+
+private:
+  struct SqlHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view sql) const {
+      return std::hash<std::string_view>{}(sql);
+    }
+  };
+
+  mutable std::mutex mutex;
+  std::unordered_map<std::string, std::unique_ptr<LatencyHistogram>, SqlHash,
+                     std::equal_to<>>
+      histograms;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "StatementCache.hpp"
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct TranslationRecord;
+
+// In-memory copy of the Translations table.
+//
+// Description keys and language codes are interned to dense ids; every key
+// owns a small vector of (language, value) pairs kept in language code order,
+// which is the order the Translations unique index returns them in. Writes
+// made through RecloserManager are applied here after they commit to SQLite;
+// inside a Transaction they are staged until the outermost one commits.
+class TranslationDictionary {
+public:
+  using KeyId = uint32_t;
+  using LanguageId = uint32_t;
+
+  // Replaces the contents with every row of the Translations table
+  bool load(StatementCache &statements);
+
+  void upsert(const std::string &key, const std::string &langCode,
+              const std::string &value);
+  // Applies the records in order under a single lock
+  void upsert(const std::vector<TranslationRecord> &records);
+
+  std::vector<TranslationRecord> lookup(const std::string &key) const;
+  std::string lookup(const std::string &key, const std::string &langCode) const;
+
+  // One entry per requested key, in request order, under a single lock
+  std::vector<std::vector<TranslationRecord>>
+  resolve(const std::vector<std::string> &keys) const;
+
+  size_t keyCount() const;
+  size_t languageCount() const;
+
+private:
+  struct Entry {
+    LanguageId language;
+    std::string value;
+  };
+
+  KeyId internKey(const std::string &key);
+  LanguageId internLanguage(const std::string &langCode);
+  void upsertLocked(KeyId key, LanguageId language, const std::string &value);
+  void appendRecords(KeyId key, std::vector<TranslationRecord> &out) const;
+
+  mutable std::shared_mutex mutex;
+  std::unordered_map<std::string, KeyId> keyIds;
+  std::vector<std::string> keys;
+  std::unordered_map<std::string, LanguageId> languageIds;
+  std::vector<std::string> languages;
+  std::vector<std::vector<Entry>> entries; // indexed by KeyId
+};
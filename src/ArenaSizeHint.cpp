@@ -0,0 +1,28 @@
+#include "ArenaSizeHint.hpp"
+#include <algorithm>
+
+namespace {
+
+// A response past this size grows the arena block by block again
+constexpr size_t MAX_FIRST_BLOCK = 64 * 1024 * 1024;
+
+} // namespace
+
+google::protobuf::ArenaOptions ArenaSizeHint::options() const {
+  google::protobuf::ArenaOptions options;
+  size_t last = lastBytes();
+  if (last > 0) {
+    // SpaceUsed() leaves out the arena's list of strings to destroy, about
+    // a quarter on top for these messages; the rest lets a slightly larger
+    // response still fit
+    size_t first = std::min(last + last / 2, MAX_FIRST_BLOCK);
+    options.start_block_size = first;
+    options.max_block_size = std::max(options.max_block_size, first);
+  }
+  return options;
+}
+
+void ArenaSizeHint::record(const google::protobuf::Arena &arena) {
+  bytes.store(static_cast<size_t>(arena.SpaceUsed()),
+              std::memory_order_relaxed);
+}
@@ -0,0 +1,197 @@
+#include "CatalogSearch.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+
+// Matches read per query, per index. Ranking every match of a short prefix
+// would read a large part of the index: FTS5's bm25 alone counts every
+// matching row before scoring the first one. Beyond this window the query
+// reports itself truncated and the user is expected to type on.
+constexpr int CANDIDATE_LIMIT = 200;
+
+// Longest prefix with an index of its own, see catalogSearchMigration()
+constexpr size_t INDEXED_PREFIX = 8;
+
+// The first ?3 matches of each index in index order, the translations
+// limited to the requested language (?2, empty for any) and both narrowed
+// by the LIKE pattern ?4. The first column tells the indexes apart. The
+// CROSS JOINs make SQLite start from the full-text matches.
+const char *CANDIDATES_SQL =
+    "SELECT * FROM (SELECT 0, t.description_key, t.language_code, t.value "
+    "FROM TranslationSearch CROSS JOIN Translations t "
+    "ON t.id = TranslationSearch.rowid WHERE TranslationSearch MATCH ?1 "
+    "AND (?2 = '' OR t.language_code = ?2) AND t.value LIKE ?4 LIMIT ?3) "
+    "UNION ALL SELECT * FROM (SELECT 1, d.key, '', d.key "
+    "FROM DescriptionSearch CROSS JOIN Descriptions d "
+    "ON d.rowid = DescriptionSearch.rowid WHERE DescriptionSearch MATCH ?1 "
+    "AND d.key LIKE ?4 LIMIT ?3);";
+
+// Features and services using one description key, one row per firmware
+const char *HITS_SQL =
+    "SELECT 0, f.id, sf.service_id, fv.id, fv.version, r.id, "
+    "r.description_key FROM Features f "
+    "CROSS JOIN ServiceFirmware sf ON sf.id = f.service_firmware_id "
+    "CROSS JOIN FirmwareVersions fv ON fv.id = sf.firmware_id "
+    "CROSS JOIN Reclosers r ON r.id = fv.recloser_id "
+    "WHERE f.description_key = ?1 "
+    "UNION ALL "
+    "SELECT 1, s.id, s.id, fv.id, fv.version, r.id, r.description_key "
+    "FROM Services s "
+    "CROSS JOIN ServiceFirmware sf ON sf.service_id = s.id "
+    "CROSS JOIN FirmwareVersions fv ON fv.id = sf.firmware_id "
+    "CROSS JOIN Reclosers r ON r.id = fv.recloser_id "
+    "WHERE s.description_key = ?1 ORDER BY 1, 2, 4;";
+
+struct Candidate {
+  std::string description_key;
+  std::string language_code;
+  std::string text;
+};
+
+bool isWordByte(unsigned char c) {
+  // Bytes of multi-byte UTF-8 characters are left to the tokenizer
+  return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') ||
+         (c >= 'a' && c <= 'z') || c >= 0x80;
+}
+
+std::string columnText(sqlite3_stmt *stmt, int col) {
+  const unsigned char *text = sqlite3_column_text(stmt, col);
+  return text ? reinterpret_cast<const char *>(text) : "";
+}
+
+} // namespace
+
+CatalogSearch::CatalogSearch(ConnectionPool &connections)
+    : connections(connections) {}
+
+CatalogSearch::Query CatalogSearch::parseQuery(const std::string &text) {
+  std::vector<std::string> words;
+  std::string word;
+  for (unsigned char c : text) {
+    if (isWordByte(c)) {
+      word += static_cast<char>(c);
+    } else if (!word.empty()) {
+      words.push_back(std::move(word));
+      word.clear();
+    }
+  }
+  if (!word.empty()) {
+    words.push_back(std::move(word));
+  }
+
+  // Quoted, so words are never read as FTS5 operators. A one letter prefix
+  // would match most of the index, so it is matched as a whole word.
+  Query query;
+  query.like = "%";
+  for (size_t i = 0; i < words.size(); ++i) {
+    std::string term = words[i];
+    bool last = i + 1 == words.size();
+    // FTS5 merges every doclist of a prefix longer than its prefix indexes
+    // up front. An ASCII word is cut to an indexed prefix instead, and LIKE
+    // (which only folds ASCII case) drops the rows without the whole word.
+    if (last && term.size() > INDEXED_PREFIX &&
+        std::all_of(term.begin(), term.end(),
+                    [](unsigned char c) { return c < 0x80; })) {
+      query.like = "%" + term + "%";
+      term.resize(INDEXED_PREFIX);
+    }
+    query.match += (i > 0 ? " \"" : "\"") + term + "\"";
+    if (last && term.size() > 1) {
+      query.match += "*";
+    }
+  }
+  return query;
+}
+
+RecloserManager::CatalogSearchResult
+CatalogSearch::search(const std::string &text, const std::string &languageCode,
+                      int limit, int offset) {
+  RecloserManager::CatalogSearchResult result;
+  Query query = parseQuery(text);
+  if (query.match.empty() || limit <= 0) {
+    return result;
+  }
+  offset = std::max(offset, 0);
+
+  auto lease = connections.acquireReader();
+
+  // The best match of each description key is its shortest matched text,
+  // the most specific one for the words typed
+  std::vector<Candidate> ranked;
+  {
+    auto stmt = lease.statements().acquire(CANDIDATES_SQL);
+    if (!stmt) {
+      return result;
+    }
+    sqlite3_bind_text(stmt.get(), 1, query.match.c_str(), -1,
+                      SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt.get(), 2, languageCode.c_str(), -1,
+                      SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt.get(), 3, CANDIDATE_LIMIT);
+    sqlite3_bind_text(stmt.get(), 4, query.like.c_str(), -1,
+                      SQLITE_TRANSIENT);
+
+    int matches[2] = {0, 0};
+    std::unordered_map<std::string, size_t> byKey;
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      matches[sqlite3_column_int(stmt.get(), 0) == 1 ? 1 : 0]++;
+      Candidate candidate{columnText(stmt.get(), 1),
+                          columnText(stmt.get(), 2),
+                          columnText(stmt.get(), 3)};
+      auto [it, added] =
+          byKey.try_emplace(candidate.description_key, ranked.size());
+      if (added) {
+        ranked.push_back(std::move(candidate));
+      } else if (candidate.text.size() < ranked[it->second].text.size()) {
+        ranked[it->second] = std::move(candidate);
+      }
+    }
+    result.truncated =
+        matches[0] >= CANDIDATE_LIMIT || matches[1] >= CANDIDATE_LIMIT;
+  }
+  std::sort(ranked.begin(), ranked.end(),
+            [](const Candidate &a, const Candidate &b) {
+              if (a.text.size() != b.text.size()) {
+                return a.text.size() < b.text.size();
+              }
+              return a.description_key < b.description_key;
+            });
+
+  // Keys are expanded in rank order until the page is full, so a page only
+  // reads the uses of the keys before it
+  auto stmt = lease.statements().acquire(HITS_SQL);
+  if (!stmt) {
+    return result;
+  }
+  int skipped = 0;
+  for (const auto &candidate : ranked) {
+    if (static_cast<int>(result.hits.size()) >= limit) {
+      break;
+    }
+    sqlite3_reset(stmt.get());
+    sqlite3_bind_text(stmt.get(), 1, candidate.description_key.c_str(), -1,
+                      SQLITE_TRANSIENT);
+    while (static_cast<int>(result.hits.size()) < limit &&
+           sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      if (skipped < offset) {
+        skipped++;
+        continue;
+      }
+      RecloserManager::CatalogSearchRecord rec;
+      rec.is_service = sqlite3_column_int(stmt.get(), 0) == 1;
+      rec.id = sqlite3_column_int(stmt.get(), 1);
+      rec.description_key = candidate.description_key;
+      rec.language_code = candidate.language_code;
+      rec.matched_text = candidate.text;
+      rec.service_id = sqlite3_column_int(stmt.get(), 2);
+      rec.firmware_id = sqlite3_column_int(stmt.get(), 3);
+      rec.firmware_version = columnText(stmt.get(), 4);
+      rec.recloser_id = sqlite3_column_int(stmt.get(), 5);
+      rec.recloser_key = columnText(stmt.get(), 6);
+      rec.score = static_cast<int>(candidate.text.size());
+      result.hits.push_back(std::move(rec));
+    }
+  }
+  return result;
+}
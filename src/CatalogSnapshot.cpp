@@ -0,0 +1,535 @@
+#include "CatalogSnapshot.hpp"
+#include <algorithm>
+#include <type_traits>
+#include <unordered_map>
+
+namespace {
+
+const char *columnText(sqlite3_stmt *stmt, int col) {
+  const unsigned char *text = sqlite3_column_text(stmt, col);
+  return text ? reinterpret_cast<const char *>(text) : "";
+}
+
+uint64_t nodeKey(int32_t serviceId, int32_t firmwareId) {
+  return (static_cast<uint64_t>(static_cast<uint32_t>(serviceId)) << 32) |
+         static_cast<uint32_t>(firmwareId);
+}
+
+// 64-bit FNV-1a, finished with the splitmix64 mixer
+uint64_t hashString(std::string_view text) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (unsigned char c : text) {
+    h = (h ^ c) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+uint64_t mix(uint64_t h) {
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+uint64_t combine(uint64_t seed, uint64_t value) {
+  return mix(seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) +
+                     (seed >> 2)));
+}
+
+template <typename T> void growTo(std::vector<T> &items, int32_t id) {
+  if (id >= 0 && static_cast<size_t>(id) >= items.size()) {
+    items.resize(static_cast<size_t>(id) + 1);
+  }
+}
+
+} // namespace
+
+struct CatalogSnapshot::Tables {
+  std::string stringData;
+  std::vector<uint32_t> stringOffsets;
+  std::vector<RecloserEntry> reclosers;
+  std::vector<int32_t> firmwareIds;
+  std::vector<FirmwareEntry> firmwaresById;
+  std::vector<ServiceNodeEntry> nodesById;
+  std::vector<int32_t> childNodeIds;
+  std::vector<int32_t> childNodeIdsByKey;
+  std::vector<FeatureEntry> features;
+  std::vector<ComponentEntry> components;
+  std::vector<LimitEntry> limits;
+  std::vector<TranslationEntry> translations;
+  std::vector<Range> translationsByString;
+};
+
+class CatalogSnapshot::Builder {
+public:
+  Builder(StatementCache &statements, CatalogSnapshot &snapshot)
+      : statements(statements), snapshot(snapshot), tables(*snapshot.tables) {
+    tables.stringOffsets.push_back(0);
+    intern(""); // StringId 0 is always the empty string
+  }
+
+  bool run() {
+    auto revision = readRevision(statements);
+    if (!revision) {
+      return false;
+    }
+    snapshot.revision_ = *revision;
+
+    if (!(loadReclosers() && loadFirmwares() && loadNodes() &&
+          loadFeatures() && loadComponents() && loadLimits() &&
+          loadTranslations())) {
+      return false;
+    }
+    // Every table has its final size now; the passes below only reorder
+    // and fill in place, reading through the snapshot's views
+    snapshot.bind();
+    sortChildrenByKey();
+    hashSubtrees();
+    return true;
+  }
+
+private:
+  StringId intern(std::string_view text) {
+    auto it = stringIds.find(std::string(text));
+    if (it != stringIds.end()) {
+      return it->second;
+    }
+    StringId id = static_cast<StringId>(tables.stringOffsets.size() - 1);
+    tables.stringData.append(text);
+    tables.stringOffsets.push_back(
+        static_cast<uint32_t>(tables.stringData.size()));
+    stringIds.emplace(std::string(text), id);
+    return id;
+  }
+
+  // Extends the range of the group the current row belongs to. Rows must
+  // arrive grouped, which every query below guarantees with ORDER BY.
+  static void extend(Range &range, size_t index) {
+    if (range.count == 0) {
+      range.begin = static_cast<uint32_t>(index);
+    }
+    range.count++;
+  }
+
+  bool loadReclosers() {
+    auto stmt = statements.acquire(
+        "SELECT id, description_key FROM Reclosers ORDER BY id;");
+    if (!stmt)
+      return false;
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      RecloserEntry rec{};
+      rec.id = sqlite3_column_int(stmt.get(), 0);
+      rec.descriptionKey = intern(columnText(stmt.get(), 1));
+      recloserIndex[rec.id] = tables.reclosers.size();
+      tables.reclosers.push_back(rec);
+    }
+    return true;
+  }
+
+  bool loadFirmwares() {
+    auto stmt = statements.acquire("SELECT id, version, recloser_id FROM "
+                                   "FirmwareVersions ORDER BY recloser_id, id;");
+    if (!stmt)
+      return false;
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      int32_t id = sqlite3_column_int(stmt.get(), 0);
+      int32_t recloserId = sqlite3_column_int(stmt.get(), 2);
+      auto owner = recloserIndex.find(recloserId);
+      if (owner == recloserIndex.end())
+        continue;
+
+      growTo(tables.firmwaresById, id);
+      FirmwareEntry &fw = tables.firmwaresById[id];
+      fw.id = id;
+      fw.recloserId = recloserId;
+      fw.version = intern(columnText(stmt.get(), 1));
+
+      extend(tables.reclosers[owner->second].firmwares,
+             tables.firmwareIds.size());
+      tables.firmwareIds.push_back(id);
+    }
+    return true;
+  }
+
+  bool loadNodes() {
+    auto stmt = statements.acquire(
+        "SELECT sf.id, sf.service_id, sf.firmware_id, s.description_key, "
+        "IFNULL(s.parent_id, 0) FROM ServiceFirmware sf "
+        "JOIN Services s ON s.id = sf.service_id "
+        "ORDER BY sf.firmware_id, s.id;");
+    if (!stmt)
+      return false;
+
+    struct Row {
+      int32_t id;
+      int32_t parentServiceId;
+    };
+    std::vector<Row> rows;
+    std::unordered_map<uint64_t, int32_t> nodeByService;
+
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      int32_t id = sqlite3_column_int(stmt.get(), 0);
+      growTo(tables.nodesById, id);
+      ServiceNodeEntry &node = tables.nodesById[id];
+      node.id = id;
+      node.serviceId = sqlite3_column_int(stmt.get(), 1);
+      node.firmwareId = sqlite3_column_int(stmt.get(), 2);
+      node.descriptionKey = intern(columnText(stmt.get(), 3));
+      nodeByService[nodeKey(node.serviceId, node.firmwareId)] = id;
+      rows.push_back(Row{id, sqlite3_column_int(stmt.get(), 4)});
+    }
+    snapshot.nodeCount_ = rows.size();
+
+    // Children in service id order, per parent node and per firmware
+    std::unordered_map<int32_t, std::vector<int32_t>> children;
+    std::unordered_map<int32_t, std::vector<int32_t>> topLevel;
+    for (const auto &row : rows) {
+      ServiceNodeEntry &node = tables.nodesById[row.id];
+      if (row.parentServiceId == 0) {
+        topLevel[node.firmwareId].push_back(row.id);
+        continue;
+      }
+      auto parent = nodeByService.find(nodeKey(row.parentServiceId,
+                                               node.firmwareId));
+      if (parent != nodeByService.end()) {
+        node.parentNodeId = parent->second;
+        children[parent->second].push_back(row.id);
+      }
+    }
+
+    for (auto &[parentId, ids] : children) {
+      Range &range = tables.nodesById[parentId].children;
+      range.begin = static_cast<uint32_t>(tables.childNodeIds.size());
+      range.count = static_cast<uint32_t>(ids.size());
+      tables.childNodeIds.insert(tables.childNodeIds.end(), ids.begin(),
+                                 ids.end());
+    }
+    for (auto &[firmwareId, ids] : topLevel) {
+      if (firmwareId < 0 ||
+          static_cast<size_t>(firmwareId) >= tables.firmwaresById.size() ||
+          tables.firmwaresById[firmwareId].id == 0)
+        continue;
+      Range &range = tables.firmwaresById[firmwareId].topLevelNodes;
+      range.begin = static_cast<uint32_t>(tables.childNodeIds.size());
+      range.count = static_cast<uint32_t>(ids.size());
+      tables.childNodeIds.insert(tables.childNodeIds.end(), ids.begin(),
+                                 ids.end());
+    }
+    // Reordered by description key once strings can be compared
+    tables.childNodeIdsByKey = tables.childNodeIds;
+    return true;
+  }
+
+  bool loadFeatures() {
+    auto stmt = statements.acquire(
+        "SELECT id, description_key, service_firmware_id FROM Features "
+        "ORDER BY service_firmware_id, id;");
+    if (!stmt)
+      return false;
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      int32_t sfId = sqlite3_column_int(stmt.get(), 2);
+      if (sfId <= 0 || static_cast<size_t>(sfId) >= tables.nodesById.size() ||
+          tables.nodesById[sfId].id == 0)
+        continue;
+
+      FeatureEntry feat{};
+      feat.id = sqlite3_column_int(stmt.get(), 0);
+      feat.descriptionKey = intern(columnText(stmt.get(), 1));
+      featureIndex[feat.id] = tables.features.size();
+      extend(tables.nodesById[sfId].features, tables.features.size());
+      tables.features.push_back(feat);
+    }
+    return true;
+  }
+
+  bool loadComponents() {
+    auto stmt = statements.acquire(
+        "SELECT fc.id, fc.feature_id, c.type FROM FeatureComponent fc "
+        "JOIN Component c ON c.id = fc.component_id "
+        "ORDER BY fc.feature_id, fc.id;");
+    if (!stmt)
+      return false;
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      auto owner = featureIndex.find(sqlite3_column_int(stmt.get(), 1));
+      if (owner == featureIndex.end())
+        continue;
+
+      ComponentEntry comp{};
+      comp.id = sqlite3_column_int(stmt.get(), 0);
+      comp.type = intern(columnText(stmt.get(), 2));
+      componentIndex[comp.id] = tables.components.size();
+      extend(tables.features[owner->second].components,
+             tables.components.size());
+      tables.components.push_back(comp);
+    }
+    return true;
+  }
+
+  bool loadLimits() {
+    auto stmt = statements.acquire(
+        "SELECT fcl.feature_component_id, l.key, fcl.value "
+        "FROM FeatureComponentLimits fcl JOIN Limits l ON l.id = fcl.limit_id "
+        "ORDER BY fcl.feature_component_id, fcl.id;");
+    if (!stmt)
+      return false;
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      auto owner = componentIndex.find(sqlite3_column_int(stmt.get(), 0));
+      if (owner == componentIndex.end())
+        continue;
+
+      LimitEntry lim{};
+      lim.key = intern(columnText(stmt.get(), 1));
+      lim.value = intern(columnText(stmt.get(), 2));
+      extend(tables.components[owner->second].limits,
+             tables.limits.size());
+      tables.limits.push_back(lim);
+    }
+    return true;
+  }
+
+  bool loadTranslations() {
+    auto stmt = statements.acquire(
+        "SELECT description_key, language_code, value FROM Translations "
+        "ORDER BY description_key, language_code;");
+    if (!stmt)
+      return false;
+
+    std::vector<std::pair<StringId, size_t>> groups;
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      StringId key = intern(columnText(stmt.get(), 0));
+      TranslationEntry entry{};
+      entry.languageCode = intern(columnText(stmt.get(), 1));
+      entry.value = intern(columnText(stmt.get(), 2));
+      if (groups.empty() || groups.back().first != key) {
+        groups.emplace_back(key, tables.translations.size());
+      }
+      tables.translations.push_back(entry);
+    }
+
+    tables.translationsByString.resize(tables.stringOffsets.size() - 1);
+    for (size_t i = 0; i < groups.size(); ++i) {
+      size_t end = i + 1 < groups.size() ? groups[i + 1].second
+                                         : tables.translations.size();
+      Range &range = tables.translationsByString[groups[i].first];
+      range.begin = static_cast<uint32_t>(groups[i].second);
+      range.count = static_cast<uint32_t>(end - groups[i].second);
+    }
+    return true;
+  }
+
+  void sortChildrenByKey() {
+    const CatalogSnapshot &snap = snapshot;
+    auto byKey = [&snap](int32_t a, int32_t b) {
+      return snap.string(snap.nodesById[a].descriptionKey) <
+             snap.string(snap.nodesById[b].descriptionKey);
+    };
+    auto sortRange = [&](Range range) {
+      auto first = tables.childNodeIdsByKey.begin() + range.begin;
+      std::sort(first, first + range.count, byKey);
+    };
+    for (const auto &node : tables.nodesById) {
+      sortRange(node.children);
+    }
+    for (const auto &fw : tables.firmwaresById) {
+      sortRange(fw.topLevelNodes);
+    }
+  }
+
+  // Post-order from each firmware's top level, so nodes caught in a parent
+  // cycle (never reachable from a root) are left at 0
+  void hashSubtrees() {
+    for (auto &fw : tables.firmwaresById) {
+      std::vector<uint64_t> parts;
+      for (int32_t id : snapshot.topLevelNodeIdsOf(fw)) {
+        parts.push_back(hashSubtree(tables.nodesById[id]));
+      }
+      std::sort(parts.begin(), parts.end());
+      uint64_t h = combine(0, parts.size());
+      for (uint64_t part : parts) {
+        h = combine(h, part);
+      }
+      fw.contentHash = h;
+    }
+  }
+
+  uint64_t hashSubtree(ServiceNodeEntry &node) {
+    uint64_t h = combine(0, hashString(snapshot.string(node.descriptionKey)));
+    for (const auto &t : snapshot.translationsOf(node.descriptionKey)) {
+      h = combine(h, hashString(snapshot.string(t.languageCode)));
+      h = combine(h, hashString(snapshot.string(t.value)));
+    }
+
+    // Features and children are hashed as unordered collections, matching
+    // how CompareServiceTrees pairs them up by key
+    std::vector<uint64_t> parts;
+    for (const auto &feat : snapshot.featuresOf(node)) {
+      uint64_t fh = hashString(snapshot.string(feat.descriptionKey));
+      for (const auto &comp : snapshot.componentsOf(feat)) {
+        fh = combine(fh, hashString(snapshot.string(comp.type)));
+        for (const auto &lim : snapshot.limitsOf(comp)) {
+          fh = combine(fh, hashString(snapshot.string(lim.key)));
+          fh = combine(fh, hashString(snapshot.string(lim.value)));
+        }
+      }
+      parts.push_back(fh);
+    }
+    std::sort(parts.begin(), parts.end());
+    h = combine(h, parts.size());
+    for (uint64_t part : parts) {
+      h = combine(h, part);
+    }
+
+    parts.clear();
+    for (int32_t childId : snapshot.childNodeIdsOf(node)) {
+      parts.push_back(hashSubtree(tables.nodesById[childId]));
+    }
+    std::sort(parts.begin(), parts.end());
+    h = combine(h, parts.size());
+    for (uint64_t part : parts) {
+      h = combine(h, part);
+    }
+
+    node.subtreeHash = h;
+    return h;
+  }
+
+  StatementCache &statements;
+  CatalogSnapshot &snapshot;
+  Tables &tables;
+  std::unordered_map<std::string, StringId> stringIds;
+  std::unordered_map<int32_t, size_t> recloserIndex;
+  std::unordered_map<int32_t, size_t> featureIndex;
+  std::unordered_map<int32_t, size_t> componentIndex;
+};
+
+CatalogSnapshot::CatalogSnapshot() = default;
+CatalogSnapshot::~CatalogSnapshot() = default;
+
+std::shared_ptr<const CatalogSnapshot>
+CatalogSnapshot::build(StatementCache &statements, uint64_t version) {
+  auto snapshot = std::make_shared<CatalogSnapshot>();
+  snapshot->version_ = version;
+  snapshot->tables = std::make_unique<Tables>();
+  Builder builder(statements, *snapshot);
+  if (!builder.run()) {
+    return nullptr;
+  }
+  return snapshot;
+}
+
+std::optional<CatalogSnapshot::Revision>
+CatalogSnapshot::readRevision(StatementCache &statements) {
+  auto stmt = statements.acquire(
+      "SELECT origin, revision FROM CatalogRevision WHERE id = 1;");
+  if (!stmt || sqlite3_step(stmt.get()) != SQLITE_ROW) {
+    return std::nullopt;
+  }
+  Revision revision;
+  revision.origin = sqlite3_column_int64(stmt.get(), 0);
+  revision.revision = sqlite3_column_int64(stmt.get(), 1);
+  return revision;
+}
+
+void CatalogSnapshot::bind() {
+  auto view = [](const auto &items) {
+    using T = typename std::decay_t<decltype(items)>::value_type;
+    return View<T>{items.data(), items.data() + items.size()};
+  };
+  stringData = view(tables->stringData);
+  stringOffsets = view(tables->stringOffsets);
+  reclosers_ = view(tables->reclosers);
+  firmwareIds = view(tables->firmwareIds);
+  firmwaresById = view(tables->firmwaresById);
+  nodesById = view(tables->nodesById);
+  childNodeIds = view(tables->childNodeIds);
+  childNodeIdsByKey = view(tables->childNodeIdsByKey);
+  features_ = view(tables->features);
+  components_ = view(tables->components);
+  limits_ = view(tables->limits);
+  translations_ = view(tables->translations);
+  translationsByString = view(tables->translationsByString);
+}
+
+std::string_view CatalogSnapshot::string(StringId id) const {
+  if (id + 1 >= stringOffsets.size()) {
+    return {};
+  }
+  return std::string_view(stringData.first, stringData.size())
+      .substr(stringOffsets[id], stringOffsets[id + 1] - stringOffsets[id]);
+}
+
+const CatalogSnapshot::FirmwareEntry *
+CatalogSnapshot::firmware(int32_t id) const {
+  if (id <= 0 || static_cast<size_t>(id) >= firmwaresById.size() ||
+      firmwaresById[id].id == 0) {
+    return nullptr;
+  }
+  return &firmwaresById[id];
+}
+
+const CatalogSnapshot::ServiceNodeEntry *
+CatalogSnapshot::node(int32_t serviceFirmwareId) const {
+  if (serviceFirmwareId <= 0 ||
+      static_cast<size_t>(serviceFirmwareId) >= nodesById.size() ||
+      nodesById[serviceFirmwareId].id == 0) {
+    return nullptr;
+  }
+  return &nodesById[serviceFirmwareId];
+}
+
+CatalogSnapshot::View<int32_t>
+CatalogSnapshot::firmwareIdsOf(const RecloserEntry &recloser) const {
+  return slice(firmwareIds, recloser.firmwares);
+}
+
+CatalogSnapshot::View<int32_t>
+CatalogSnapshot::topLevelNodeIdsOf(const FirmwareEntry &firmware) const {
+  return slice(childNodeIds, firmware.topLevelNodes);
+}
+
+CatalogSnapshot::View<int32_t>
+CatalogSnapshot::childNodeIdsOf(const ServiceNodeEntry &node) const {
+  return slice(childNodeIds, node.children);
+}
+
+CatalogSnapshot::View<int32_t>
+CatalogSnapshot::topLevelNodeIdsByKeyOf(const FirmwareEntry &firmware) const {
+  return slice(childNodeIdsByKey, firmware.topLevelNodes);
+}
+
+CatalogSnapshot::View<int32_t>
+CatalogSnapshot::childNodeIdsByKeyOf(const ServiceNodeEntry &node) const {
+  return slice(childNodeIdsByKey, node.children);
+}
+
+CatalogSnapshot::View<CatalogSnapshot::FeatureEntry>
+CatalogSnapshot::featuresOf(const ServiceNodeEntry &node) const {
+  return slice(features_, node.features);
+}
+
+CatalogSnapshot::View<CatalogSnapshot::ComponentEntry>
+CatalogSnapshot::componentsOf(const FeatureEntry &feature) const {
+  return slice(components_, feature.components);
+}
+
+CatalogSnapshot::View<CatalogSnapshot::LimitEntry>
+CatalogSnapshot::limitsOf(const ComponentEntry &component) const {
+  return slice(limits_, component.limits);
+}
+
+CatalogSnapshot::View<CatalogSnapshot::TranslationEntry>
+CatalogSnapshot::translationsOf(StringId descriptionKey) const {
+  if (descriptionKey >= translationsByString.size()) {
+    return View<TranslationEntry>{nullptr, nullptr};
+  }
+  return slice(translations_, translationsByString[descriptionKey]);
+}
+
+std::string_view CatalogSnapshot::translation(StringId descriptionKey,
+                                              std::string_view languageCode) const {
+  for (const auto &entry : translationsOf(descriptionKey)) {
+    if (string(entry.languageCode) == languageCode) {
+      return string(entry.value);
+    }
+  }
+  return {};
+}
@@ -0,0 +1,342 @@
+#include "CatalogSnapshot.hpp"
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+// Snapshot file layout, all integers in host byte order:
+//
+//   FileHeader                 fixed size, see below
+//   section 0 .. SECTION_COUNT-1, each starting on an 8-byte boundary
+//
+// Every section is one of the snapshot's arrays copied verbatim, so open()
+// validates the header and points the views into the mapping. The checksum
+// covers the header up to the checksum field and every byte after the
+// header; it is verified before anything else in the file is trusted. The
+// ranges and ids inside the sections are then checked against the section
+// sizes before the snapshot serves a read.
+
+namespace {
+
+constexpr char MAGIC[8] = {'R', 'C', 'L', 'S', 'N', 'A', 'P', '\0'};
+// Bump whenever the header or any entry struct changes layout
+constexpr uint32_t FORMAT_VERSION = 1;
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+enum Section : uint32_t {
+  STRING_DATA,
+  STRING_OFFSETS,
+  RECLOSERS,
+  FIRMWARE_IDS,
+  FIRMWARES_BY_ID,
+  NODES_BY_ID,
+  CHILD_NODE_IDS,
+  CHILD_NODE_IDS_BY_KEY,
+  FEATURES,
+  COMPONENTS,
+  LIMITS,
+  TRANSLATIONS,
+  TRANSLATIONS_BY_STRING,
+  SECTION_COUNT
+};
+
+struct SectionEntry {
+  uint64_t offset; // from the start of the file
+  uint64_t count;  // elements, not bytes
+};
+
+struct FileHeader {
+  char magic[8];
+  uint32_t formatVersion;
+  uint32_t byteOrder;
+  int64_t origin;
+  int64_t revision;
+  uint64_t nodeCount;
+  SectionEntry sections[SECTION_COUNT];
+  uint64_t checksum;
+};
+
+constexpr size_t CHECKED_HEADER_BYTES = offsetof(FileHeader, checksum);
+
+uint64_t mix(uint64_t h) {
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+// Word-at-a-time 64-bit hash, strong enough to catch torn or corrupted
+// files at memory bandwidth rather than byte-at-a-time speed
+uint64_t checksum(uint64_t h, const char *data, size_t size) {
+  size_t words = size / 8;
+  for (size_t i = 0; i < words; ++i) {
+    uint64_t word;
+    std::memcpy(&word, data + i * 8, 8);
+    h = (h ^ word) * 0x100000001b3ULL;
+    h ^= h >> 29;
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, data + words * 8, size - words * 8);
+  h = (h ^ tail) * 0x100000001b3ULL;
+  return mix(h ^ size);
+}
+
+uint64_t alignUp(uint64_t offset) { return (offset + 7) & ~uint64_t(7); }
+
+} // namespace
+
+bool CatalogSnapshot::save(const std::string &path) const {
+  struct Source {
+    const void *data;
+    size_t count;
+    size_t elementSize;
+  };
+  auto source = [](const auto &view) {
+    using T = std::remove_const_t<std::remove_pointer_t<decltype(view.first)>>;
+    static_assert(std::is_trivially_copyable_v<T>);
+    // No padding, so every byte written (and checksummed) is initialized
+    static_assert(std::has_unique_object_representations_v<T>);
+    return Source{view.first, view.size(), sizeof(T)};
+  };
+  const Source sources[SECTION_COUNT] = {
+      source(stringData),        source(stringOffsets),
+      source(reclosers_),        source(firmwareIds),
+      source(firmwaresById),     source(nodesById),
+      source(childNodeIds),      source(childNodeIdsByKey),
+      source(features_),         source(components_),
+      source(limits_),           source(translations_),
+      source(translationsByString)};
+
+  FileHeader header{};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.formatVersion = FORMAT_VERSION;
+  header.byteOrder = BYTE_ORDER_MARK;
+  header.origin = revision_.origin;
+  header.revision = revision_.revision;
+  header.nodeCount = nodeCount_;
+
+  // Lay the sections out and build the payload after the header
+  std::string payload;
+  for (uint32_t i = 0; i < SECTION_COUNT; ++i) {
+    payload.resize(alignUp(sizeof(FileHeader) + payload.size()) -
+                   sizeof(FileHeader));
+    header.sections[i].offset = sizeof(FileHeader) + payload.size();
+    header.sections[i].count = sources[i].count;
+    payload.append(static_cast<const char *>(sources[i].data),
+                   sources[i].count * sources[i].elementSize);
+  }
+  header.checksum =
+      checksum(checksum(0, reinterpret_cast<const char *>(&header),
+                        CHECKED_HEADER_BYTES),
+               payload.data(), payload.size());
+
+  // Readers map the file by name, so it must never be seen half written
+  std::string tempPath = path + ".tmp";
+  {
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+    out.flush();
+    if (!out) {
+      std::cerr << "Failed to write catalog snapshot file " << tempPath
+                << std::endl;
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tempPath, path, ec);
+  if (ec) {
+    std::cerr << "Failed to replace catalog snapshot file " << path << ": "
+              << ec.message() << std::endl;
+    std::filesystem::remove(tempPath, ec);
+    return false;
+  }
+  return true;
+}
+
+std::shared_ptr<const CatalogSnapshot>
+CatalogSnapshot::open(const std::string &path, uint64_t version,
+                      const Revision &expected) {
+  auto file = MappedFile::open(path);
+  if (!file) {
+    std::cout << "No catalog snapshot file at " << path << std::endl;
+    return nullptr;
+  }
+  auto reject = [&path](const char *reason) {
+    std::cout << "Ignoring catalog snapshot file " << path << ": " << reason
+              << std::endl;
+    return nullptr;
+  };
+
+  // The mapping is page aligned, so the header and every 8-byte aligned
+  // section can be read in place
+  if (file->size() < sizeof(FileHeader)) {
+    return reject("truncated");
+  }
+  const auto &header = *reinterpret_cast<const FileHeader *>(file->data());
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+    return reject("not a catalog snapshot");
+  }
+  if (header.formatVersion != FORMAT_VERSION ||
+      header.byteOrder != BYTE_ORDER_MARK) {
+    return reject("written by an incompatible build");
+  }
+  // Cheap staleness check first; the checksum has to read the whole file
+  if (header.origin != expected.origin ||
+      header.revision != expected.revision) {
+    return reject("stale, the catalog changed since it was saved");
+  }
+  uint64_t sum = checksum(
+      checksum(0, file->data(), CHECKED_HEADER_BYTES),
+      file->data() + sizeof(FileHeader), file->size() - sizeof(FileHeader));
+  if (sum != header.checksum) {
+    return reject("checksum mismatch");
+  }
+
+  auto snapshot = std::make_shared<CatalogSnapshot>();
+  snapshot->version_ = version;
+  snapshot->revision_ = Revision{header.origin, header.revision};
+  snapshot->nodeCount_ = static_cast<size_t>(header.nodeCount);
+
+  bool fits = true;
+  auto view = [&](Section section, auto &target) {
+    using T = std::remove_const_t<
+        std::remove_pointer_t<decltype(target.first)>>;
+    const SectionEntry &entry = header.sections[section];
+    if (entry.offset % alignof(T) != 0 || entry.offset > file->size() ||
+        entry.count > (file->size() - entry.offset) / sizeof(T)) {
+      fits = false;
+      return;
+    }
+    const T *first = reinterpret_cast<const T *>(file->data() + entry.offset);
+    target = View<T>{first, first + entry.count};
+  };
+  view(STRING_DATA, snapshot->stringData);
+  view(STRING_OFFSETS, snapshot->stringOffsets);
+  view(RECLOSERS, snapshot->reclosers_);
+  view(FIRMWARE_IDS, snapshot->firmwareIds);
+  view(FIRMWARES_BY_ID, snapshot->firmwaresById);
+  view(NODES_BY_ID, snapshot->nodesById);
+  view(CHILD_NODE_IDS, snapshot->childNodeIds);
+  view(CHILD_NODE_IDS_BY_KEY, snapshot->childNodeIdsByKey);
+  view(FEATURES, snapshot->features_);
+  view(COMPONENTS, snapshot->components_);
+  view(LIMITS, snapshot->limits_);
+  view(TRANSLATIONS, snapshot->translations_);
+  view(TRANSLATIONS_BY_STRING, snapshot->translationsByString);
+  if (!fits) {
+    return reject("section out of bounds");
+  }
+  // The checksum only proves the file is what save() wrote, not that the
+  // build which wrote it laid the tables out the way this one reads them
+  if (const char *reason = snapshot->inconsistency()) {
+    return reject(reason);
+  }
+
+  snapshot->file = std::move(file);
+  return snapshot;
+}
+
+const char *CatalogSnapshot::inconsistency() const {
+  if (stringOffsets.size() == 0) {
+    return "no string table";
+  }
+  for (size_t i = 1; i < stringOffsets.size(); ++i) {
+    if (stringOffsets[i] < stringOffsets[i - 1]) {
+      return "string offsets out of order";
+    }
+  }
+  if (stringOffsets[stringOffsets.size() - 1] > stringData.size()) {
+    return "string offset out of bounds";
+  }
+  size_t stringCount = stringOffsets.size() - 1;
+  auto badString = [stringCount](StringId id) { return id >= stringCount; };
+  auto badRange = [](Range range, size_t size) {
+    return range.begin > size || range.count > size - range.begin;
+  };
+
+  if (childNodeIdsByKey.size() != childNodeIds.size()) {
+    return "child node orders differ in size";
+  }
+  // Every listed child must name the node listing it as its parent, which
+  // also keeps parent cycles out of every walk from a firmware's top level
+  auto badChildren = [&](Range range, int32_t parentNodeId,
+                         int32_t firmwareId) {
+    for (auto ids :
+         {slice(childNodeIds, range), slice(childNodeIdsByKey, range)}) {
+      for (int32_t id : ids) {
+        const ServiceNodeEntry *child = node(id);
+        if (!child || child->parentNodeId != parentNodeId ||
+            child->firmwareId != firmwareId) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+
+  for (const auto &recloser : reclosers_) {
+    if (badString(recloser.descriptionKey) ||
+        badRange(recloser.firmwares, firmwareIds.size())) {
+      return "recloser out of bounds";
+    }
+  }
+  for (int32_t id : firmwareIds) {
+    if (!firmware(id)) {
+      return "unknown firmware id";
+    }
+  }
+  for (size_t i = 0; i < firmwaresById.size(); ++i) {
+    const FirmwareEntry &fw = firmwaresById[i];
+    if (fw.id == 0) {
+      continue;
+    }
+    if (static_cast<size_t>(fw.id) != i || badString(fw.version) ||
+        badRange(fw.topLevelNodes, childNodeIds.size()) ||
+        badChildren(fw.topLevelNodes, 0, fw.id)) {
+      return "firmware out of bounds";
+    }
+  }
+  for (size_t i = 0; i < nodesById.size(); ++i) {
+    const ServiceNodeEntry &entry = nodesById[i];
+    if (entry.id == 0) {
+      continue;
+    }
+    if (static_cast<size_t>(entry.id) != i ||
+        badString(entry.descriptionKey) ||
+        badRange(entry.features, features_.size()) ||
+        badRange(entry.children, childNodeIds.size()) ||
+        badChildren(entry.children, entry.id, entry.firmwareId)) {
+      return "service node out of bounds";
+    }
+  }
+  for (const auto &feature : features_) {
+    if (badString(feature.descriptionKey) ||
+        badRange(feature.components, components_.size())) {
+      return "feature out of bounds";
+    }
+  }
+  for (const auto &component : components_) {
+    if (badString(component.type) ||
+        badRange(component.limits, limits_.size())) {
+      return "component out of bounds";
+    }
+  }
+  for (const auto &limit : limits_) {
+    if (badString(limit.key) || badString(limit.value)) {
+      return "limit out of bounds";
+    }
+  }
+  for (const auto &translation : translations_) {
+    if (badString(translation.languageCode) || badString(translation.value)) {
+      return "translation out of bounds";
+    }
+  }
+  for (Range range : translationsByString) {
+    if (badRange(range, translations_.size())) {
+      return "translation range out of bounds";
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,119 @@
+#include "CatalogStore.hpp"
+#include "RecloserManager.hpp"
+#include <chrono>
+#include <iostream>
+
+CatalogStore::CatalogStore(RecloserManager *manager, std::string snapshotFile)
+    : manager(manager), snapshotFile(std::move(snapshotFile)) {
+  if (!this->snapshotFile.empty()) {
+    saver = std::thread(&CatalogStore::saveLatest, this);
+  }
+}
+
+CatalogStore::~CatalogStore() {
+  {
+    std::lock_guard<std::mutex> lock(saveMutex);
+    stopping = true;
+  }
+  saveWake.notify_one();
+  if (saver.joinable()) {
+    saver.join();
+  }
+}
+
+std::shared_ptr<const CatalogSnapshot> CatalogStore::current() const {
+#if defined(__cpp_lib_atomic_shared_ptr)
+  return snapshot.load(std::memory_order_acquire);
+#else
+  return std::atomic_load_explicit(&snapshot, std::memory_order_acquire);
+#endif
+}
+
+bool CatalogStore::load() {
+  if (snapshotFile.empty()) {
+    return publish();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(publishMutex);
+    auto start = std::chrono::steady_clock::now();
+    auto revision = manager->catalogRevision();
+    auto mapped = revision ? CatalogSnapshot::open(snapshotFile, nextVersion,
+                                                   *revision)
+                           : nullptr;
+    if (mapped) {
+      nextVersion++;
+      auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start);
+      std::cout << "Mapped catalog snapshot v" << mapped->version() << " ("
+                << mapped->nodeCount() << " service nodes, "
+                << mapped->featureCount() << " features) from "
+                << snapshotFile << " in " << elapsed.count() << " us"
+                << std::endl;
+      swapIn(std::move(mapped));
+      return true;
+    }
+  }
+  // Missing or stale: build from SQLite, which also rewrites the file
+  return publish();
+}
+
+bool CatalogStore::publish() {
+  // Serialize rebuilds so versions are published in increasing order
+  std::lock_guard<std::mutex> lock(publishMutex);
+
+  auto start = std::chrono::steady_clock::now();
+  auto next = manager->buildCatalogSnapshot(nextVersion);
+  if (!next) {
+    std::cerr << "Failed to build catalog snapshot" << std::endl;
+    return false;
+  }
+  nextVersion++;
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  std::cout << "Published catalog snapshot v" << next->version() << " ("
+            << next->nodeCount() << " service nodes, " << next->featureCount()
+            << " features) in " << elapsed.count() << " us" << std::endl;
+
+  swapIn(next);
+  if (!snapshotFile.empty()) {
+    {
+      std::lock_guard<std::mutex> saveLock(saveMutex);
+      pendingSave = std::move(next); // replaces any snapshot not saved yet
+    }
+    saveWake.notify_one();
+  }
+  return true;
+}
+
+void CatalogStore::saveLatest() {
+  std::unique_lock<std::mutex> lock(saveMutex);
+  while (true) {
+    saveWake.wait(lock, [this] { return pendingSave || stopping; });
+    if (!pendingSave) {
+      return; // stopping with nothing left to save
+    }
+    auto next = std::move(pendingSave);
+    pendingSave.reset();
+    lock.unlock();
+    // A failed save only costs the next startup a rebuild; the file on disk
+    // is either the previous complete snapshot or gone
+    next->save(snapshotFile);
+    lock.lock();
+  }
+}
+
+void CatalogStore::swapIn(std::shared_ptr<const CatalogSnapshot> next) {
+#if defined(__cpp_lib_atomic_shared_ptr)
+  snapshot.store(std::move(next), std::memory_order_release);
+#else
+  std::atomic_store_explicit(&snapshot, std::move(next),
+                             std::memory_order_release);
+#endif
+}
+
+uint64_t CatalogStore::version() const {
+  auto snap = current();
+  return snap ? snap->version() : 0;
+}
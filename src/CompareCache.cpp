@@ -0,0 +1,89 @@
+#include "CompareCache.hpp"
+#include <functional>
+#include <iterator>
+
+namespace {
+
+// List node, map node and shared_ptr control block of one entry
+constexpr size_t ENTRY_OVERHEAD = 160;
+
+} // namespace
+
+size_t CompareCache::KeyHash::operator()(const Key &key) const {
+  size_t h = std::hash<std::string>{}(key.languageCode);
+  h ^= std::hash<int64_t>{}((static_cast<int64_t>(key.firmwareId1) << 32) |
+                            static_cast<uint32_t>(key.firmwareId2)) +
+       0x9e3779b9 + (h << 6) + (h >> 2);
+  return h;
+}
+
+CompareCache::CompareCache(size_t capacityBytes)
+    : capacityBytes(capacityBytes) {}
+
+std::shared_ptr<const std::string>
+CompareCache::lookup(const Key &key, uint64_t revision1, uint64_t revision2) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = index.find(key);
+  if (it == index.end()) {
+    misses++;
+    return nullptr;
+  }
+
+  auto entry = it->second;
+  if (entry->revision1 != revision1 || entry->revision2 != revision2) {
+    // One of the firmwares changed since this result was computed
+    invalidations++;
+    misses++;
+    erase(entry);
+    return nullptr;
+  }
+
+  hits++;
+  lru.splice(lru.begin(), lru, entry);
+  return entry->payload;
+}
+
+void CompareCache::store(const Key &key, uint64_t revision1,
+                         uint64_t revision2, std::string payload) {
+  size_t entryBytes =
+      payload.size() + key.languageCode.size() + sizeof(Entry) + ENTRY_OVERHEAD;
+  if (entryBytes > capacityBytes) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto existing = index.find(key);
+  if (existing != index.end()) {
+    erase(existing->second);
+  }
+
+  while (!lru.empty() && bytes + entryBytes > capacityBytes) {
+    erase(std::prev(lru.end()));
+    evictions++;
+  }
+
+  lru.push_front(Entry{key, revision1, revision2,
+                       std::make_shared<const std::string>(std::move(payload)),
+                       entryBytes});
+  index.emplace(key, lru.begin());
+  bytes += entryBytes;
+}
+
+void CompareCache::erase(EntryList::iterator entry) {
+  bytes -= entry->bytes;
+  index.erase(entry->key);
+  lru.erase(entry);
+}
+
+CompareCacheStats CompareCache::stats() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  CompareCacheStats s;
+  s.hits = hits;
+  s.misses = misses;
+  s.invalidations = invalidations;
+  s.evictions = evictions;
+  s.entries = index.size();
+  s.bytes = bytes;
+  s.capacityBytes = capacityBytes;
+  return s;
+}
@@ -0,0 +1,208 @@
+#include "ConnectionPool.hpp"
+#include <algorithm>
+#include <iostream>
+
+thread_local std::vector<ConnectionPool::HeldReader>
+    ConnectionPool::heldReaders;
+thread_local std::vector<const ConnectionPool *> ConnectionPool::pinnedPools;
+
+ConnectionProfile ConnectionProfile::durable() {
+  return {"durable", "FULL", 2000, 0};
+}
+
+ConnectionProfile ConnectionProfile::balanced() {
+  return {"balanced", "NORMAL", 16 * 1024, 64LL * 1024 * 1024};
+}
+
+ConnectionProfile ConnectionProfile::throughput() {
+  return {"throughput", "OFF", 64 * 1024, 256LL * 1024 * 1024};
+}
+
+std::optional<ConnectionProfile>
+ConnectionProfile::byName(const std::string &name) {
+  for (auto profile : {durable(), balanced(), throughput()}) {
+    if (profile.name == name) {
+      return profile;
+    }
+  }
+  return std::nullopt;
+}
+
+ConnectionPool::ReadLease::~ReadLease() {
+  if (owner) {
+    owner->release(connection);
+  }
+}
+
+ConnectionPool::ConnectionPool(const std::string &dbPath,
+                               size_t readConnections,
+                               ConnectionProfile profile)
+    : dbPath(dbPath), readConnections(readConnections),
+      profile_(std::move(profile)) {}
+
+ConnectionPool::~ConnectionPool() {
+  // Cached statements must be finalized before their connection can close
+  for (auto &reader : readers) {
+    reader.statements.reset();
+    sqlite3_close(reader.db);
+  }
+  writerConnection.statements.reset();
+  if (writerConnection.db) {
+    sqlite3_close(writerConnection.db);
+  }
+}
+
+bool ConnectionPool::open() {
+  // The writer creates the file and switches it to WAL before any reader
+  // opens it; WAL lets readers run alongside the writer
+  if (!openConnection(writerConnection,
+                      SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) ||
+      !applyPragmas(writerConnection.db, true)) {
+    return false;
+  }
+
+  readers.resize(readConnections);
+  for (auto &reader : readers) {
+    if (!openConnection(reader, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX) ||
+        !applyPragmas(reader.db, false)) {
+      return false;
+    }
+    idle.push_back(&reader);
+  }
+
+  std::cout << "Opened " << dbPath << " with 1 writer and " << readers.size()
+            << " read connection(s), profile '" << profile_.name << "'"
+            << std::endl;
+  return true;
+}
+
+bool ConnectionPool::openConnection(Connection &connection, int flags) {
+  int rc = sqlite3_open_v2(dbPath.c_str(), &connection.db, flags, nullptr);
+  if (rc != SQLITE_OK) {
+    std::cerr << "Cannot open database: " << sqlite3_errmsg(connection.db)
+              << std::endl;
+    return false;
+  }
+  connection.statements =
+      std::make_unique<StatementCache>(connection.db, &statementMetrics);
+  return true;
+}
+
+bool ConnectionPool::applyPragmas(sqlite3 *db, bool writer) {
+  std::string sql = "PRAGMA busy_timeout = 5000;"
+                    "PRAGMA cache_size = -" +
+                    std::to_string(profile_.cacheSizeKiB) +
+                    ";"
+                    "PRAGMA mmap_size = " +
+                    std::to_string(profile_.mmapSizeBytes) + ";";
+  if (writer) {
+    sql += "PRAGMA journal_mode = WAL;"
+           "PRAGMA foreign_keys = ON;"
+           "PRAGMA synchronous = " +
+           profile_.synchronous + ";";
+  }
+
+  char *zErrMsg = nullptr;
+  if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &zErrMsg) != SQLITE_OK) {
+    std::cerr << "Failed to configure connection: " << zErrMsg << std::endl;
+    sqlite3_free(zErrMsg);
+    return false;
+  }
+  return true;
+}
+
+ConnectionPool::ReadLease ConnectionPool::acquireReader() {
+  if (pinnedByThisThread()) {
+    return ReadLease(nullptr, &writerConnection);
+  }
+  if (readers.empty()) {
+    // Waits out any other thread's write transaction
+    return ReadLease(nullptr, &writerConnection,
+                     std::unique_lock<std::recursive_mutex>(writerMutex_));
+  }
+  for (const auto &entry : heldReaders) {
+    if (entry.pool == this) {
+      return ReadLease(nullptr, entry.connection);
+    }
+  }
+
+  Connection *connection;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (idle.empty()) {
+      waits++;
+    }
+    available.wait(lock, [this] { return !idle.empty(); });
+    connection = idle.back();
+    idle.pop_back();
+    leases++;
+  }
+  heldReaders.push_back(HeldReader{this, connection});
+  return ReadLease(this, connection);
+}
+
+void ConnectionPool::release(Connection *connection) {
+  heldReaders.erase(std::find_if(
+      heldReaders.begin(), heldReaders.end(),
+      [this](const HeldReader &entry) { return entry.pool == this; }));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    idle.push_back(connection);
+  }
+  available.notify_one();
+}
+
+void ConnectionPool::pinWriter() { pinnedPools.push_back(this); }
+
+void ConnectionPool::unpinWriter() {
+  pinnedPools.erase(
+      std::find(pinnedPools.begin(), pinnedPools.end(), this));
+}
+
+bool ConnectionPool::pinnedByThisThread() const {
+  return std::find(pinnedPools.begin(), pinnedPools.end(), this) !=
+         pinnedPools.end();
+}
+
+StatementStats ConnectionPool::statementStats() const {
+  StatementStats total;
+  auto add = [&total](const Connection &connection) {
+    if (connection.statements) {
+      StatementStats stats = connection.statements->stats();
+      total.hits += stats.hits;
+      total.prepares += stats.prepares;
+    }
+  };
+  add(writerConnection);
+  for (const auto &reader : readers) {
+    add(reader);
+  }
+  return total;
+}
+
+ConnectionPoolStats ConnectionPool::stats() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  ConnectionPoolStats s;
+  s.readers = readers.size();
+  s.leased = readers.size() - idle.size();
+  s.leases = leases;
+  s.waits = waits;
+  return s;
+}
+
+std::vector<std::string> ConnectionPool::preparedSql() const {
+  std::vector<std::string> sql;
+  auto add = [&sql](const Connection &connection) {
+    if (connection.statements) {
+      auto texts = connection.statements->sqlTexts();
+      sql.insert(sql.end(), texts.begin(), texts.end());
+    }
+  };
+  add(writerConnection);
+  for (const auto &reader : readers) {
+    add(reader);
+  }
+  std::sort(sql.begin(), sql.end());
+  sql.erase(std::unique(sql.begin(), sql.end()), sql.end());
+  return sql;
+}
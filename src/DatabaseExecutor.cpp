@@ -0,0 +1,79 @@
+#include "DatabaseExecutor.hpp"
+#include <algorithm>
+
+DatabaseExecutor::DatabaseExecutor(size_t workers, size_t queueCapacity)
+    : queueCapacity(queueCapacity) {
+  threads.reserve(workers);
+  for (size_t i = 0; i < workers; ++i) {
+    threads.emplace_back(&DatabaseExecutor::work, this);
+  }
+}
+
+DatabaseExecutor::~DatabaseExecutor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  available.notify_all();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+bool DatabaseExecutor::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping || threads.empty() || queue.size() >= queueCapacity) {
+      rejected++;
+      return false;
+    }
+    queue.push_back(Task{std::move(task), Clock::now()});
+    submitted++;
+    maxQueueDepth = std::max(maxQueueDepth, queue.size());
+  }
+  available.notify_one();
+  return true;
+}
+
+void DatabaseExecutor::work() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    available.wait(lock, [this] { return stopping || !queue.empty(); });
+    if (queue.empty()) {
+      return; // stopping, and nothing left to run
+    }
+
+    Task task = std::move(queue.front());
+    queue.pop_front();
+    uint64_t waitMicros = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() -
+                                                              task.queuedAt)
+            .count());
+    totalWaitMicros += waitMicros;
+    maxWaitMicros = std::max(maxWaitMicros, waitMicros);
+    busyWorkers++;
+
+    lock.unlock();
+    task.run();
+    lock.lock();
+
+    busyWorkers--;
+    completed++;
+  }
+}
+
+DatabaseExecutorStats DatabaseExecutor::stats() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  DatabaseExecutorStats s;
+  s.workers = threads.size();
+  s.queueCapacity = queueCapacity;
+  s.queueDepth = queue.size();
+  s.maxQueueDepth = maxQueueDepth;
+  s.busyWorkers = busyWorkers;
+  s.submitted = submitted;
+  s.completed = completed;
+  s.rejected = rejected;
+  s.totalWaitMicros = totalWaitMicros;
+  s.maxWaitMicros = maxWaitMicros;
+  return s;
+}
@@ -0,0 +1,143 @@
+#include "FeaturePresenceMatrix.hpp"
+#include <algorithm>
+#include <queue>
+
+namespace {
+
+using StringId = CatalogSnapshot::StringId;
+
+// One firmware's tree as sorted (service path, feature key) entries
+struct FlatTree {
+  struct Entry {
+    uint32_t path; // into paths
+    StringId featureKey;
+  };
+  std::vector<std::vector<StringId>> paths; // one per service node
+  std::vector<Entry> entries;
+};
+
+// Orders paths key by key, a path before the paths below it. Strings are
+// interned, so equal ids are equal keys.
+int comparePaths(const CatalogSnapshot &catalog,
+                 const std::vector<StringId> &a,
+                 const std::vector<StringId> &b) {
+  size_t common = std::min(a.size(), b.size());
+  for (size_t i = 0; i < common; ++i) {
+    if (a[i] != b[i]) {
+      return catalog.string(a[i]) < catalog.string(b[i]) ? -1 : 1;
+    }
+  }
+  if (a.size() == b.size()) {
+    return 0;
+  }
+  return a.size() < b.size() ? -1 : 1;
+}
+
+int compareEntries(const CatalogSnapshot &catalog, const FlatTree &treeA,
+                   const FlatTree::Entry &a, const FlatTree &treeB,
+                   const FlatTree::Entry &b) {
+  int order = comparePaths(catalog, treeA.paths[a.path], treeB.paths[b.path]);
+  if (order != 0 || a.featureKey == b.featureKey) {
+    return order;
+  }
+  return catalog.string(a.featureKey) < catalog.string(b.featureKey) ? -1 : 1;
+}
+
+void flattenNode(const CatalogSnapshot &catalog, int32_t serviceFirmwareId,
+                 std::vector<StringId> &path, FlatTree &tree) {
+  const auto &node = *catalog.node(serviceFirmwareId);
+  path.push_back(node.descriptionKey);
+  auto pathIndex = static_cast<uint32_t>(tree.paths.size());
+  tree.paths.push_back(path);
+  for (const auto &feat : catalog.featuresOf(node)) {
+    tree.entries.push_back({pathIndex, feat.descriptionKey});
+  }
+  for (int32_t childId : catalog.childNodeIdsOf(node)) {
+    flattenNode(catalog, childId, path, tree);
+  }
+  path.pop_back();
+}
+
+FlatTree flatten(const CatalogSnapshot &catalog, int32_t firmwareId) {
+  FlatTree tree;
+  const auto *firmware = catalog.firmware(firmwareId);
+  if (!firmware) {
+    return tree;
+  }
+  std::vector<StringId> path;
+  for (int32_t serviceFirmwareId : catalog.topLevelNodeIdsOf(*firmware)) {
+    flattenNode(catalog, serviceFirmwareId, path, tree);
+  }
+
+  // A key repeated under one path (or sibling services sharing a key) is a
+  // single entry, as in the pairwise comparison
+  auto less = [&](const FlatTree::Entry &a, const FlatTree::Entry &b) {
+    return compareEntries(catalog, tree, a, tree, b) < 0;
+  };
+  auto equal = [&](const FlatTree::Entry &a, const FlatTree::Entry &b) {
+    return compareEntries(catalog, tree, a, tree, b) == 0;
+  };
+  std::sort(tree.entries.begin(), tree.entries.end(), less);
+  tree.entries.erase(
+      std::unique(tree.entries.begin(), tree.entries.end(), equal),
+      tree.entries.end());
+  return tree;
+}
+
+} // namespace
+
+FeaturePresenceMatrix::Result
+FeaturePresenceMatrix::build(const CatalogSnapshot &catalog,
+                             const std::vector<int32_t> &firmwareIds,
+                             ParallelPool &pool, bool includeCommon) {
+  Result result;
+  size_t count = std::min(firmwareIds.size(), MAX_FIRMWARES);
+  std::vector<FlatTree> trees(count);
+  pool.run(count, [&](size_t i) {
+    trees[i] = flatten(catalog, firmwareIds[i]);
+  });
+
+  // k-way merge of the sorted lists; the heap holds the lists that have
+  // entries left, smallest head on top
+  std::vector<size_t> position(count, 0);
+  auto headAfter = [&](size_t a, size_t b) {
+    return compareEntries(catalog, trees[a], trees[a].entries[position[a]],
+                          trees[b], trees[b].entries[position[b]]) > 0;
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(headAfter)> heads(
+      headAfter);
+  for (size_t i = 0; i < count; ++i) {
+    if (!trees[i].entries.empty()) {
+      heads.push(i);
+    }
+  }
+
+  uint64_t everyFirmware =
+      count >= MAX_FIRMWARES ? ~uint64_t{0} : (uint64_t{1} << count) - 1;
+  while (!heads.empty()) {
+    const FlatTree &tree = trees[heads.top()];
+    const FlatTree::Entry &entry = tree.entries[position[heads.top()]];
+    uint64_t presence = 0;
+    while (!heads.empty()) {
+      size_t i = heads.top();
+      if (compareEntries(catalog, trees[i], trees[i].entries[position[i]],
+                         tree, entry) != 0) {
+        break;
+      }
+      heads.pop();
+      presence |= uint64_t{1} << i;
+      if (++position[i] < trees[i].entries.size()) {
+        heads.push(i);
+      }
+    }
+
+    if (presence == everyFirmware) {
+      result.common++;
+      if (!includeCommon) {
+        continue;
+      }
+    }
+    result.rows.push_back({tree.paths[entry.path], entry.featureKey, presence});
+  }
+  return result;
+}
@@ -0,0 +1,66 @@
+#include "LatencyHistogram.hpp"
+#include <algorithm>
+#include <bit>
+
+void LatencyHistogram::record(uint64_t nanos) {
+  total.fetch_add(nanos, std::memory_order_relaxed);
+  buckets[bucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+
+  uint64_t seen = max.load(std::memory_order_relaxed);
+  while (nanos > seen &&
+         !max.compare_exchange_weak(seen, nanos, std::memory_order_relaxed)) {
+  }
+}
+
+int LatencyHistogram::bucketOf(uint64_t nanos) {
+  if (nanos < 2 * SUB_BUCKETS) {
+    return static_cast<int>(nanos);
+  }
+  int shift = std::bit_width(nanos) - 1 - SUB_BUCKET_BITS;
+  return (shift + 1) * SUB_BUCKETS +
+         static_cast<int>((nanos >> shift) & (SUB_BUCKETS - 1));
+}
+
+uint64_t LatencyHistogram::bucketMidpoint(int bucket) {
+  if (bucket < 2 * SUB_BUCKETS) {
+    return static_cast<uint64_t>(bucket);
+  }
+  int shift = bucket / SUB_BUCKETS - 1;
+  uint64_t lower = static_cast<uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS)
+                   << shift;
+  return lower + ((uint64_t{1} << shift) >> 1);
+}
+
+LatencySummary LatencyHistogram::summary() const {
+  std::array<uint64_t, BUCKETS> counts;
+  uint64_t n = 0;
+  for (int i = 0; i < BUCKETS; ++i) {
+    counts[i] = buckets[i].load(std::memory_order_relaxed);
+    n += counts[i];
+  }
+
+  LatencySummary s;
+  s.count = n;
+  s.totalNanos = total.load(std::memory_order_relaxed);
+  s.maxNanos = max.load(std::memory_order_relaxed);
+  if (n == 0) {
+    return s;
+  }
+
+  // Smallest bucket holding at least the given share of the events
+  auto percentile = [&](uint64_t perMille) {
+    uint64_t rank = std::max<uint64_t>(1, (n * perMille + 999) / 1000);
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+      seen += counts[i];
+      if (seen >= rank) {
+        return std::min(bucketMidpoint(i), s.maxNanos);
+      }
+    }
+    return s.maxNanos;
+  };
+  s.p50Nanos = percentile(500);
+  s.p90Nanos = percentile(900);
+  s.p99Nanos = percentile(990);
+  return s;
+}
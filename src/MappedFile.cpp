@@ -0,0 +1,83 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string &path) {
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return nullptr;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    CloseHandle(file);
+    return nullptr;
+  }
+  // The mapping keeps its own reference to the file
+  HANDLE mapping =
+      CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (!mapping) {
+    return nullptr;
+  }
+  void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!view) {
+    CloseHandle(mapping);
+    return nullptr;
+  }
+
+  std::unique_ptr<MappedFile> mapped(new MappedFile());
+  mapped->bytes = static_cast<const char *>(view);
+  mapped->length = static_cast<size_t>(size.QuadPart);
+  mapped->mapping = mapping;
+  return mapped;
+}
+
+MappedFile::~MappedFile() {
+  UnmapViewOfFile(bytes);
+  CloseHandle(mapping);
+}
+
+#else
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    return nullptr;
+  }
+  // The mapping keeps its own reference to the file
+  void *view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ,
+                    MAP_SHARED, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED) {
+    return nullptr;
+  }
+
+  std::unique_ptr<MappedFile> mapped(new MappedFile());
+  mapped->bytes = static_cast<const char *>(view);
+  mapped->length = static_cast<size_t>(info.st_size);
+  return mapped;
+}
+
+MappedFile::~MappedFile() {
+  munmap(const_cast<char *>(bytes), length);
+}
+
+#endif
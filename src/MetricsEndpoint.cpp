@@ -0,0 +1,190 @@
+#include "MetricsEndpoint.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string_view>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+using Socket = SOCKET;
+constexpr int SHUTDOWN_BOTH = SD_BOTH;
+void closeSocket(Socket s) { closesocket(s); }
+#else
+using Socket = int;
+constexpr int SHUTDOWN_BOTH = SHUT_RDWR;
+void closeSocket(Socket s) { close(s); }
+#endif
+
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL; // a closed peer must not SIGPIPE
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+constexpr intptr_t NO_SOCKET = -1;
+constexpr size_t MAX_REQUEST_BYTES = 8192;
+constexpr int CLIENT_TIMEOUT_SECONDS = 2;
+
+Socket socketOf(intptr_t handle) { return static_cast<Socket>(handle); }
+
+void setTimeouts(Socket s) {
+#ifdef _WIN32
+  DWORD timeout = CLIENT_TIMEOUT_SECONDS * 1000;
+#else
+  timeval timeout{CLIENT_TIMEOUT_SECONDS, 0};
+#endif
+  const char *value = reinterpret_cast<const char *>(&timeout);
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, value, sizeof(timeout));
+  setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, value, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+  int one = 1;
+  setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}
+
+bool sendAll(Socket s, const std::string &data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    size_t chunk = std::min<size_t>(data.size() - sent, 1 << 20);
+    int n = send(s, data.data() + sent, static_cast<int>(chunk), SEND_FLAGS);
+    if (n <= 0) {
+      return false;
+    }
+    sent += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+std::string httpResponse(const char *status, const char *contentType,
+                         const std::string &body) {
+  return std::string("HTTP/1.0 ") + status + "\r\nContent-Type: " +
+         contentType + "\r\nContent-Length: " + std::to_string(body.size()) +
+         "\r\nConnection: close\r\n\r\n" + body;
+}
+
+} // namespace
+
+MetricsEndpoint::MetricsEndpoint(uint16_t port,
+                                 std::function<std::string()> render)
+    : port(port), render(std::move(render)) {}
+
+MetricsEndpoint::~MetricsEndpoint() {
+  stopping = true;
+  if (listener != NO_SOCKET) {
+    // Wakes the thread blocked in accept()
+    shutdown(socketOf(listener), SHUTDOWN_BOTH);
+    closeSocket(socketOf(listener));
+  }
+  if (thread.joinable()) {
+    thread.join();
+  }
+#ifdef _WIN32
+  if (listener != NO_SOCKET) {
+    WSACleanup();
+  }
+#endif
+}
+
+bool MetricsEndpoint::start() {
+#ifdef _WIN32
+  WSADATA data;
+  if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+    std::cerr << "Metrics endpoint: failed to initialize Winsock"
+              << std::endl;
+    return false;
+  }
+#endif
+  Socket s = socket(AF_INET, SOCK_STREAM, 0);
+  if (static_cast<intptr_t>(s) == NO_SOCKET) {
+    std::cerr << "Metrics endpoint: failed to create a socket" << std::endl;
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return false;
+  }
+  int one = 1;
+  setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&one),
+             sizeof(one));
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(s, reinterpret_cast<const sockaddr *>(&address),
+           sizeof(address)) != 0 ||
+      listen(s, 16) != 0) {
+    std::cerr << "Metrics endpoint: cannot listen on 127.0.0.1:" << port
+              << std::endl;
+    closeSocket(s);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return false;
+  }
+
+  listener = static_cast<intptr_t>(s);
+  thread = std::thread(&MetricsEndpoint::serve, this);
+  std::cout << "Metrics endpoint listening on http://127.0.0.1:" << port
+            << "/metrics" << std::endl;
+  return true;
+}
+
+void MetricsEndpoint::serve() {
+  while (!stopping) {
+    Socket client = accept(socketOf(listener), nullptr, nullptr);
+    if (static_cast<intptr_t>(client) == NO_SOCKET) {
+      if (!stopping) {
+        // Out of descriptors, most likely; give the process a moment
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      }
+      continue;
+    }
+    setTimeouts(client);
+    respond(static_cast<intptr_t>(client));
+    closeSocket(client);
+  }
+}
+
+void MetricsEndpoint::respond(intptr_t client) {
+  Socket s = socketOf(client);
+
+  // Only the request line matters; read up to the end of the headers
+  std::string request;
+  char buffer[1024];
+  while (request.find("\r\n\r\n") == std::string::npos &&
+         request.size() < MAX_REQUEST_BYTES) {
+    int n = recv(s, buffer, sizeof(buffer), 0);
+    if (n <= 0) {
+      break;
+    }
+    request.append(buffer, static_cast<size_t>(n));
+  }
+
+  std::string_view line(request);
+  line = line.substr(0, line.find("\r\n"));
+  std::string_view path;
+  if (line.substr(0, 4) == "GET ") {
+    path = line.substr(4);
+    path = path.substr(0, path.find_first_of(" ?"));
+  }
+
+  if (path == "/metrics") {
+    sendAll(s, httpResponse("200 OK",
+                            "text/plain; version=0.0.4; charset=utf-8",
+                            render()));
+  } else {
+    sendAll(s, httpResponse("404 Not Found", "text/plain", "Not found\n"));
+  }
+}
@@ -0,0 +1,75 @@
+#include "ParallelPool.hpp"
+#include <algorithm>
+
+ParallelPool::ParallelPool(size_t helpers) {
+  threads.reserve(helpers);
+  for (size_t i = 0; i < helpers; ++i) {
+    threads.emplace_back(&ParallelPool::work, this);
+  }
+}
+
+ParallelPool::~ParallelPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  available.notify_all();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+void ParallelPool::drain(Batch &batch) {
+  for (size_t i = batch.next++; i < batch.count; i = batch.next++) {
+    batch.task(i);
+  }
+}
+
+void ParallelPool::run(size_t count,
+                       const std::function<void(size_t)> &task) {
+  Batch batch{task, count};
+  if (count < 2 || threads.empty()) {
+    drain(batch);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back(&batch);
+  }
+  available.notify_all();
+  drain(batch);
+
+  // Every task has been started; withdraw the batch so no helper joins it
+  // late, and wait for the ones still running theirs
+  std::unique_lock<std::mutex> lock(mutex);
+  auto queued = std::find(queue.begin(), queue.end(), &batch);
+  if (queued != queue.end()) {
+    queue.erase(queued);
+  }
+  finished.wait(lock, [&batch] { return batch.active == 0; });
+}
+
+void ParallelPool::work() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    available.wait(lock, [this] { return stopping || !queue.empty(); });
+    if (queue.empty()) {
+      return; // stopping
+    }
+
+    // The caller works on its own batch, so count - 1 helpers are enough
+    Batch *batch = queue.front();
+    if (++batch->active >= batch->count - 1) {
+      queue.pop_front();
+    }
+
+    lock.unlock();
+    drain(*batch);
+    lock.lock();
+
+    if (--batch->active == 0) {
+      finished.notify_all();
+    }
+  }
+}
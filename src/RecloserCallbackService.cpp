@@ -0,0 +1,291 @@
+#include "RecloserCallbackService.hpp"
+#include <iostream>
+
+namespace recloser {
+
+namespace {
+
+grpc::Status executorFull() {
+  return grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                      "Database executor queue is full");
+}
+
+// Streams the inventory one message at a time: each message is built on the
+// executor, and the next one is only built once the previous write is done,
+// so a slow client holds no more than one firmware tree in memory
+class InventoryStreamReactor : public grpc::ServerWriteReactor<InventoryChunk> {
+public:
+  InventoryStreamReactor(RecloserServiceImpl *handlers,
+                         DatabaseExecutor *executor,
+                         const FullInventoryRequest &request)
+      : handlers(handlers), executor(executor),
+        cursor(handlers->startInventory(request)) {
+    next();
+  }
+
+  void OnWriteDone(bool ok) override {
+    if (!ok) {
+      Finish(grpc::Status(grpc::StatusCode::CANCELLED,
+                          "Inventory stream cancelled"));
+      return;
+    }
+    next();
+  }
+
+  void OnDone() override { delete this; }
+
+private:
+  void next() {
+    bool queued = executor->submit([this] {
+      chunk.Clear();
+      if (handlers->nextInventoryChunk(cursor, &chunk)) {
+        StartWrite(&chunk);
+      } else {
+        Finish(grpc::Status::OK);
+      }
+    });
+    if (!queued) {
+      Finish(executorFull());
+    }
+  }
+
+  RecloserServiceImpl *handlers;
+  DatabaseExecutor *executor;
+  InventoryCursor cursor;
+  InventoryChunk chunk;
+};
+
+} // namespace
+
+RecloserCallbackService::RecloserCallbackService(RecloserServiceImpl *handlers,
+                                                 DatabaseExecutor *executor)
+    : handlers_(handlers), executor_(executor) {}
+
+template <typename Request, typename Response>
+grpc::ServerUnaryReactor *RecloserCallbackService::dispatch(
+    grpc::CallbackServerContext *context,
+    grpc::Status (RecloserServiceImpl::*handler)(grpc::ServerContext *,
+                                                 const Request *, Response *),
+    const Request *request, Response *response) {
+  grpc::ServerUnaryReactor *reactor = context->DefaultReactor();
+
+  // The unary handlers never look at their ServerContext, which only the
+  // sync API can provide
+  bool queued = executor_->submit(
+      [this, context, reactor, handler, request, response] {
+        if (context->IsCancelled()) {
+          reactor->Finish(grpc::Status::CANCELLED);
+          return;
+        }
+        reactor->Finish((handlers_->*handler)(nullptr, request, response));
+      });
+  if (!queued) {
+    std::cerr << "Rejecting call: database executor queue is full"
+              << std::endl;
+    reactor->Finish(executorFull());
+  }
+  return reactor;
+}
+
+grpc::ServerUnaryReactor *RecloserCallbackService::dispatchRawRead(
+    grpc::CallbackServerContext *context, RawRead method,
+    const grpc::ByteBuffer *request, grpc::ByteBuffer *response) {
+  grpc::ServerUnaryReactor *reactor = context->DefaultReactor();
+
+  // A hit is only a lookup, so it is answered right here
+  std::string key = RecloserServiceImpl::rawReadKey(method, *request);
+  if (handlers_->findCachedRead(key, response)) {
+    reactor->Finish(grpc::Status::OK);
+    return reactor;
+  }
+
+  bool queued = executor_->submit(
+      [this, context, reactor, key = std::move(key), response] {
+        if (context->IsCancelled()) {
+          reactor->Finish(grpc::Status::CANCELLED);
+          return;
+        }
+        reactor->Finish(handlers_->buildRawRead(key, response));
+      });
+  if (!queued) {
+    std::cerr << "Rejecting call: database executor queue is full"
+              << std::endl;
+    reactor->Finish(executorFull());
+  }
+  return reactor;
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::GetServiceTree(grpc::CallbackServerContext *context,
+                                        const grpc::ByteBuffer *request,
+                                        grpc::ByteBuffer *response) {
+  return dispatchRawRead(context, RawRead::SERVICE_TREE, request, response);
+}
+
+grpc::ServerUnaryReactor *RecloserCallbackService::CompareServiceTrees(
+    grpc::CallbackServerContext *context,
+    const CompareServiceTreesRequest *request,
+    CompareServiceTreesResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::CompareServiceTrees, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *RecloserCallbackService::CompareFirmwareSet(
+    grpc::CallbackServerContext *context,
+    const CompareFirmwareSetRequest *request,
+    CompareFirmwareSetResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::CompareFirmwareSet, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::GetScreenLayout(grpc::CallbackServerContext *context,
+                                         const grpc::ByteBuffer *request,
+                                         grpc::ByteBuffer *response) {
+  return dispatchRawRead(context, RawRead::SCREEN_LAYOUT, request, response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::GetFullInventory(grpc::CallbackServerContext *context,
+                                          const grpc::ByteBuffer *request,
+                                          grpc::ByteBuffer *response) {
+  return dispatchRawRead(context, RawRead::FULL_INVENTORY, request, response);
+}
+
+grpc::ServerWriteReactor<InventoryChunk> *
+RecloserCallbackService::StreamFullInventory(
+    grpc::CallbackServerContext *context, const FullInventoryRequest *request) {
+  std::cout << "StreamFullInventory called" << std::endl;
+  return new InventoryStreamReactor(handlers_, executor_, *request);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::SearchCatalog(grpc::CallbackServerContext *context,
+                                       const SearchCatalogRequest *request,
+                                       SearchCatalogResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::SearchCatalog, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::CreateRecloser(grpc::CallbackServerContext *context,
+                                        const RecloserRecord *request,
+                                        GenericResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::CreateRecloser, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::UpdateRecloser(grpc::CallbackServerContext *context,
+                                        const RecloserRecord *request,
+                                        GenericResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::UpdateRecloser, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::DeleteRecloser(grpc::CallbackServerContext *context,
+                                        const DeleteRequest *request,
+                                        GenericResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::DeleteRecloser, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::CreateFirmware(grpc::CallbackServerContext *context,
+                                        const FirmwareRecord *request,
+                                        GenericResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::CreateFirmware, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::UpdateFirmware(grpc::CallbackServerContext *context,
+                                        const FirmwareRecord *request,
+                                        GenericResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::UpdateFirmware, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::DeleteFirmware(grpc::CallbackServerContext *context,
+                                        const DeleteRequest *request,
+                                        GenericResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::DeleteFirmware, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::CloneFirmware(grpc::CallbackServerContext *context,
+                                       const CloneFirmwareRequest *request,
+                                       CloneFirmwareResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::CloneFirmware, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::AddServiceNode(grpc::CallbackServerContext *context,
+                                        const ServiceRecord *request,
+                                        GenericResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::AddServiceNode, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::UpdateServiceNode(grpc::CallbackServerContext *context,
+                                           const ServiceRecord *request,
+                                           GenericResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::UpdateServiceNode, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::DeleteServiceNode(grpc::CallbackServerContext *context,
+                                           const DeleteRequest *request,
+                                           GenericResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::DeleteServiceNode, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::CreateFeature(grpc::CallbackServerContext *context,
+                                       const FeatureRecord *request,
+                                       GenericResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::CreateFeature, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::UpdateFeature(grpc::CallbackServerContext *context,
+                                       const FeatureRecord *request,
+                                       GenericResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::UpdateFeature, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::DeleteFeature(grpc::CallbackServerContext *context,
+                                       const DeleteRequest *request,
+                                       GenericResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::DeleteFeature, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::ApplyChangeSet(grpc::CallbackServerContext *context,
+                                        const ChangeSetRequest *request,
+                                        ChangeSetResponse *response) {
+  return dispatch(context, &RecloserServiceImpl::ApplyChangeSet, request,
+                  response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserCallbackService::GetServerStats(grpc::CallbackServerContext *context,
+                                        const ServerStatsRequest *request,
+                                        ServerStatsResponse *response) {
+  grpc::ServerUnaryReactor *reactor = context->DefaultReactor();
+  reactor->Finish(handlers_->GetServerStats(nullptr, request, response));
+  return reactor;
+}
+
+} // namespace recloser
@@ -1,26 +1,56 @@
 #include "RecloserManager.hpp"
+#include "CatalogSearch.hpp"
 #include "DatabaseSchema.hpp"
+#include "ScreenLayoutEngine.hpp"
 #include <iostream>
 
-RecloserManager::RecloserManager(const std::string &dbPath)
-    : dbPath(dbPath), db(nullptr) {}
+RecloserManager::RecloserManager(const std::string &dbPath,
+                                 size_t readConnections,
+                                 ConnectionProfile profile)
+    : dbPath(dbPath),
+      connections(std::make_unique<ConnectionPool>(dbPath, readConnections,
+                                                   std::move(profile))),
+      db(nullptr), statements(nullptr),
+      writeMutex(connections->writerMutex()) {}
 
 RecloserManager::~RecloserManager() {
-  if (db) {
-    sqlite3_close(db);
-  }
+  // These lease pooled connections, so they go before the pool
+  layoutEngine.reset();
+  search.reset();
+  connections.reset();
 }
 
 bool RecloserManager::initialize() {
-  int rc = sqlite3_open(dbPath.c_str(), &db);
-  if (rc != SQLITE_OK) {
-    std::cerr << "Cannot open database: " << sqlite3_errmsg(db) << std::endl;
+  // WAL mode, foreign keys and the profile pragmas are set by the pool
+  if (!connections->open()) {
+    return false;
+  }
+  db = connections->writer();
+  statements = &connections->writerStatements();
+  layoutEngine =
+      std::make_unique<ScreenLayoutEngine>(*connections, translations);
+  search = std::make_unique<CatalogSearch>(*connections);
+
+  if (!runSchema()) {
     return false;
   }
-  // Enable foreign keys
-  sqlite3_exec(db, "PRAGMA foreign_keys = ON;", nullptr, nullptr, nullptr);
+  return translations.load(*statements);
+}
+
+StatementStats RecloserManager::statementStats() const {
+  return connections->statementStats();
+}
 
-  return runSchema();
+std::vector<std::string> RecloserManager::preparedSql() const {
+  return connections->preparedSql();
+}
+
+std::vector<StatementTiming> RecloserManager::statementTimings() const {
+  return connections->statementTimings();
+}
+
+ConnectionPoolStats RecloserManager::connectionPoolStats() const {
+  return connections->stats();
 }
 
 bool RecloserManager::migrate() {
@@ -51,15 +81,11 @@ bool RecloserManager::migrate() {
 }
 
 int RecloserManager::getCurrentVersion() {
-  const char *sql = "SELECT MAX(version) FROM Migrations;";
-  sqlite3_stmt *stmt;
+  auto stmt = statements->acquire("SELECT MAX(version) FROM Migrations;");
   int version = 0;
 
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-      version = sqlite3_column_int(stmt, 0);
-    }
-    sqlite3_finalize(stmt);
+  if (stmt && sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    version = sqlite3_column_int(stmt.get(), 0);
   }
   return version;
 }
@@ -80,394 +106,633 @@ bool RecloserManager::runSchema() {
 
 bool RecloserManager::addLanguage(const std::string &code,
                                   const std::string &name) {
-  const char *sql =
-      "INSERT OR IGNORE INTO Languages (code, name) VALUES (?, ?);";
-  sqlite3_stmt *stmt;
-  sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-  sqlite3_bind_text(stmt, 1, code.c_str(), -1, SQLITE_TRANSIENT);
-  sqlite3_bind_text(stmt, 2, name.c_str(), -1, SQLITE_TRANSIENT);
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt = statements->acquire(
+      "INSERT OR IGNORE INTO Languages (code, name) VALUES (?, ?);");
+  if (!stmt)
+    return false;
+
+  sqlite3_bind_text(stmt.get(), 1, code.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_text(stmt.get(), 2, name.c_str(), -1, SQLITE_TRANSIENT);
 
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  return rc == SQLITE_DONE;
+  return sqlite3_step(stmt.get()) == SQLITE_DONE;
 }
 
 bool RecloserManager::addDescriptionKey(const std::string &key) {
-  const char *sql = "INSERT OR IGNORE INTO Descriptions (key) VALUES (?);";
-  sqlite3_stmt *stmt;
-  sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-  sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt =
+      statements->acquire("INSERT OR IGNORE INTO Descriptions (key) VALUES (?);");
+  if (!stmt)
+    return false;
+
+  sqlite3_bind_text(stmt.get(), 1, key.c_str(), -1, SQLITE_TRANSIENT);
 
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  return rc == SQLITE_DONE;
+  return sqlite3_step(stmt.get()) == SQLITE_DONE;
 }
 
 bool RecloserManager::addTranslation(const std::string &key,
                                      const std::string &langCode,
                                      const std::string &value) {
-  const char *sql = "INSERT OR REPLACE INTO Translations (description_key, "
-                    "language_code, value) VALUES (?, ?, ?);";
-  sqlite3_stmt *stmt;
-  sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-  sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
-  sqlite3_bind_text(stmt, 2, langCode.c_str(), -1, SQLITE_TRANSIENT);
-  sqlite3_bind_text(stmt, 3, value.c_str(), -1, SQLITE_TRANSIENT);
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  // An upsert rather than INSERT OR REPLACE, whose implicit delete would
+  // skip the search index triggers
+  auto stmt = statements->acquire(
+      "INSERT INTO Translations (description_key, language_code, value) "
+      "VALUES (?, ?, ?) ON CONFLICT (description_key, language_code) DO "
+      "UPDATE SET value = excluded.value;");
+  if (!stmt)
+    return false;
+
+  sqlite3_bind_text(stmt.get(), 1, key.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_text(stmt.get(), 2, langCode.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_text(stmt.get(), 3, value.c_str(), -1, SQLITE_TRANSIENT);
 
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  return rc == SQLITE_DONE;
+  if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+    return false;
+  }
+  if (transactionDepth > 0) {
+    stagedTranslations.push_back({key, langCode, value});
+  } else {
+    translations.upsert(key, langCode, value);
+  }
+  return true;
 }
 
 bool RecloserManager::addKeyWithTranslations(
     const std::string &key,
     const std::vector<std::pair<std::string, std::string>> &translations) {
+  Transaction transaction(*this);
   if (!addDescriptionKey(key)) {
     return false;
   }
 
-  bool success = true;
   for (const auto &t : translations) {
     if (!addTranslation(key, t.first, t.second)) {
-      success = false;
+      return false;
     }
   }
-  return success;
+  return transaction.commit();
 }
 
 std::string RecloserManager::getTranslation(const std::string &key,
                                             const std::string &langCode) {
-  const char *sql = "SELECT value FROM Translations WHERE description_key = ? "
-                    "AND language_code = ?;";
-  sqlite3_stmt *stmt;
-  std::string result = "";
-
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, langCode.c_str(), -1, SQLITE_TRANSIENT);
-
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-      result = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
-    }
-  }
-  sqlite3_finalize(stmt);
-  return result;
+  return translations.lookup(key, langCode);
 }
 
 std::vector<TranslationRecord>
 RecloserManager::getTranslationsForKey(const std::string &key) {
-  std::vector<TranslationRecord> results;
-  const char *sql = "SELECT description_key, language_code, value FROM "
-                    "Translations WHERE description_key = ?;";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-      TranslationRecord rec;
-      rec.description_key =
-          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
-      rec.language_code =
-          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
-      rec.value = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
-      results.push_back(rec);
-    }
-  }
-  sqlite3_finalize(stmt);
-  return results;
+  return translations.lookup(key);
 }
 
-bool RecloserManager::addRecloser(const std::string &key) {
-  const char *sql = "INSERT INTO Reclosers (description_key) VALUES (?);";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
-    return false;
+std::vector<std::vector<TranslationRecord>>
+RecloserManager::resolveTranslations(const std::vector<std::string> &keys) {
+  return translations.resolve(keys);
+}
+
+int RecloserManager::addRecloser(const std::string &key) {
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt =
+      statements->acquire("INSERT INTO Reclosers (description_key) VALUES (?);");
+  if (!stmt)
+    return 0;
 
-  sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_text(stmt.get(), 1, key.c_str(), -1, SQLITE_TRANSIENT);
 
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  return rc == SQLITE_DONE;
+  if (sqlite3_step(stmt.get()) == SQLITE_DONE) {
+    return static_cast<int>(sqlite3_last_insert_rowid(db));
+  }
+  return 0;
 }
 
 bool RecloserManager::updateRecloser(int id, const std::string &key) {
-  const char *sql = "UPDATE Reclosers SET description_key = ? WHERE id = ?;";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt = statements->acquire(
+      "UPDATE Reclosers SET description_key = ? WHERE id = ?;");
+  if (!stmt)
     return false;
 
-  sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
-  sqlite3_bind_int(stmt, 2, id);
+  sqlite3_bind_text(stmt.get(), 1, key.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int(stmt.get(), 2, id);
 
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  return rc == SQLITE_DONE;
+  return sqlite3_step(stmt.get()) == SQLITE_DONE;
 }
 
 bool RecloserManager::deleteRecloser(int id) {
-  const char *sql = "DELETE FROM Reclosers WHERE id = ?;";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt = statements->acquire("DELETE FROM Reclosers WHERE id = ?;");
+  if (!stmt)
     return false;
 
-  sqlite3_bind_int(stmt, 1, id);
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  return rc == SQLITE_DONE;
+  sqlite3_bind_int(stmt.get(), 1, id);
+  return sqlite3_step(stmt.get()) == SQLITE_DONE;
 }
 
 std::vector<RecloserRecord> RecloserManager::getAllReclosers() {
   std::vector<RecloserRecord> records;
-  const char *sql = "SELECT id, description_key FROM Reclosers;";
-  sqlite3_stmt *stmt;
+  auto lease = connections->acquireReader();
+  auto stmt = lease.statements().acquire(
+      "SELECT id, description_key FROM Reclosers;");
 
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
+  if (stmt) {
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
       RecloserRecord rec;
-      rec.id = sqlite3_column_int(stmt, 0);
+      rec.id = sqlite3_column_int(stmt.get(), 0);
       rec.description_key =
-          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
       records.push_back(rec);
     }
   }
-  sqlite3_finalize(stmt);
   return records;
 }
 
 std::optional<RecloserRecord> RecloserManager::getRecloserById(int id) {
-  const char *sql = "SELECT id, description_key FROM Reclosers WHERE id = ?;";
-  sqlite3_stmt *stmt;
+  auto lease = connections->acquireReader();
+  auto stmt = lease.statements().acquire(
+      "SELECT id, description_key FROM Reclosers WHERE id = ?;");
   std::optional<RecloserRecord> result = std::nullopt;
 
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-    sqlite3_bind_int(stmt, 1, id);
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
+  if (stmt) {
+    sqlite3_bind_int(stmt.get(), 1, id);
+    if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
       RecloserRecord rec;
-      rec.id = sqlite3_column_int(stmt, 0);
+      rec.id = sqlite3_column_int(stmt.get(), 0);
       rec.description_key =
-          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
       result = rec;
     }
   }
-  sqlite3_finalize(stmt);
   return result;
 }
 
-bool RecloserManager::addFirmwareVersion(const std::string &version,
-                                         int recloserId) {
-  const char *sql =
-      "INSERT INTO FirmwareVersions (version, recloser_id) VALUES (?, ?);";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
-    return false;
+int RecloserManager::addFirmwareVersion(const std::string &version,
+                                        int recloserId) {
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt = statements->acquire(
+      "INSERT INTO FirmwareVersions (version, recloser_id) VALUES (?, ?);");
+  if (!stmt)
+    return 0;
 
-  sqlite3_bind_text(stmt, 1, version.c_str(), -1, SQLITE_TRANSIENT);
-  sqlite3_bind_int(stmt, 2, recloserId);
+  sqlite3_bind_text(stmt.get(), 1, version.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int(stmt.get(), 2, recloserId);
 
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  return rc == SQLITE_DONE;
+  if (sqlite3_step(stmt.get()) == SQLITE_DONE) {
+    return static_cast<int>(sqlite3_last_insert_rowid(db));
+  }
+  return 0;
 }
 
 bool RecloserManager::updateFirmwareVersion(int id, const std::string &version,
                                             int recloserId) {
-  const char *sql =
-      "UPDATE FirmwareVersions SET version = ?, recloser_id = ? WHERE id = ?;";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt = statements->acquire(
+      "UPDATE FirmwareVersions SET version = ?, recloser_id = ? WHERE id = ?;");
+  if (!stmt)
     return false;
 
-  sqlite3_bind_text(stmt, 1, version.c_str(), -1, SQLITE_TRANSIENT);
-  sqlite3_bind_int(stmt, 2, recloserId);
-  sqlite3_bind_int(stmt, 3, id);
+  sqlite3_bind_text(stmt.get(), 1, version.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int(stmt.get(), 2, recloserId);
+  sqlite3_bind_int(stmt.get(), 3, id);
 
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  return rc == SQLITE_DONE;
+  return sqlite3_step(stmt.get()) == SQLITE_DONE;
 }
 
 bool RecloserManager::deleteFirmwareVersion(int id) {
-  const char *sql = "DELETE FROM FirmwareVersions WHERE id = ?;";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt = statements->acquire("DELETE FROM FirmwareVersions WHERE id = ?;");
+  if (!stmt)
     return false;
 
-  sqlite3_bind_int(stmt, 1, id);
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  return rc == SQLITE_DONE;
+  sqlite3_bind_int(stmt.get(), 1, id);
+  return sqlite3_step(stmt.get()) == SQLITE_DONE;
 }
 
 std::vector<FirmwareVersionRecord>
 RecloserManager::getFirmwareVersionsForRecloser(int recloserId) {
   std::vector<FirmwareVersionRecord> records;
-  const char *sql = "SELECT id, version, recloser_id FROM FirmwareVersions "
-                    "WHERE recloser_id = ?;";
-  sqlite3_stmt *stmt;
-
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-    sqlite3_bind_int(stmt, 1, recloserId);
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
+  auto lease = connections->acquireReader();
+  auto stmt = lease.statements().acquire(
+      "SELECT id, version, recloser_id FROM "
+      "FirmwareVersions WHERE recloser_id = ?;");
+
+  if (stmt) {
+    sqlite3_bind_int(stmt.get(), 1, recloserId);
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
       FirmwareVersionRecord rec;
-      rec.id = sqlite3_column_int(stmt, 0);
+      rec.id = sqlite3_column_int(stmt.get(), 0);
       rec.version =
-          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
-      rec.recloser_id = sqlite3_column_int(stmt, 2);
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
+      rec.recloser_id = sqlite3_column_int(stmt.get(), 2);
       records.push_back(rec);
     }
   }
-  sqlite3_finalize(stmt);
   return records;
 }
 
 std::optional<FirmwareVersionRecord>
 RecloserManager::getFirmwareVersionById(int id) {
-  const char *sql =
-      "SELECT id, version, recloser_id FROM FirmwareVersions WHERE id = ?;";
-  sqlite3_stmt *stmt;
+  auto lease = connections->acquireReader();
+  auto stmt = lease.statements().acquire(
+      "SELECT id, version, recloser_id FROM FirmwareVersions WHERE id = ?;");
   std::optional<FirmwareVersionRecord> result = std::nullopt;
 
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-    sqlite3_bind_int(stmt, 1, id);
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
+  if (stmt) {
+    sqlite3_bind_int(stmt.get(), 1, id);
+    if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
       FirmwareVersionRecord rec;
-      rec.id = sqlite3_column_int(stmt, 0);
+      rec.id = sqlite3_column_int(stmt.get(), 0);
       rec.version =
-          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
-      rec.recloser_id = sqlite3_column_int(stmt, 2);
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
+      rec.recloser_id = sqlite3_column_int(stmt.get(), 2);
       result = rec;
     }
   }
-  sqlite3_finalize(stmt);
   return result;
 }
 
+FirmwareCloneRecord RecloserManager::cloneFirmware(int sourceFirmwareId,
+                                                   const std::string &version,
+                                                   int recloserId) {
+  FirmwareCloneRecord clone;
+  Transaction transaction(*this);
+  if (!transaction.active()) {
+    return clone;
+  }
+
+  // Runs a statement to completion and returns the rows it changed, or -1
+  auto run = [this](StatementCache::CachedStatement &stmt) {
+    if (!stmt || sqlite3_step(stmt.get()) != SQLITE_DONE) {
+      std::cerr << "Clone statement failed: " << sqlite3_errmsg(db)
+                << std::endl;
+      return -1;
+    }
+    return sqlite3_changes(db);
+  };
+  // Ids are handed out past both the highest id and the AUTOINCREMENT
+  // sequence, so rows deleted earlier never have their ids reused
+  auto nextIdBase = [this](const std::string &table) {
+    auto stmt = statements->acquire(
+        "SELECT MAX(IFNULL((SELECT seq FROM sqlite_sequence WHERE name = '" +
+        table + "'), 0), IFNULL((SELECT MAX(id) FROM " + table + "), 0));");
+    return stmt && sqlite3_step(stmt.get()) == SQLITE_ROW
+               ? sqlite3_column_int64(stmt.get(), 0)
+               : -1;
+  };
+
+  // Old to new id maps for the rows children refer to. Services are shared
+  // between firmwares, so new ServiceFirmware rows are found through their
+  // (service_id, firmware_id) key instead. The CROSS JOINs below make SQLite
+  // walk a map and look children up by index, rather than scan the whole
+  // child table, which also holds every other firmware's rows.
+  std::string prepareMaps = Schema::CLONE_MAPS_SQL +
+                           "DELETE FROM temp.CloneFeatureMap;"
+                           "DELETE FROM temp.CloneComponentMap;";
+  if (sqlite3_exec(db, prepareMaps.c_str(), nullptr, nullptr, nullptr) !=
+      SQLITE_OK) {
+    std::cerr << "Failed to prepare clone maps: " << sqlite3_errmsg(db)
+              << std::endl;
+    return clone;
+  }
+
+  auto firmware = statements->acquire(
+      "INSERT INTO FirmwareVersions (version, recloser_id) SELECT ?, CASE "
+      "WHEN ? > 0 THEN ? ELSE recloser_id END FROM FirmwareVersions "
+      "WHERE id = ?;");
+  if (firmware) {
+    sqlite3_bind_text(firmware.get(), 1, version.c_str(), -1,
+                      SQLITE_TRANSIENT);
+    sqlite3_bind_int(firmware.get(), 2, recloserId);
+    sqlite3_bind_int(firmware.get(), 3, recloserId);
+    sqlite3_bind_int(firmware.get(), 4, sourceFirmwareId);
+  }
+  if (run(firmware) != 1) {
+    return clone; // no such source firmware
+  }
+  int firmwareId = static_cast<int>(sqlite3_last_insert_rowid(db));
+
+  auto services = statements->acquire(
+      "INSERT INTO ServiceFirmware (service_id, firmware_id) SELECT "
+      "service_id, ? FROM ServiceFirmware WHERE firmware_id = ? ORDER BY id;");
+  if (services) {
+    sqlite3_bind_int(services.get(), 1, firmwareId);
+    sqlite3_bind_int(services.get(), 2, sourceFirmwareId);
+  }
+  int serviceCount = run(services);
+  if (serviceCount < 0) {
+    return clone;
+  }
+
+  // New ids follow the old id order, so every child list keeps its order
+  int64_t featureBase = nextIdBase("Features");
+  auto featureMap = statements->acquire(
+      "INSERT INTO temp.CloneFeatureMap (old_id, new_id) SELECT f.id, ? + "
+      "ROW_NUMBER() OVER (ORDER BY f.id) FROM Features f JOIN "
+      "ServiceFirmware sf ON sf.id = f.service_firmware_id "
+      "WHERE sf.firmware_id = ?;");
+  if (featureMap) {
+    sqlite3_bind_int64(featureMap.get(), 1, featureBase);
+    sqlite3_bind_int(featureMap.get(), 2, sourceFirmwareId);
+  }
+  if (featureBase < 0 || run(featureMap) < 0) {
+    return clone;
+  }
+
+  auto features = statements->acquire(
+      "INSERT INTO Features (id, description_key, service_firmware_id) "
+      "SELECT m.new_id, f.description_key, nsf.id FROM temp.CloneFeatureMap "
+      "m JOIN Features f ON f.id = m.old_id JOIN ServiceFirmware osf ON "
+      "osf.id = f.service_firmware_id JOIN ServiceFirmware nsf ON "
+      "nsf.service_id = osf.service_id AND nsf.firmware_id = ? "
+      "ORDER BY m.new_id;");
+  if (features) {
+    sqlite3_bind_int(features.get(), 1, firmwareId);
+  }
+  int featureCount = run(features);
+  if (featureCount < 0) {
+    return clone;
+  }
+
+  int64_t componentBase = nextIdBase("FeatureComponent");
+  auto componentMap = statements->acquire(
+      "INSERT INTO temp.CloneComponentMap (old_id, new_id) SELECT fc.id, ? + "
+      "ROW_NUMBER() OVER (ORDER BY fc.id) FROM temp.CloneFeatureMap m "
+      "CROSS JOIN FeatureComponent fc ON fc.feature_id = m.old_id;");
+  if (componentMap) {
+    sqlite3_bind_int64(componentMap.get(), 1, componentBase);
+  }
+  if (componentBase < 0 || run(componentMap) < 0) {
+    return clone;
+  }
+
+  auto components = statements->acquire(
+      "INSERT INTO FeatureComponent (id, feature_id, component_id) SELECT "
+      "cm.new_id, fm.new_id, fc.component_id FROM temp.CloneComponentMap cm "
+      "JOIN FeatureComponent fc ON fc.id = cm.old_id JOIN "
+      "temp.CloneFeatureMap fm ON fm.old_id = fc.feature_id "
+      "ORDER BY cm.new_id;");
+  int componentCount = run(components);
+  if (componentCount < 0) {
+    return clone;
+  }
+
+  // Limits are leaves, nothing refers to their ids
+  auto limits = statements->acquire(
+      "INSERT INTO FeatureComponentLimits (feature_component_id, limit_id, "
+      "value) SELECT m.new_id, l.limit_id, l.value FROM "
+      "temp.CloneComponentMap m CROSS JOIN FeatureComponentLimits l ON "
+      "l.feature_component_id = m.old_id ORDER BY l.id;");
+  int limitCount = run(limits);
+  if (limitCount < 0 || !transaction.commit()) {
+    return clone;
+  }
+
+  clone.firmware_id = firmwareId;
+  clone.services = serviceCount;
+  clone.features = featureCount;
+  clone.components = componentCount;
+  clone.limits = limitCount;
+  return clone;
+}
+
 int RecloserManager::addService(const std::string &descKey, int parentId) {
-  const char *sql =
-      "INSERT INTO Services (description_key, parent_id) VALUES (?, ?);";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+  Transaction transaction(*this);
+  if (!transaction.active())
     return 0;
 
-  sqlite3_bind_text(stmt, 1, descKey.c_str(), -1, SQLITE_TRANSIENT);
-  if (parentId > 0) {
-    sqlite3_bind_int(stmt, 2, parentId);
-  } else {
-    sqlite3_bind_null(stmt, 2);
-  }
+  int id = 0;
+  {
+    auto stmt = statements->acquire(
+        "INSERT INTO Services (description_key, parent_id) VALUES (?, ?);");
+    if (!stmt)
+      return 0;
 
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
+    sqlite3_bind_text(stmt.get(), 1, descKey.c_str(), -1, SQLITE_TRANSIENT);
+    if (parentId > 0) {
+      sqlite3_bind_int(stmt.get(), 2, parentId);
+    } else {
+      sqlite3_bind_null(stmt.get(), 2);
+    }
 
-  if (rc == SQLITE_DONE) {
-    return static_cast<int>(sqlite3_last_insert_rowid(db));
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE)
+      return 0;
+    id = static_cast<int>(sqlite3_last_insert_rowid(db));
   }
-  return 0;
+
+  // The parent's ancestors one level further away, plus the service itself
+  auto closure = statements->acquire(
+      "INSERT INTO ServiceClosure (ancestor_id, descendant_id, depth) "
+      "SELECT ancestor_id, ?1, depth + 1 FROM ServiceClosure WHERE "
+      "descendant_id = ?2 UNION ALL SELECT ?1, ?1, 0;");
+  if (!closure)
+    return 0;
+
+  sqlite3_bind_int(closure.get(), 1, id);
+  sqlite3_bind_int(closure.get(), 2, parentId);
+  if (sqlite3_step(closure.get()) != SQLITE_DONE || !transaction.commit())
+    return 0;
+  return id;
 }
 
 bool RecloserManager::updateService(int id, const std::string &descKey,
                                     int parentId) {
-  const char *sql = "UPDATE Services SET description_key = ?, "
-                    "parent_id = ? WHERE id = ?;";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+  Transaction transaction(*this);
+  if (!transaction.active())
     return false;
 
-  sqlite3_bind_text(stmt, 1, descKey.c_str(), -1, SQLITE_TRANSIENT);
-  if (parentId > 0) {
-    sqlite3_bind_int(stmt, 2, parentId);
-  } else {
-    sqlite3_bind_null(stmt, 2);
+  {
+    auto stmt = statements->acquire(
+        "UPDATE Services SET description_key = ? WHERE id = ?;");
+    if (!stmt)
+      return false;
+
+    sqlite3_bind_text(stmt.get(), 1, descKey.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt.get(), 2, id);
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE)
+      return false;
+    if (sqlite3_changes(db) == 0)
+      return transaction.commit(); // no such service, nothing to move
   }
-  sqlite3_bind_int(stmt, 3, id);
 
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  return rc == SQLITE_DONE;
+  return moveService(id, parentId) && transaction.commit();
 }
 
-int RecloserManager::linkServiceToFirmware(int serviceId, int firmwareId) {
-  const char *sql = "INSERT OR IGNORE INTO ServiceFirmware (service_id, "
-                    "firmware_id) VALUES (?, ?);";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
-    return 0;
+bool RecloserManager::moveService(int id, int newParentId) {
+  Transaction transaction(*this);
+  if (!transaction.active())
+    return false;
+
+  {
+    auto stmt = statements->acquire(
+        "SELECT IFNULL(parent_id, 0) FROM Services WHERE id = ?;");
+    if (!stmt)
+      return false;
+
+    sqlite3_bind_int(stmt.get(), 1, id);
+    if (sqlite3_step(stmt.get()) != SQLITE_ROW)
+      return false;
+    if (sqlite3_column_int(stmt.get(), 0) == newParentId)
+      return transaction.commit();
+  }
+
+  if (newParentId > 0) {
+    auto stmt = statements->acquire("SELECT 1 FROM ServiceClosure WHERE "
+                                    "ancestor_id = ? AND descendant_id = ?;");
+    if (!stmt)
+      return false;
+
+    sqlite3_bind_int(stmt.get(), 1, id);
+    sqlite3_bind_int(stmt.get(), 2, newParentId);
+    if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      std::cerr << "Cannot move service " << id << " below its own subtree"
+                << std::endl;
+      return false;
+    }
+  }
+
+  {
+    auto stmt =
+        statements->acquire("UPDATE Services SET parent_id = ? WHERE id = ?;");
+    if (!stmt)
+      return false;
+
+    if (newParentId > 0) {
+      sqlite3_bind_int(stmt.get(), 1, newParentId);
+    } else {
+      sqlite3_bind_null(stmt.get(), 1);
+    }
+    sqlite3_bind_int(stmt.get(), 2, id);
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE)
+      return false;
+  }
+
+  // Cut every path from the old ancestors into the subtree, then join the
+  // subtree's internal paths to every path down to the new parent
+  {
+    auto stmt = statements->acquire(
+        "DELETE FROM ServiceClosure WHERE (ancestor_id, descendant_id) IN ("
+        "SELECT a.ancestor_id, d.descendant_id FROM ServiceClosure a CROSS "
+        "JOIN ServiceClosure d WHERE a.descendant_id = ?1 AND a.depth > 0 "
+        "AND d.ancestor_id = ?1);");
+    if (!stmt)
+      return false;
+
+    sqlite3_bind_int(stmt.get(), 1, id);
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE)
+      return false;
+  }
+  {
+    auto stmt = statements->acquire(
+        "INSERT INTO ServiceClosure (ancestor_id, descendant_id, depth) "
+        "SELECT a.ancestor_id, d.descendant_id, a.depth + d.depth + 1 FROM "
+        "ServiceClosure a CROSS JOIN ServiceClosure d WHERE "
+        "a.descendant_id = ? AND d.ancestor_id = ?;");
+    if (!stmt)
+      return false;
 
-  sqlite3_bind_int(stmt, 1, serviceId);
-  sqlite3_bind_int(stmt, 2, firmwareId);
+    sqlite3_bind_int(stmt.get(), 1, newParentId);
+    sqlite3_bind_int(stmt.get(), 2, id);
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE)
+      return false;
+  }
 
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
+  return transaction.commit();
+}
+
+int RecloserManager::linkServiceToFirmware(int serviceId, int firmwareId) {
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  int rc;
+  {
+    auto stmt = statements->acquire("INSERT OR IGNORE INTO ServiceFirmware "
+                                    "(service_id, firmware_id) VALUES (?, ?);");
+    if (!stmt)
+      return 0;
+
+    sqlite3_bind_int(stmt.get(), 1, serviceId);
+    sqlite3_bind_int(stmt.get(), 2, firmwareId);
+
+    rc = sqlite3_step(stmt.get());
+  }
 
-  if (rc == SQLITE_DONE) {
+  if (rc == SQLITE_DONE && sqlite3_changes(db) > 0) {
     return static_cast<int>(sqlite3_last_insert_rowid(db));
-  } else {
-    // If it exists, find the ID
-    return getServiceFirmwareId(serviceId, firmwareId);
   }
+
+  // If it exists, find the ID; on the writer, since the link may have been
+  // created by the caller's open transaction
+  auto stmt = statements->acquire("SELECT id FROM ServiceFirmware WHERE "
+                                  "service_id = ? AND firmware_id = ?;");
+  if (!stmt)
+    return 0;
+
+  sqlite3_bind_int(stmt.get(), 1, serviceId);
+  sqlite3_bind_int(stmt.get(), 2, firmwareId);
+  if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    return sqlite3_column_int(stmt.get(), 0);
+  }
+  return 0;
 }
 
 int RecloserManager::getServiceFirmwareId(int serviceId, int firmwareId) {
-  const char *sql = "SELECT id FROM ServiceFirmware WHERE service_id = ? AND "
-                    "firmware_id = ?;";
-  sqlite3_stmt *stmt;
+  auto lease = connections->acquireReader();
+  auto stmt = lease.statements().acquire(
+      "SELECT id FROM ServiceFirmware WHERE "
+      "service_id = ? AND firmware_id = ?;");
   int id = 0;
 
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-    sqlite3_bind_int(stmt, 1, serviceId);
-    sqlite3_bind_int(stmt, 2, firmwareId);
+  if (stmt) {
+    sqlite3_bind_int(stmt.get(), 1, serviceId);
+    sqlite3_bind_int(stmt.get(), 2, firmwareId);
 
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-      id = sqlite3_column_int(stmt, 0);
+    if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      id = sqlite3_column_int(stmt.get(), 0);
     }
-    sqlite3_finalize(stmt);
   }
   return id;
 }
 
 bool RecloserManager::unlinkServiceFromFirmware(int serviceId, int firmwareId) {
-  const char *sql = "DELETE FROM ServiceFirmware WHERE service_id = ? "
-                    "AND firmware_id = ?;";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt = statements->acquire("DELETE FROM ServiceFirmware WHERE "
+                                  "service_id = ? AND firmware_id = ?;");
+  if (!stmt)
     return false;
 
-  sqlite3_bind_int(stmt, 1, serviceId);
-  sqlite3_bind_int(stmt, 2, firmwareId);
+  sqlite3_bind_int(stmt.get(), 1, serviceId);
+  sqlite3_bind_int(stmt.get(), 2, firmwareId);
 
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  return rc == SQLITE_DONE;
+  return sqlite3_step(stmt.get()) == SQLITE_DONE;
 }
 
 bool RecloserManager::deleteService(int id) {
-  const char *sql = "DELETE FROM Services WHERE id = ?;";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  // The whole subtree in one statement; the parent_id cascade still covers
+  // any descendant missing from the closure
+  auto stmt = statements->acquire(
+      "DELETE FROM Services WHERE id = ?1 OR id IN (SELECT descendant_id "
+      "FROM ServiceClosure WHERE ancestor_id = ?1);");
+  if (!stmt)
     return false;
 
-  sqlite3_bind_int(stmt, 1, id);
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  return rc == SQLITE_DONE;
+  sqlite3_bind_int(stmt.get(), 1, id);
+  return sqlite3_step(stmt.get()) == SQLITE_DONE;
 }
 
 std::vector<ServiceRecord> RecloserManager::getAllServices() {
   std::vector<ServiceRecord> records;
-  const char *sql = "SELECT id, description_key, "
-                    "IFNULL(parent_id, 0) FROM Services;";
-  sqlite3_stmt *stmt;
+  auto lease = connections->acquireReader();
+  auto stmt = lease.statements().acquire(
+      "SELECT id, description_key, "
+      "IFNULL(parent_id, 0) FROM Services;");
 
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
+  if (stmt) {
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
       ServiceRecord rec;
-      rec.id = sqlite3_column_int(stmt, 0);
+      rec.id = sqlite3_column_int(stmt.get(), 0);
       rec.description_key =
-          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
-      rec.parent_id = sqlite3_column_int(stmt, 2);
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
+      rec.parent_id = sqlite3_column_int(stmt.get(), 2);
       records.push_back(rec);
     }
   }
-  sqlite3_finalize(stmt);
   return records;
 }
 
@@ -487,65 +752,122 @@ RecloserManager::getServicesByParentAndFirmware(int parentId, int firmwareId) {
           "WHERE s.parent_id IS NULL AND sf.firmware_id = ?;";
   }
 
-  sqlite3_stmt *stmt;
+  auto lease = connections->acquireReader();
+  auto stmt = lease.statements().acquire(sql);
 
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+  if (stmt) {
     if (parentId > 0) {
-      sqlite3_bind_int(stmt, 1, parentId);
-      sqlite3_bind_int(stmt, 2, firmwareId);
+      sqlite3_bind_int(stmt.get(), 1, parentId);
+      sqlite3_bind_int(stmt.get(), 2, firmwareId);
     } else {
-      sqlite3_bind_int(stmt, 1, firmwareId);
+      sqlite3_bind_int(stmt.get(), 1, firmwareId);
     }
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
       ServiceRecord rec;
-      rec.id = sqlite3_column_int(stmt, 0);
+      rec.id = sqlite3_column_int(stmt.get(), 0);
       rec.description_key =
-          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
-      rec.parent_id = sqlite3_column_int(stmt, 2);
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
+      rec.parent_id = sqlite3_column_int(stmt.get(), 2);
       records.push_back(rec);
     }
   }
-  sqlite3_finalize(stmt);
   return records;
 }
 
 std::optional<ServiceRecord> RecloserManager::getServiceById(int id) {
-  const char *sql = "SELECT id, description_key, IFNULL(parent_id, "
-                    "0) FROM Services WHERE id = ?;";
-  sqlite3_stmt *stmt;
+  auto lease = connections->acquireReader();
+  auto stmt = lease.statements().acquire(
+      "SELECT id, description_key, IFNULL("
+      "parent_id, 0) FROM Services WHERE id = ?;");
   std::optional<ServiceRecord> result = std::nullopt;
 
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-    sqlite3_bind_int(stmt, 1, id);
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
+  if (stmt) {
+    sqlite3_bind_int(stmt.get(), 1, id);
+    if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
       ServiceRecord rec;
-      rec.id = sqlite3_column_int(stmt, 0);
+      rec.id = sqlite3_column_int(stmt.get(), 0);
       rec.description_key =
-          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
-      rec.parent_id = sqlite3_column_int(stmt, 2);
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
+      rec.parent_id = sqlite3_column_int(stmt.get(), 2);
       result = rec;
     }
   }
-  sqlite3_finalize(stmt);
   return result;
 }
 
+std::vector<ServiceRecord> RecloserManager::getServiceSubtree(int id) {
+  std::vector<ServiceRecord> records;
+  auto lease = connections->acquireReader();
+  auto stmt = lease.statements().acquire(
+      "SELECT s.id, s.description_key, IFNULL(s.parent_id, 0) FROM "
+      "ServiceClosure c JOIN Services s ON s.id = c.descendant_id WHERE "
+      "c.ancestor_id = ? ORDER BY c.depth, s.id;");
+
+  if (stmt) {
+    sqlite3_bind_int(stmt.get(), 1, id);
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      ServiceRecord rec;
+      rec.id = sqlite3_column_int(stmt.get(), 0);
+      rec.description_key =
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
+      rec.parent_id = sqlite3_column_int(stmt.get(), 2);
+      records.push_back(rec);
+    }
+  }
+  return records;
+}
+
+std::vector<ServiceRecord> RecloserManager::getServiceAncestors(int id) {
+  std::vector<ServiceRecord> records;
+  auto lease = connections->acquireReader();
+  auto stmt = lease.statements().acquire(
+      "SELECT s.id, s.description_key, IFNULL(s.parent_id, 0) FROM "
+      "ServiceClosure c JOIN Services s ON s.id = c.ancestor_id WHERE "
+      "c.descendant_id = ? AND c.depth > 0 ORDER BY c.depth DESC;");
+
+  if (stmt) {
+    sqlite3_bind_int(stmt.get(), 1, id);
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      ServiceRecord rec;
+      rec.id = sqlite3_column_int(stmt.get(), 0);
+      rec.description_key =
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
+      rec.parent_id = sqlite3_column_int(stmt.get(), 2);
+      records.push_back(rec);
+    }
+  }
+  return records;
+}
+
+int RecloserManager::getServiceDepth(int id) {
+  auto lease = connections->acquireReader();
+  auto stmt = lease.statements().acquire(
+      "SELECT MAX(depth) FROM ServiceClosure WHERE descendant_id = ?;");
+  int depth = -1;
+
+  if (stmt) {
+    sqlite3_bind_int(stmt.get(), 1, id);
+    if (sqlite3_step(stmt.get()) == SQLITE_ROW &&
+        sqlite3_column_type(stmt.get(), 0) != SQLITE_NULL) {
+      depth = sqlite3_column_int(stmt.get(), 0);
+    }
+  }
+  return depth;
+}
+
 int RecloserManager::addFeature(const std::string &descKey,
                                 int serviceFirmwareId) {
-  const char *sql =
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt = statements->acquire(
       "INSERT INTO Features (description_key, service_firmware_id) "
-      "VALUES (?, ?);";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+      "VALUES (?, ?);");
+  if (!stmt)
     return 0;
 
-  sqlite3_bind_text(stmt, 1, descKey.c_str(), -1, SQLITE_TRANSIENT);
-  sqlite3_bind_int(stmt, 2, serviceFirmwareId);
+  sqlite3_bind_text(stmt.get(), 1, descKey.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int(stmt.get(), 2, serviceFirmwareId);
 
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-
-  if (rc == SQLITE_DONE) {
+  if (sqlite3_step(stmt.get()) == SQLITE_DONE) {
     return static_cast<int>(sqlite3_last_insert_rowid(db));
   }
   return 0;
@@ -553,70 +875,67 @@ int RecloserManager::addFeature(const std::string &descKey,
 
 bool RecloserManager::updateFeature(int id, const std::string &descKey,
                                     int serviceFirmwareId) {
-  const char *sql = "UPDATE Features SET description_key = ?, "
-                    "service_firmware_id = ? WHERE id = ?;";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt = statements->acquire("UPDATE Features SET description_key = ?, "
+                                  "service_firmware_id = ? WHERE id = ?;");
+  if (!stmt)
     return false;
 
-  sqlite3_bind_text(stmt, 1, descKey.c_str(), -1, SQLITE_TRANSIENT);
-  sqlite3_bind_int(stmt, 2, serviceFirmwareId);
-  sqlite3_bind_int(stmt, 3, id);
+  sqlite3_bind_text(stmt.get(), 1, descKey.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int(stmt.get(), 2, serviceFirmwareId);
+  sqlite3_bind_int(stmt.get(), 3, id);
 
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  return rc == SQLITE_DONE;
+  return sqlite3_step(stmt.get()) == SQLITE_DONE;
 }
 
 bool RecloserManager::deleteFeature(int id) {
-  const char *sql = "DELETE FROM Features WHERE id = ?;";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt = statements->acquire("DELETE FROM Features WHERE id = ?;");
+  if (!stmt)
     return false;
 
-  sqlite3_bind_int(stmt, 1, id);
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  return rc == SQLITE_DONE;
+  sqlite3_bind_int(stmt.get(), 1, id);
+  return sqlite3_step(stmt.get()) == SQLITE_DONE;
 }
 
 std::vector<FeatureRecord>
 RecloserManager::getFeaturesByServiceFirmware(int serviceFirmwareId) {
   std::vector<FeatureRecord> records;
-  const char *sql = "SELECT id, description_key, service_firmware_id FROM "
-                    "Features WHERE service_firmware_id = ?;";
-  sqlite3_stmt *stmt;
-
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-    sqlite3_bind_int(stmt, 1, serviceFirmwareId);
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
+  auto lease = connections->acquireReader();
+  auto stmt = lease.statements().acquire(
+      "SELECT id, description_key, "
+      "service_firmware_id FROM Features WHERE "
+      "service_firmware_id = ?;");
+
+  if (stmt) {
+    sqlite3_bind_int(stmt.get(), 1, serviceFirmwareId);
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
       FeatureRecord rec;
-      rec.id = sqlite3_column_int(stmt, 0);
+      rec.id = sqlite3_column_int(stmt.get(), 0);
       rec.description_key =
-          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
-      rec.service_firmware_id = sqlite3_column_int(stmt, 2);
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
+      rec.service_firmware_id = sqlite3_column_int(stmt.get(), 2);
       records.push_back(rec);
     }
   }
-  sqlite3_finalize(stmt);
   return records;
 }
 
 int RecloserManager::linkFeatureToComponent(int featureId,
                                             const std::string &componentType) {
-  const char *sql = "INSERT INTO FeatureComponent (feature_id, component_id) "
-                    "SELECT ?, id FROM Component WHERE type = ?;";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt = statements->acquire(
+      "INSERT INTO FeatureComponent (feature_id, component_id) "
+      "SELECT ?, id FROM Component WHERE type = ?;");
+  if (!stmt)
     return 0;
 
-  sqlite3_bind_int(stmt, 1, featureId);
-  sqlite3_bind_text(stmt, 2, componentType.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int(stmt.get(), 1, featureId);
+  sqlite3_bind_text(stmt.get(), 2, componentType.c_str(), -1,
+                    SQLITE_TRANSIENT);
 
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-
-  if (rc == SQLITE_DONE) {
+  // An unknown component type inserts nothing
+  if (sqlite3_step(stmt.get()) == SQLITE_DONE && sqlite3_changes(db) > 0) {
     return static_cast<int>(sqlite3_last_insert_rowid(db));
   }
   return 0;
@@ -625,157 +944,202 @@ int RecloserManager::linkFeatureToComponent(int featureId,
 bool RecloserManager::addComponentLimit(int featureComponentId,
                                         const std::string &limitKey,
                                         const std::string &value) {
-  const char *sql =
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt = statements->acquire(
       "INSERT INTO FeatureComponentLimits (feature_component_id, limit_id, "
-      "value) SELECT ?, id, ? FROM Limits WHERE key = ?;";
-  sqlite3_stmt *stmt;
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+      "value) SELECT ?, id, ? FROM Limits WHERE key = ?;");
+  if (!stmt)
     return false;
 
-  sqlite3_bind_int(stmt, 1, featureComponentId);
-  sqlite3_bind_text(stmt, 2, value.c_str(), -1, SQLITE_TRANSIENT);
-  sqlite3_bind_text(stmt, 3, limitKey.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int(stmt.get(), 1, featureComponentId);
+  sqlite3_bind_text(stmt.get(), 2, value.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_text(stmt.get(), 3, limitKey.c_str(), -1, SQLITE_TRANSIENT);
 
-  int rc = sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  return rc == SQLITE_DONE;
+  // An unknown limit key inserts nothing
+  return sqlite3_step(stmt.get()) == SQLITE_DONE && sqlite3_changes(db) > 0;
 }
 
-std::optional<FeatureRecord> RecloserManager::getFeatureById(int id) {
-  const char *sql = "SELECT id, description_key, service_firmware_id FROM "
-                    "Features WHERE id = ?;";
-  sqlite3_stmt *stmt;
-  std::optional<FeatureRecord> result = std::nullopt;
+bool RecloserManager::updateComponentLimit(int featureComponentId,
+                                           const std::string &limitKey,
+                                           const std::string &value) {
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt = statements->acquire(
+      "UPDATE FeatureComponentLimits SET value = ? WHERE "
+      "feature_component_id = ? AND limit_id = "
+      "(SELECT id FROM Limits WHERE key = ?);");
+  if (!stmt)
+    return false;
 
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-    sqlite3_bind_int(stmt, 1, id);
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-      FeatureRecord rec;
-      rec.id = sqlite3_column_int(stmt, 0);
-      rec.description_key =
-          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
-      rec.service_firmware_id = sqlite3_column_int(stmt, 2);
-      result = rec;
-    }
-  }
-  sqlite3_finalize(stmt);
-  return result;
+  sqlite3_bind_text(stmt.get(), 1, value.c_str(), -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int(stmt.get(), 2, featureComponentId);
+  sqlite3_bind_text(stmt.get(), 3, limitKey.c_str(), -1, SQLITE_TRANSIENT);
+
+  return sqlite3_step(stmt.get()) == SQLITE_DONE;
 }
 
-std::optional<RecloserManager::ServiceLayoutRecord>
-RecloserManager::getScreenLayout(int serviceFirmwareId) {
-  // Get service details via ServiceFirmware join
-  const char *serviceSql = "SELECT s.id, s.description_key "
-                           "FROM Services s "
-                           "JOIN ServiceFirmware sf ON s.id = sf.service_id "
-                           "WHERE sf.id = ?;";
+bool RecloserManager::deleteComponentLimit(int featureComponentId,
+                                           const std::string &limitKey) {
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt = statements->acquire(
+      "DELETE FROM FeatureComponentLimits WHERE feature_component_id = ? AND "
+      "limit_id = (SELECT id FROM Limits WHERE key = ?);");
+  if (!stmt)
+    return false;
 
-  sqlite3_stmt *serviceStmt;
-  ServiceLayoutRecord layout;
-  bool found = false;
+  sqlite3_bind_int(stmt.get(), 1, featureComponentId);
+  sqlite3_bind_text(stmt.get(), 2, limitKey.c_str(), -1, SQLITE_TRANSIENT);
 
-  if (sqlite3_prepare_v2(db, serviceSql, -1, &serviceStmt, nullptr) ==
-      SQLITE_OK) {
-    sqlite3_bind_int(serviceStmt, 1, serviceFirmwareId);
-    if (sqlite3_step(serviceStmt) == SQLITE_ROW) {
-      layout.service_id = sqlite3_column_int(serviceStmt, 0);
-      layout.description_key =
-          reinterpret_cast<const char *>(sqlite3_column_text(serviceStmt, 1));
-      found = true;
-    }
-  }
-  sqlite3_finalize(serviceStmt);
+  return sqlite3_step(stmt.get()) == SQLITE_DONE;
+}
 
-  if (!found)
-    return std::nullopt;
+bool RecloserManager::deleteFeatureComponent(int id) {
+  std::lock_guard<std::recursive_mutex> lock(writeMutex);
+  auto stmt = statements->acquire("DELETE FROM FeatureComponent WHERE id = ?;");
+  if (!stmt)
+    return false;
 
-  layout.translations = getTranslationsForKey(layout.description_key);
+  sqlite3_bind_int(stmt.get(), 1, id);
+  return sqlite3_step(stmt.get()) == SQLITE_DONE;
+}
 
-  // Get features for this service-firmware combination
-  const char *layoutSql =
-      "SELECT f.id, f.description_key, c.type, fc.id "
-      "FROM Features f "
-      "LEFT JOIN FeatureComponent fc ON f.id = fc.feature_id "
-      "LEFT JOIN Component c ON fc.component_id = c.id "
-      "WHERE f.service_firmware_id = ?;";
+RecloserManager::Transaction::Transaction(RecloserManager &manager)
+    : manager(manager), lock(manager.writeMutex),
+      depth(manager.transactionDepth) {
+  open = exec(depth == 0 ? "BEGIN IMMEDIATE;"
+                         : "SAVEPOINT unit_of_work_" + std::to_string(depth) +
+                               ";");
+  if (open) {
+    manager.transactionDepth++;
+    stagedAtBegin = manager.stagedTranslations.size();
+    if (depth == 0) {
+      manager.connections->pinWriter();
+    }
+    // Rolled back with the transaction if it never commits
+    if (depth == 0 &&
+        !exec("UPDATE CatalogRevision SET tracking = 0 WHERE id = 1;")) {
+      rollback();
+      return;
+    }
+    changesAtBegin = sqlite3_total_changes(manager.db);
+  }
+}
 
-  sqlite3_stmt *layoutStmt;
-  if (sqlite3_prepare_v2(db, layoutSql, -1, &layoutStmt, nullptr) ==
-      SQLITE_OK) {
-    sqlite3_bind_int(layoutStmt, 1, serviceFirmwareId);
+RecloserManager::Transaction::~Transaction() {
+  if (open) {
+    rollback();
+  }
+}
 
-    while (sqlite3_step(layoutStmt) == SQLITE_ROW) {
-      FeatureComponentRecord rec;
-      rec.feature_id = sqlite3_column_int(layoutStmt, 0);
-      rec.feature_key =
-          reinterpret_cast<const char *>(sqlite3_column_text(layoutStmt, 1));
+bool RecloserManager::Transaction::commit() {
+  if (!open) {
+    return false;
+  }
+  // One revision bump for everything the transaction changed, and tracking
+  // back on before anyone else can write
+  bool changed = sqlite3_total_changes(manager.db) != changesAtBegin;
+  bool bumped = depth > 0 ||
+                exec(changed ? "UPDATE CatalogRevision SET revision = "
+                               "revision + 1, tracking = 1 WHERE id = 1;"
+                             : "UPDATE CatalogRevision SET tracking = 1 "
+                               "WHERE id = 1;");
+  if (!bumped ||
+      !exec(depth == 0 ? "COMMIT;"
+                       : "RELEASE unit_of_work_" + std::to_string(depth) +
+                             ";")) {
+    rollback();
+    return false;
+  }
+  open = false;
+  manager.transactionDepth--;
+  if (depth == 0) {
+    manager.connections->unpinWriter();
+    manager.translations.upsert(manager.stagedTranslations);
+    manager.stagedTranslations.clear();
+  }
+  return true;
+}
 
-      rec.translations = getTranslationsForKey(rec.feature_key);
+void RecloserManager::Transaction::rollback() {
+  if (!open) {
+    return;
+  }
+  if (depth == 0) {
+    exec("ROLLBACK;");
+  } else {
+    std::string name = "unit_of_work_" + std::to_string(depth);
+    exec("ROLLBACK TO " + name + "; RELEASE " + name + ";");
+  }
+  open = false;
+  manager.transactionDepth--;
+  manager.stagedTranslations.resize(stagedAtBegin);
+  if (depth == 0) {
+    manager.connections->unpinWriter();
+  }
+}
 
-      if (sqlite3_column_type(layoutStmt, 2) != SQLITE_NULL) {
-        rec.component_type =
-            reinterpret_cast<const char *>(sqlite3_column_text(layoutStmt, 2));
+bool RecloserManager::Transaction::deferForeignKeys() {
+  return open && exec("PRAGMA defer_foreign_keys = ON;");
+}
 
-        int fcId = sqlite3_column_int(layoutStmt, 3);
+bool RecloserManager::Transaction::exec(const std::string &sql) {
+  char *zErrMsg = nullptr;
+  if (sqlite3_exec(manager.db, sql.c_str(), nullptr, nullptr, &zErrMsg) !=
+      SQLITE_OK) {
+    std::cerr << "Transaction error (" << sql << "): " << zErrMsg << std::endl;
+    sqlite3_free(zErrMsg);
+    return false;
+  }
+  return true;
+}
 
-        // Get limits for this component
-        const char *limitSql = "SELECT l.key, fcl.value "
-                               "FROM FeatureComponentLimits fcl "
-                               "JOIN Limits l ON fcl.limit_id = l.id "
-                               "WHERE fcl.feature_component_id = ?;";
+std::optional<FeatureRecord> RecloserManager::getFeatureById(int id) {
+  auto lease = connections->acquireReader();
+  auto stmt = lease.statements().acquire(
+      "SELECT id, description_key, "
+      "service_firmware_id FROM Features WHERE "
+      "id = ?;");
+  std::optional<FeatureRecord> result = std::nullopt;
 
-        sqlite3_stmt *limitStmt;
-        if (sqlite3_prepare_v2(db, limitSql, -1, &limitStmt, nullptr) ==
-            SQLITE_OK) {
-          sqlite3_bind_int(limitStmt, 1, fcId);
-          while (sqlite3_step(limitStmt) == SQLITE_ROW) {
-            ComponentLimitRecord lim;
-            lim.key = reinterpret_cast<const char *>(
-                sqlite3_column_text(limitStmt, 0));
-            lim.value = reinterpret_cast<const char *>(
-                sqlite3_column_text(limitStmt, 1));
-            rec.limits.push_back(lim);
-          }
-        }
-        sqlite3_finalize(limitStmt);
-      }
-      layout.features.push_back(rec);
+  if (stmt) {
+    sqlite3_bind_int(stmt.get(), 1, id);
+    if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      FeatureRecord rec;
+      rec.id = sqlite3_column_int(stmt.get(), 0);
+      rec.description_key =
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1));
+      rec.service_firmware_id = sqlite3_column_int(stmt.get(), 2);
+      result = rec;
     }
   }
-  sqlite3_finalize(layoutStmt);
+  return result;
+}
 
-  // Get firmwareId from sfId to use for children
-  int firmwareId = 0;
-  const char *fwSql = "SELECT firmware_id FROM ServiceFirmware WHERE id = ?;";
-  sqlite3_stmt *fwStmt;
-  if (sqlite3_prepare_v2(db, fwSql, -1, &fwStmt, nullptr) == SQLITE_OK) {
-    sqlite3_bind_int(fwStmt, 1, serviceFirmwareId);
-    if (sqlite3_step(fwStmt) == SQLITE_ROW) {
-      firmwareId = sqlite3_column_int(fwStmt, 0);
-    }
-  }
-  sqlite3_finalize(fwStmt);
+std::optional<RecloserManager::ServiceLayoutRecord>
+RecloserManager::getScreenLayout(int serviceFirmwareId) {
+  return layoutEngine->build(serviceFirmwareId);
+}
 
-  // Recursively get children layouts
-  const char *childrenSql = "SELECT id FROM Services WHERE parent_id = ?;";
-  sqlite3_stmt *childrenStmt;
-  if (sqlite3_prepare_v2(db, childrenSql, -1, &childrenStmt, nullptr) ==
-      SQLITE_OK) {
-    sqlite3_bind_int(childrenStmt, 1, layout.service_id);
-    while (sqlite3_step(childrenStmt) == SQLITE_ROW) {
-      int childServiceId = sqlite3_column_int(childrenStmt, 0);
-      int childSfId = getServiceFirmwareId(childServiceId, firmwareId);
-      if (childSfId > 0) {
-        auto childLayout = getScreenLayout(childSfId);
-        if (childLayout) {
-          layout.children.push_back(*childLayout);
-        }
-      }
-    }
-  }
-  sqlite3_finalize(childrenStmt);
+RecloserManager::CatalogSearchResult
+RecloserManager::searchCatalog(const std::string &text,
+                               const std::string &languageCode, int limit,
+                               int offset) {
+  return search->search(text, languageCode, limit, offset);
+}
+
+std::shared_ptr<const CatalogSnapshot>
+RecloserManager::buildCatalogSnapshot(uint64_t version) {
+  // One read transaction, so every table is read from the same commit while
+  // the writer keeps going
+  auto lease = connections->acquireReader();
+  sqlite3_exec(lease.db(), "BEGIN;", nullptr, nullptr, nullptr);
+  auto snapshot = CatalogSnapshot::build(lease.statements(), version);
+  sqlite3_exec(lease.db(), "COMMIT;", nullptr, nullptr, nullptr);
+  return snapshot;
+}
 
-  return layout;
+std::optional<CatalogSnapshot::Revision> RecloserManager::catalogRevision() {
+  auto lease = connections->acquireReader();
+  return CatalogSnapshot::readRevision(lease.statements());
 }
 
 bool RecloserManager::populateSampleLayoutData() {
@@ -1,11 +1,681 @@
 #include "RecloserServiceImpl.hpp"
+#include "FeaturePresenceMatrix.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <google/protobuf/io/coded_stream.h>
+#include <grpc/slice.h>
 #include <iostream>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
 
 namespace recloser {
 
-RecloserServiceImpl::RecloserServiceImpl(RecloserManager *manager)
-    : manager_(manager) {}
+namespace {
+
+// Logs the prepared statement activity of one RPC when it goes out of scope.
+// The counters are per thread, and a sync handler runs on a single thread.
+class StatementActivity {
+public:
+  explicit StatementActivity(const char *rpcName)
+      : rpcName(rpcName), start(StatementCache::threadStats()) {}
+
+  ~StatementActivity() {
+    StatementStats end = StatementCache::threadStats();
+    std::cout << rpcName << " statements: " << (end.hits - start.hits)
+              << " cache hits, " << (end.prepares - start.prepares)
+              << " prepares" << std::endl;
+  }
+
+private:
+  const char *rpcName;
+  StatementStats start;
+};
+
+// SearchCatalog page sizes
+constexpr int DEFAULT_SEARCH_PAGE = 20;
+constexpr int MAX_SEARCH_PAGE = 100;
+
+void assign(std::string *target, std::string_view value) {
+  target->assign(value.data(), value.size());
+}
+
+// Serialized size of one entry of a repeated Translation field (leaving out
+// the few bytes its absence may also save in the enclosing length prefixes)
+size_t translationWireSize(std::string_view languageCode,
+                           std::string_view value) {
+  auto field = [](size_t length) {
+    return 1 +
+           google::protobuf::io::CodedOutputStream::VarintSize32(
+               static_cast<uint32_t>(length)) +
+           length;
+  };
+  return field(field(languageCode.size()) + field(value.size()));
+}
+
+void addTranslations(const CatalogSnapshot &catalog,
+                     CatalogSnapshot::StringId key,
+                     google::protobuf::RepeatedPtrField<Translation> *target,
+                     TreeFilter &filter) {
+  for (const auto &t : catalog.translationsOf(key)) {
+    std::string_view languageCode = catalog.string(t.languageCode);
+    if (!filter.includesLanguage(languageCode)) {
+      filter.omitTranslation(
+          translationWireSize(languageCode, catalog.string(t.value)));
+      continue;
+    }
+    auto *trans = target->Add();
+    assign(trans->mutable_language_code(), languageCode);
+    assign(trans->mutable_value(), catalog.string(t.value));
+  }
+}
+
+// Number of nodes in the subtrees below a node
+size_t descendantCount(const CatalogSnapshot &catalog,
+                       const CatalogSnapshot::ServiceNodeEntry &node) {
+  size_t count = 0;
+  for (int32_t childId : catalog.childNodeIdsOf(node)) {
+    count += 1 + descendantCount(catalog, *catalog.node(childId));
+  }
+  return count;
+}
+
+void logPayload(const char *rpcName, const TreeFilter &filter,
+                size_t payloadBytes) {
+  if (!filter.active()) {
+    return;
+  }
+  std::cout << rpcName << " payload: " << payloadBytes
+            << " bytes; filter left out " << filter.omittedTranslations
+            << " translation(s) (" << filter.omittedTranslationBytes
+            << " bytes) and "
+            << filter.omittedNodes << " service node(s)" << std::endl;
+}
+
+void logCompareCache(const CompareCache &cache, bool hit) {
+  CompareCacheStats stats = cache.stats();
+  std::cout << "CompareServiceTrees cache " << (hit ? "hit" : "miss") << " ("
+            << stats.hits << " hits, " << stats.misses << " misses, "
+            << stats.entries << " entries, " << stats.bytes << " bytes)"
+            << std::endl;
+}
+
+struct KeyedFeature {
+  std::string_view key;
+  const CatalogSnapshot::FeatureEntry *feature;
+};
+
+// Hands a payload to gRPC; the buffer shares the slice instead of copying it
+void setPayload(const grpc::Slice &payload, grpc::ByteBuffer *response) {
+  grpc::ByteBuffer buffer(&payload, 1);
+  response->Swap(&buffer);
+}
+
+// Parses a raw read's request and runs its typed handler, both on the
+// arena; *message is set to the response, which the arena owns
+template <typename Request, typename Response, typename Handler>
+grpc::Status buildOnArena(google::protobuf::Arena &arena,
+                          std::string_view body, Handler handler,
+                          google::protobuf::Message **message) {
+  auto *request = google::protobuf::Arena::CreateMessage<Request>(&arena);
+  if (!request->ParseFromArray(body.data(), static_cast<int>(body.size()))) {
+    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                        "Malformed " + Request::descriptor()->name());
+  }
+  auto *response = google::protobuf::Arena::CreateMessage<Response>(&arena);
+  *message = response;
+  return handler(request, response);
+}
+
+// Distinct features of a node in key order, as the comparison sees them. A
+// key used twice is compared by its first feature.
+std::vector<KeyedFeature>
+featuresByKey(const CatalogSnapshot &catalog,
+              const CatalogSnapshot::ServiceNodeEntry &node) {
+  std::vector<KeyedFeature> features;
+  for (const auto &feat : catalog.featuresOf(node)) {
+    features.push_back({catalog.string(feat.descriptionKey), &feat});
+  }
+  auto byKey = [](const KeyedFeature &a, const KeyedFeature &b) {
+    return a.key < b.key;
+  };
+  std::stable_sort(features.begin(), features.end(), byKey);
+  features.erase(std::unique(features.begin(), features.end(),
+                             [](const KeyedFeature &a, const KeyedFeature &b) {
+                               return a.key == b.key;
+                             }),
+                 features.end());
+  return features;
+}
+
+const CatalogSnapshot::FeatureEntry *
+findFeature(const std::vector<KeyedFeature> &features, std::string_view key) {
+  auto it = std::lower_bound(
+      features.begin(), features.end(), key,
+      [](const KeyedFeature &a, std::string_view k) { return a.key < k; });
+  return it != features.end() && it->key == key ? it->feature : nullptr;
+}
+
+// Limits of a component (none for a missing one) in key order
+std::vector<std::pair<std::string_view, std::string_view>>
+limitsByKey(const CatalogSnapshot &catalog,
+            const CatalogSnapshot::ComponentEntry *component) {
+  std::vector<std::pair<std::string_view, std::string_view>> limits;
+  if (component) {
+    for (const auto &lim : catalog.limitsOf(*component)) {
+      limits.emplace_back(catalog.string(lim.key), catalog.string(lim.value));
+    }
+  }
+  std::stable_sort(
+      limits.begin(), limits.end(),
+      [](const auto &a, const auto &b) { return a.first < b.first; });
+  return limits;
+}
+
+// Adds the limit changes between two components, merging the key-ordered
+// limit lists; a key repeated in both is paired up occurrence by occurrence
+void compareLimits(const CatalogSnapshot &catalog,
+                   const CatalogSnapshot::ComponentEntry *component1,
+                   const CatalogSnapshot::ComponentEntry *component2,
+                   ComponentDifference *diff) {
+  auto limits1 = limitsByKey(catalog, component1);
+  auto limits2 = limitsByKey(catalog, component2);
+  auto it1 = limits1.begin();
+  auto it2 = limits2.begin();
+  while (it1 != limits1.end() || it2 != limits2.end()) {
+    auto *limDiff = diff->add_limit_differences();
+    if (it2 == limits2.end() ||
+        (it1 != limits1.end() && it1->first < it2->first)) {
+      assign(limDiff->mutable_limit_key(), it1->first);
+      assign(limDiff->mutable_old_value(), it1->second);
+      limDiff->set_difference_type(DifferenceType::REMOVED);
+      ++it1;
+    } else if (it1 == limits1.end() || it2->first < it1->first) {
+      assign(limDiff->mutable_limit_key(), it2->first);
+      assign(limDiff->mutable_new_value(), it2->second);
+      limDiff->set_difference_type(DifferenceType::ADDED);
+      ++it2;
+    } else if (it1->second != it2->second) {
+      assign(limDiff->mutable_limit_key(), it1->first);
+      assign(limDiff->mutable_old_value(), it1->second);
+      assign(limDiff->mutable_new_value(), it2->second);
+      limDiff->set_difference_type(DifferenceType::MODIFIED);
+      ++it1, ++it2;
+    } else {
+      diff->mutable_limit_differences()->RemoveLast();
+      ++it1, ++it2;
+    }
+  }
+}
+
+// Adds the component changes of a feature both services have, pairing the
+// components up by position. Returns whether anything differs.
+bool compareComponents(const CatalogSnapshot &catalog,
+                       const CatalogSnapshot::FeatureEntry &feature1,
+                       const CatalogSnapshot::FeatureEntry &feature2,
+                       FeatureDifference *diff) {
+  auto components1 = catalog.componentsOf(feature1);
+  auto components2 = catalog.componentsOf(feature2);
+  size_t count = std::max(components1.size(), components2.size());
+  for (size_t i = 0; i < count; ++i) {
+    const auto *component1 =
+        i < components1.size() ? &components1[i] : nullptr;
+    const auto *component2 =
+        i < components2.size() ? &components2[i] : nullptr;
+    auto *compDiff = diff->add_component_differences();
+    compDiff->set_position(static_cast<int32_t>(i));
+    if (component1) {
+      assign(compDiff->mutable_old_component_type(),
+             catalog.string(component1->type));
+    }
+    if (component2) {
+      assign(compDiff->mutable_new_component_type(),
+             catalog.string(component2->type));
+    }
+    compareLimits(catalog, component1, component2, compDiff);
+
+    if (!component2) {
+      compDiff->set_difference_type(DifferenceType::REMOVED);
+    } else if (!component1) {
+      compDiff->set_difference_type(DifferenceType::ADDED);
+    } else if (component1->type != component2->type ||
+               compDiff->limit_differences_size() > 0) {
+      compDiff->set_difference_type(DifferenceType::MODIFIED);
+    } else {
+      diff->mutable_component_differences()->RemoveLast();
+    }
+  }
+  return diff->component_differences_size() > 0;
+}
+
+// Applies the steps of one change set in order, mapping temporary ids to the
+// rows created by earlier steps
+class ChangeSetApplier {
+public:
+  explicit ChangeSetApplier(RecloserManager &manager) : manager(manager) {}
+
+  bool apply(const ChangeOperation &op, ChangeResult *result) {
+    // Proto3 enums are open: an unknown wire value arrives unchanged
+    if (!ChangeAction_IsValid(op.action())) {
+      return fail(result, "Unknown action");
+    }
+    switch (op.target_case()) {
+    case ChangeOperation::kDescription:
+      return applyDescription(op, result);
+    case ChangeOperation::kRecloser:
+      return applyRecloser(op, result);
+    case ChangeOperation::kFirmware:
+      return applyFirmware(op, result);
+    case ChangeOperation::kService:
+      return applyService(op, result);
+    case ChangeOperation::kFeature:
+      return applyFeature(op, result);
+    case ChangeOperation::kFeatureComponent:
+      return applyFeatureComponent(op, result);
+    case ChangeOperation::kComponentLimit:
+      return applyComponentLimit(op, result);
+    default:
+      return fail(result, "Operation has no target");
+    }
+  }
+
+private:
+  struct CreatedRow {
+    int32_t id;
+    bool service;
+    int32_t serviceFirmwareId; // services linked to a firmware
+  };
+
+  static bool fail(ChangeResult *result, const std::string &message) {
+    result->set_success(false);
+    result->set_message(message);
+    return false;
+  }
+
+  // Sets the result message the single-row RPCs would give, e.g.
+  // "Feature created" or "Failed to create feature"
+  static bool finish(ChangeResult *result, bool success, ChangeAction action,
+                     const std::string &noun) {
+    static const char *const PAST[] = {"created", "updated", "deleted"};
+    static const char *const VERB[] = {"create", "update", "delete"};
+    std::string message;
+    if (success) {
+      message = noun + " " + PAST[action];
+      message[0] = static_cast<char>(std::toupper(message[0]));
+    } else {
+      message = std::string("Failed to ") + VERB[action] + " " + noun;
+    }
+    result->set_success(success);
+    result->set_message(message);
+    return success;
+  }
+
+  // Replaces a -temp_id reference with the id it stands for; real ids (and
+  // 0, meaning "none") are left alone
+  bool resolve(int32_t &id, ChangeResult *result, bool serviceLink = false) {
+    if (id >= 0) {
+      return true;
+    }
+    auto row = created.find(-id);
+    if (row == created.end()) {
+      return fail(result, "Unknown temporary id " + std::to_string(-id));
+    }
+    if (serviceLink && row->second.service) {
+      if (row->second.serviceFirmwareId == 0) {
+        return fail(result, "Temporary service " + std::to_string(-id) +
+                                " is not linked to a firmware");
+      }
+      id = row->second.serviceFirmwareId;
+    } else {
+      id = row->second.id;
+    }
+    return true;
+  }
+
+  bool remember(const ChangeOperation &op, ChangeResult *result,
+                CreatedRow row) {
+    result->set_id(row.id);
+    result->set_service_firmware_id(row.serviceFirmwareId);
+    if (op.temp_id() > 0 && !created.emplace(op.temp_id(), row).second) {
+      return fail(result,
+                  "Duplicate temporary id " + std::to_string(op.temp_id()));
+    }
+    return true;
+  }
+
+  bool applyDescription(const ChangeOperation &op, ChangeResult *result) {
+    const auto &record = op.description();
+    switch (op.action()) {
+    case CHANGE_CREATE:
+    case CHANGE_UPDATE:
+      break;
+    case CHANGE_DELETE:
+      return fail(result, "Descriptions cannot be deleted");
+    default:
+      return fail(result, "Unknown action");
+    }
+    std::vector<std::pair<std::string, std::string>> values;
+    for (const auto &t : record.translations()) {
+      values.emplace_back(t.language_code(), t.value());
+    }
+    return finish(result, manager.addKeyWithTranslations(record.key(), values),
+                  op.action(), "description");
+  }
+
+  bool applyRecloser(const ChangeOperation &op, ChangeResult *result) {
+    const auto &record = op.recloser();
+    int32_t id = record.id();
+    if (op.action() == CHANGE_CREATE) {
+      id = manager.addRecloser(record.description_key());
+      return finish(result, id > 0, op.action(), "recloser") &&
+             remember(op, result, {id, false, 0});
+    }
+    if (!resolve(id, result)) {
+      return false;
+    }
+    result->set_id(id);
+    bool success;
+    switch (op.action()) {
+    case CHANGE_UPDATE:
+      success = manager.updateRecloser(id, record.description_key());
+      break;
+    case CHANGE_DELETE:
+      success = manager.deleteRecloser(id);
+      break;
+    default:
+      return fail(result, "Unknown action");
+    }
+    return finish(result, success, op.action(), "recloser");
+  }
+
+  bool applyFirmware(const ChangeOperation &op, ChangeResult *result) {
+    const auto &record = op.firmware();
+    int32_t id = record.id();
+    int32_t recloserId = record.recloser_id();
+    if (!resolve(recloserId, result)) {
+      return false;
+    }
+    if (op.action() == CHANGE_CREATE) {
+      id = manager.addFirmwareVersion(record.version(), recloserId);
+      return finish(result, id > 0, op.action(), "firmware") &&
+             remember(op, result, {id, false, 0});
+    }
+    if (!resolve(id, result)) {
+      return false;
+    }
+    result->set_id(id);
+    bool success;
+    switch (op.action()) {
+    case CHANGE_UPDATE:
+      success = manager.updateFirmwareVersion(id, record.version(), recloserId);
+      break;
+    case CHANGE_DELETE:
+      success = manager.deleteFirmwareVersion(id);
+      break;
+    default:
+      return fail(result, "Unknown action");
+    }
+    return finish(result, success, op.action(), "firmware");
+  }
+
+  bool applyService(const ChangeOperation &op, ChangeResult *result) {
+    const auto &record = op.service();
+    int32_t id = record.id();
+    int32_t parentId = record.parent_id();
+    int32_t firmwareId = record.firmware_id();
+    if (!resolve(parentId, result) || !resolve(firmwareId, result)) {
+      return false;
+    }
+    if (op.action() == CHANGE_CREATE) {
+      id = manager.addService(record.description_key(), parentId);
+      int32_t serviceFirmwareId = 0;
+      if (id > 0 && firmwareId > 0) {
+        serviceFirmwareId = manager.linkServiceToFirmware(id, firmwareId);
+      }
+      bool success = id > 0 && (firmwareId <= 0 || serviceFirmwareId > 0);
+      return finish(result, success, op.action(), "service") &&
+             remember(op, result, {id, true, serviceFirmwareId});
+    }
+    if (!resolve(id, result)) {
+      return false;
+    }
+    result->set_id(id);
+    bool success;
+    switch (op.action()) {
+    case CHANGE_UPDATE:
+      success = manager.updateService(id, record.description_key(), parentId);
+      break;
+    case CHANGE_DELETE:
+      success = manager.deleteService(id);
+      break;
+    default:
+      return fail(result, "Unknown action");
+    }
+    return finish(result, success, op.action(), "service");
+  }
+
+  bool applyFeature(const ChangeOperation &op, ChangeResult *result) {
+    const auto &record = op.feature();
+    int32_t id = record.id();
+    int32_t serviceFirmwareId = record.service_id();
+    if (!resolve(serviceFirmwareId, result, true)) {
+      return false;
+    }
+    if (op.action() == CHANGE_CREATE) {
+      id = manager.addFeature(record.description_key(), serviceFirmwareId);
+      return finish(result, id > 0, op.action(), "feature") &&
+             remember(op, result, {id, false, 0});
+    }
+    if (!resolve(id, result)) {
+      return false;
+    }
+    result->set_id(id);
+    bool success;
+    switch (op.action()) {
+    case CHANGE_UPDATE:
+      success = manager.updateFeature(id, record.description_key(),
+                                      serviceFirmwareId);
+      break;
+    case CHANGE_DELETE:
+      success = manager.deleteFeature(id);
+      break;
+    default:
+      return fail(result, "Unknown action");
+    }
+    return finish(result, success, op.action(), "feature");
+  }
+
+  bool applyFeatureComponent(const ChangeOperation &op, ChangeResult *result) {
+    const auto &record = op.feature_component();
+    int32_t id = record.id();
+    int32_t featureId = record.feature_id();
+    if (!resolve(featureId, result) || !resolve(id, result)) {
+      return false;
+    }
+    switch (op.action()) {
+    case CHANGE_CREATE:
+      id = manager.linkFeatureToComponent(featureId, record.component_type());
+      return finish(result, id > 0, op.action(), "feature component") &&
+             remember(op, result, {id, false, 0});
+    case CHANGE_DELETE:
+      result->set_id(id);
+      return finish(result, manager.deleteFeatureComponent(id), op.action(),
+                    "feature component");
+    case CHANGE_UPDATE:
+      return fail(result, "Feature components can only be created or deleted");
+    default:
+      return fail(result, "Unknown action");
+    }
+  }
+
+  bool applyComponentLimit(const ChangeOperation &op, ChangeResult *result) {
+    const auto &record = op.component_limit();
+    int32_t featureComponentId = record.feature_component_id();
+    if (!resolve(featureComponentId, result)) {
+      return false;
+    }
+    result->set_id(featureComponentId);
+    bool success;
+    switch (op.action()) {
+    case CHANGE_CREATE:
+      success = manager.addComponentLimit(featureComponentId,
+                                          record.limit_key(), record.value());
+      break;
+    case CHANGE_UPDATE:
+      success = manager.updateComponentLimit(
+          featureComponentId, record.limit_key(), record.value());
+      break;
+    case CHANGE_DELETE:
+      success =
+          manager.deleteComponentLimit(featureComponentId, record.limit_key());
+      break;
+    default:
+      return fail(result, "Unknown action");
+    }
+    return finish(result, success, op.action(), "component limit");
+  }
+
+  RecloserManager &manager;
+  std::unordered_map<int32_t, CreatedRow> created;
+};
+
+} // namespace
+
+TreeFilter::TreeFilter(
+    const google::protobuf::RepeatedPtrField<std::string> &languageCodes,
+    int32_t maxDepth)
+    : languages(languageCodes.begin(), languageCodes.end()),
+      maxDepth(maxDepth) {}
+
+bool TreeFilter::includesLanguage(std::string_view languageCode) const {
+  return languages.empty() ||
+         std::find(languages.begin(), languages.end(), languageCode) !=
+             languages.end();
+}
+
+RecloserServiceImpl::RecloserServiceImpl(RecloserManager *manager,
+                                         CatalogStore *catalog,
+                                         CompareCache *compareCache,
+                                         ResponseCache *responseCache,
+                                         ServerMetrics *metrics)
+    : manager_(manager), catalog_(catalog), compareCache_(compareCache),
+      responseCache_(responseCache), metrics_(metrics),
+      comparePool_(std::max(1u, std::thread::hardware_concurrency()) - 1) {}
+
+grpc::ServerUnaryReactor *
+RecloserServiceImpl::GetServiceTree(grpc::CallbackServerContext *context,
+                                    const grpc::ByteBuffer *request,
+                                    grpc::ByteBuffer *response) {
+  return serveRawRead(context, RawRead::SERVICE_TREE, request, response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserServiceImpl::GetScreenLayout(grpc::CallbackServerContext *context,
+                                     const grpc::ByteBuffer *request,
+                                     grpc::ByteBuffer *response) {
+  return serveRawRead(context, RawRead::SCREEN_LAYOUT, request, response);
+}
+
+grpc::ServerUnaryReactor *
+RecloserServiceImpl::serveRawRead(grpc::CallbackServerContext *context,
+                                  RawRead method,
+                                  const grpc::ByteBuffer *request,
+                                  grpc::ByteBuffer *response) {
+  grpc::ServerUnaryReactor *reactor = context->DefaultReactor();
+  std::string key = rawReadKey(method, *request);
+  reactor->Finish(findCachedRead(key, response)
+                      ? grpc::Status::OK
+                      : buildRawRead(key, response));
+  return reactor;
+}
+
+std::string RecloserServiceImpl::rawReadKey(RawRead method,
+                                            const grpc::ByteBuffer &request) {
+  std::string key(1, static_cast<char>(method));
+  std::vector<grpc::Slice> slices;
+  if (request.Dump(&slices).ok()) {
+    for (const auto &slice : slices) {
+      key.append(reinterpret_cast<const char *>(slice.begin()), slice.size());
+    }
+  }
+  return key;
+}
+
+bool RecloserServiceImpl::findCachedRead(const std::string &key,
+                                         grpc::ByteBuffer *response) {
+  auto method = static_cast<RawRead>(key[0]);
+  if (method == RawRead::FULL_INVENTORY) {
+    return false;
+  }
+  auto payload = responseCache_->lookup(key, catalog_->version());
+  if (!payload) {
+    return false;
+  }
+  setPayload(*payload, response);
+  return true;
+}
+
+grpc::Status RecloserServiceImpl::buildRawRead(const std::string &key,
+                                               grpc::ByteBuffer *response) {
+  // Read before the handler takes its snapshot: a response stored under an
+  // older version than it was built from is only ever dropped, never served
+  uint64_t version = catalog_->version();
+  auto method = static_cast<RawRead>(key[0]);
+  std::string_view body(key.data() + 1, key.size() - 1);
+
+  // Request, response and every message below it live on the arena and go
+  // away with it in one piece
+  ArenaSizeHint &hint = method == RawRead::SERVICE_TREE ? serviceTreeArena_
+                        : method == RawRead::SCREEN_LAYOUT
+                            ? screenLayoutArena_
+                            : inventoryArena_;
+  google::protobuf::Arena arena(hint.options());
+  google::protobuf::Message *message = nullptr;
+  grpc::Status status;
+  switch (method) {
+  case RawRead::SERVICE_TREE:
+    status = buildOnArena<ServiceTreeRequest, ServiceTreeResponse>(
+        arena, body,
+        [this](const auto *request, auto *reply) {
+          return GetServiceTree(nullptr, request, reply);
+        },
+        &message);
+    break;
+  case RawRead::SCREEN_LAYOUT:
+    status = buildOnArena<ScreenLayoutRequest, ScreenLayoutResponse>(
+        arena, body,
+        [this](const auto *request, auto *reply) {
+          return GetScreenLayout(nullptr, request, reply);
+        },
+        &message);
+    break;
+  case RawRead::FULL_INVENTORY:
+    status = buildOnArena<FullInventoryRequest, FullInventoryResponse>(
+        arena, body,
+        [this](const auto *request, auto *reply) {
+          return GetFullInventory(nullptr, request, reply);
+        },
+        &message);
+    break;
+  }
+  if (!status.ok()) {
+    return status;
+  }
+
+  // Serialized straight into the slice that is both cached and sent
+  size_t size = message->ByteSizeLong();
+  grpc::Slice payload(grpc_slice_malloc(size), grpc::Slice::STEAL_REF);
+  message->SerializeWithCachedSizesToArray(
+      const_cast<uint8_t *>(payload.begin()));
+  hint.record(arena);
+  if (method != RawRead::FULL_INVENTORY) {
+    responseCache_->store(key, version, payload);
+  }
+  setPayload(payload, response);
+  return grpc::Status::OK;
+}
 
 grpc::Status
 RecloserServiceImpl::GetServiceTree(grpc::ServerContext *context,
@@ -17,46 +687,20 @@ RecloserServiceImpl::GetServiceTree(grpc::ServerContext *context,
   std::cout << "GetServiceTree called for firmware_id=" << firmwareId
             << std::endl;
 
-  // Get top-level services (parent_id = 0)
-  auto topLevelServices =
-      manager_->getServicesByParentAndFirmware(0, firmwareId);
-
-  for (const auto &service : topLevelServices) {
-    ServiceNode *node = response->add_top_level_services();
-    int sfId = manager_->getServiceFirmwareId(service.id, firmwareId);
-    node->set_id(sfId);
-    node->set_description_key(service.description_key);
-
-    auto translations =
-        manager_->getTranslationsForKey(service.description_key);
-    for (const auto &t : translations) {
-      auto *trans = node->add_translations();
-      trans->set_language_code(t.language_code);
-      trans->set_value(t.value);
-    }
-
-    // Get features for this service-firmware combination
-    if (sfId > 0) {
-      auto features = manager_->getFeaturesByServiceFirmware(sfId);
-      for (const auto &feat : features) {
-        Feature *feature = node->add_features();
-        feature->set_id(feat.id);
-        feature->set_feature_key(feat.description_key);
-
-        auto fTranslations =
-            manager_->getTranslationsForKey(feat.description_key);
-        for (const auto &t : fTranslations) {
-          auto *trans = feature->add_translations();
-          trans->set_language_code(t.language_code);
-          trans->set_value(t.value);
-        }
-      }
-    }
+  auto catalog = catalog_->current();
+  const auto *firmware = catalog->firmware(firmwareId);
+  if (!firmware) {
+    return grpc::Status::OK;
+  }
 
-    // Recursively build children
-    buildServiceNode(service.id, firmwareId, node);
+  // Top-level services (parent_id = 0) of this firmware
+  TreeFilter filter(request->language_codes(), request->max_depth());
+  for (int32_t sfId : catalog->topLevelNodeIdsOf(*firmware)) {
+    buildServiceNode(*catalog, *catalog->node(sfId),
+                     response->add_top_level_services(), filter, 1);
   }
 
+  logPayload("GetServiceTree", filter, response->ByteSizeLong());
   return grpc::Status::OK;
 }
 
@@ -72,18 +716,124 @@ grpc::Status RecloserServiceImpl::CompareServiceTrees(
             << ", firmware_id_2=" << firmwareId2
             << ", language=" << languageCode << std::endl;
 
+  bool hit = compareFirmwares(*catalog_->current(), firmwareId1, firmwareId2,
+                              languageCode, response);
+  logCompareCache(*compareCache_, hit);
+  return grpc::Status::OK;
+}
+
+grpc::Status RecloserServiceImpl::CompareFirmwareSet(
+    grpc::ServerContext *context, const CompareFirmwareSetRequest *request,
+    CompareFirmwareSetResponse *response) {
+
+  std::vector<int32_t> firmwareIds(request->firmware_ids().begin(),
+                                   request->firmware_ids().end());
+  const std::string &languageCode = request->language_code();
+
+  std::cout << "CompareFirmwareSet called for " << firmwareIds.size()
+            << " firmware(s), language=" << languageCode << std::endl;
+
+  if (firmwareIds.size() < 2 ||
+      firmwareIds.size() > FeaturePresenceMatrix::MAX_FIRMWARES) {
+    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                        "Between 2 and 64 firmware ids are required");
+  }
+  auto catalog = catalog_->current();
+  for (int32_t firmwareId : firmwareIds) {
+    if (!catalog->firmware(firmwareId)) {
+      return grpc::Status(grpc::StatusCode::NOT_FOUND,
+                          "Firmware " + std::to_string(firmwareId) +
+                              " not found");
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::pair<int32_t, int32_t>> pairs;
+  for (size_t i = 0; i < firmwareIds.size(); ++i) {
+    for (size_t j = i + 1; j < firmwareIds.size(); ++j) {
+      pairs.emplace_back(firmwareIds[i], firmwareIds[j]);
+    }
+    if (request->mode() == BASELINE) {
+      break;
+    }
+  }
+
+  // Every pair and every firmware's flattened tree is independent work on
+  // the same immutable snapshot
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    response->add_comparisons();
+  }
+  std::atomic<int> cacheHits{0};
+  comparePool_.run(pairs.size(), [&](size_t i) {
+    if (compareFirmwares(*catalog, pairs[i].first, pairs[i].second,
+                         languageCode, response->mutable_comparisons(i))) {
+      cacheHits++;
+    }
+  });
+  auto matrix = FeaturePresenceMatrix::build(
+      *catalog, firmwareIds, comparePool_, request->include_common());
+
+  // Translations are looked up once per distinct feature key
+  std::unordered_map<CatalogSnapshot::StringId, std::string_view> names;
+  response->mutable_firmware_ids()->Add(firmwareIds.begin(),
+                                        firmwareIds.end());
+  for (const auto &row : matrix.rows) {
+    auto *feature = response->add_features();
+    for (auto key : row.servicePath) {
+      assign(feature->add_service_path(), catalog->string(key));
+    }
+    assign(feature->mutable_feature_key(), catalog->string(row.featureKey));
+    auto name = names.try_emplace(row.featureKey, std::string_view());
+    if (name.second) {
+      name.first->second = catalog->translation(row.featureKey, languageCode);
+    }
+    assign(feature->mutable_display_name(), name.first->second);
+    feature->set_presence(row.presence);
+  }
+  response->set_common_features(static_cast<int32_t>(matrix.common));
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  std::cout << "CompareFirmwareSet: " << pairs.size() << " comparison(s) ("
+            << cacheHits << " cached), " << matrix.rows.size()
+            << " feature row(s), " << matrix.common << " common, in "
+            << elapsed.count() << " us" << std::endl;
+  return grpc::Status::OK;
+}
+
+bool RecloserServiceImpl::compareFirmwares(
+    const CatalogSnapshot &catalog, int32_t firmwareId1, int32_t firmwareId2,
+    const std::string &languageCode, CompareServiceTreesResponse *response) {
   response->set_firmware_id_1(firmwareId1);
   response->set_firmware_id_2(firmwareId2);
 
-  // Build internal tree structures for both firmwares
-  std::map<std::string, ServiceTreeNode> tree1, tree2;
-  buildInternalTree(0, firmwareId1, languageCode, tree1);
-  buildInternalTree(0, firmwareId2, languageCode, tree2);
+  const auto *fw1 = catalog.firmware(firmwareId1);
+  const auto *fw2 = catalog.firmware(firmwareId2);
+
+  // Results are cached per firmware revision, so any change to either tree
+  // (services, features, limits or service translations) forces a recompute
+  CompareCache::Key cacheKey{firmwareId1, firmwareId2, languageCode};
+  uint64_t revision1 = fw1 ? fw1->contentHash : 0;
+  uint64_t revision2 = fw2 ? fw2->contentHash : 0;
+  if (auto cached = compareCache_->lookup(cacheKey, revision1, revision2)) {
+    response->ParseFromString(*cached);
+    return true;
+  }
+
+  // Compare the trees straight from the snapshot; identical subtrees are
+  // skipped by their content hash
+  CatalogSnapshot::View<int32_t> nodes1{nullptr, nullptr};
+  CatalogSnapshot::View<int32_t> nodes2{nullptr, nullptr};
+  if (fw1) {
+    nodes1 = catalog.topLevelNodeIdsByKeyOf(*fw1);
+  }
+  if (fw2) {
+    nodes2 = catalog.topLevelNodeIdsByKeyOf(*fw2);
+  }
 
-  // Compare the trees
   int added = 0, removed = 0, modified = 0;
-  compareNodes(tree1, tree2, response->mutable_differences(), added, removed,
-               modified);
+  compareNodes(catalog, nodes1, nodes2, languageCode,
+               response->mutable_differences(), added, removed, modified);
 
   // Generate summary
   std::ostringstream summary;
@@ -91,161 +841,166 @@ grpc::Status RecloserServiceImpl::CompareServiceTrees(
           << " service(s) removed, " << modified << " service(s) modified";
   response->set_summary(summary.str());
 
-  return grpc::Status::OK;
+  compareCache_->store(cacheKey, revision1, revision2,
+                       response->SerializeAsString());
+  return false;
 }
 
-void RecloserServiceImpl::buildServiceNode(int parentId, int firmwareId,
-                                           ServiceNode *parentNode) {
-
-  auto childServices =
-      manager_->getServicesByParentAndFirmware(parentId, firmwareId);
-
-  for (const auto &service : childServices) {
-    ServiceNode *childNode = parentNode->add_children();
-    int sfId = manager_->getServiceFirmwareId(service.id, firmwareId);
-    childNode->set_id(sfId);
-    childNode->set_description_key(service.description_key);
-
-    auto translations =
-        manager_->getTranslationsForKey(service.description_key);
-    for (const auto &t : translations) {
-      auto *trans = childNode->add_translations();
-      trans->set_language_code(t.language_code);
-      trans->set_value(t.value);
-    }
-
-    // Get features for this child service-firmware combination
-    if (sfId > 0) {
-      auto features = manager_->getFeaturesByServiceFirmware(sfId);
-      for (const auto &feat : features) {
-        Feature *feature = childNode->add_features();
-        feature->set_id(feat.id);
-        feature->set_feature_key(feat.description_key);
-
-        auto fTranslations =
-            manager_->getTranslationsForKey(feat.description_key);
-        for (const auto &t : fTranslations) {
-          auto *trans = feature->add_translations();
-          trans->set_language_code(t.language_code);
-          trans->set_value(t.value);
-        }
-      }
-    }
-
-    // Recursively build grandchildren
-    buildServiceNode(service.id, firmwareId, childNode);
+void RecloserServiceImpl::buildServiceNode(
+    const CatalogSnapshot &catalog,
+    const CatalogSnapshot::ServiceNodeEntry &entry, ServiceNode *node,
+    TreeFilter &filter, int depth) {
+
+  node->set_id(entry.id);
+  assign(node->mutable_description_key(), catalog.string(entry.descriptionKey));
+  addTranslations(catalog, entry.descriptionKey, node->mutable_translations(),
+                  filter);
+
+  // Features of this service-firmware combination
+  for (const auto &feat : catalog.featuresOf(entry)) {
+    Feature *feature = node->add_features();
+    feature->set_id(feat.id);
+    assign(feature->mutable_feature_key(), catalog.string(feat.descriptionKey));
+    addTranslations(catalog, feat.descriptionKey,
+                    feature->mutable_translations(), filter);
   }
-}
-
-void RecloserServiceImpl::buildInternalTree(
-    int parentId, int firmwareId, const std::string &languageCode,
-    std::map<std::string, ServiceTreeNode> &tree) {
-
-  auto services =
-      manager_->getServicesByParentAndFirmware(parentId, firmwareId);
-
-  for (const auto &service : services) {
-    ServiceTreeNode node;
-    node.description_key = service.description_key;
-    node.display_name =
-        manager_->getTranslation(service.description_key, languageCode);
-
-    // Get features for this service-firmware combination
-    int sfId = manager_->getServiceFirmwareId(service.id, firmwareId);
-    if (sfId > 0) {
-      auto features = manager_->getFeaturesByServiceFirmware(sfId);
-      for (const auto &feat : features) {
-        node.features.insert(feat.description_key);
-      }
-    }
 
-    // Recursively build children
-    buildInternalTree(service.id, firmwareId, languageCode, node.children);
-
-    tree[service.description_key] = node;
+  // Recursively build children, down to the requested depth
+  if (!filter.expandsBelow(depth)) {
+    filter.omitNodes(descendantCount(catalog, entry));
+    return;
+  }
+  for (int32_t childId : catalog.childNodeIdsOf(entry)) {
+    buildServiceNode(catalog, *catalog.node(childId), node->add_children(),
+                     filter, depth + 1);
   }
 }
 
 void RecloserServiceImpl::compareNodes(
-    const std::map<std::string, ServiceTreeNode> &tree1,
-    const std::map<std::string, ServiceTreeNode> &tree2,
+    const CatalogSnapshot &catalog, CatalogSnapshot::View<int32_t> nodes1,
+    CatalogSnapshot::View<int32_t> nodes2, const std::string &languageCode,
     google::protobuf::RepeatedPtrField<ServiceDifference> *differences,
     int &added, int &removed, int &modified) {
 
+  // Both lists are sorted by description key, so services pair up in a
+  // single merge pass
+  auto keyOf = [&catalog](int32_t sfId) {
+    return catalog.string(catalog.node(sfId)->descriptionKey);
+  };
+  auto setDisplay = [&](ServiceDifference *diff,
+                        const CatalogSnapshot::ServiceNodeEntry &node) {
+    assign(diff->mutable_description_key(),
+           catalog.string(node.descriptionKey));
+    assign(diff->mutable_display_name(),
+           catalog.translation(node.descriptionKey, languageCode));
+  };
+
   // Find services in tree1 (check for removed or modified)
-  for (const auto &[key, node1] : tree1) {
-    auto it2 = tree2.find(key);
+  const int32_t *it2 = nodes2.begin();
+  for (int32_t sfId1 : nodes1) {
+    const auto &node1 = *catalog.node(sfId1);
+    std::string_view key = catalog.string(node1.descriptionKey);
+    while (it2 != nodes2.end() && keyOf(*it2) < key) {
+      ++it2;
+    }
 
-    if (it2 == tree2.end()) {
+    if (it2 == nodes2.end() || keyOf(*it2) != key) {
       // Service removed in tree2
       ServiceDifference *diff = differences->Add();
-      diff->set_description_key(node1.description_key);
-      diff->set_display_name(node1.display_name);
+      setDisplay(diff, node1);
       diff->set_difference_type(DifferenceType::REMOVED);
       removed++;
-    } else {
-      // Service exists in both, check for modifications
-      const auto &node2 = it2->second;
-      bool hasChanges = false;
+      continue;
+    }
 
-      ServiceDifference *diff = differences->Add();
-      diff->set_description_key(node1.description_key);
-      diff->set_display_name(node1.display_name);
-
-      // Compare features
-      for (const auto &feat : node1.features) {
-        if (node2.features.find(feat) == node2.features.end()) {
-          FeatureDifference *featDiff = diff->add_feature_differences();
-          featDiff->set_feature_name(feat);
-          featDiff->set_difference_type(DifferenceType::REMOVED);
-          hasChanges = true;
-        }
-      }
+    // Service exists in both; equal hashes mean the whole subtree is equal
+    const auto &node2 = *catalog.node(*it2);
+    if (node1.subtreeHash == node2.subtreeHash) {
+      continue;
+    }
 
-      for (const auto &feat : node2.features) {
-        if (node1.features.find(feat) == node1.features.end()) {
-          FeatureDifference *featDiff = diff->add_feature_differences();
-          featDiff->set_feature_name(feat);
-          featDiff->set_difference_type(DifferenceType::ADDED);
-          hasChanges = true;
-        }
+    bool hasChanges = false;
+    ServiceDifference *diff = differences->Add();
+    setDisplay(diff, node1);
+
+    // Compare features: keys only one service uses were added or removed,
+    // the features behind a key both use are compared by their components
+    auto features1 = featuresByKey(catalog, node1);
+    auto features2 = featuresByKey(catalog, node2);
+    for (const auto &feat : features1) {
+      if (!findFeature(features2, feat.key)) {
+        FeatureDifference *featDiff = diff->add_feature_differences();
+        assign(featDiff->mutable_feature_name(), feat.key);
+        featDiff->set_difference_type(DifferenceType::REMOVED);
+        hasChanges = true;
       }
+    }
 
-      // Recursively compare children
-      int childAdded = 0, childRemoved = 0, childModified = 0;
-      compareNodes(node1.children, node2.children,
-                   diff->mutable_child_differences(), childAdded, childRemoved,
-                   childModified);
+    for (const auto &feat : features2) {
+      if (!findFeature(features1, feat.key)) {
+        FeatureDifference *featDiff = diff->add_feature_differences();
+        assign(featDiff->mutable_feature_name(), feat.key);
+        featDiff->set_difference_type(DifferenceType::ADDED);
+        hasChanges = true;
+      }
+    }
 
-      if (hasChanges || childAdded > 0 || childRemoved > 0 ||
-          childModified > 0) {
-        diff->set_difference_type(DifferenceType::MODIFIED);
-        modified++;
+    for (const auto &feat : features1) {
+      const auto *feature2 = findFeature(features2, feat.key);
+      if (!feature2) {
+        continue;
+      }
+      FeatureDifference *featDiff = diff->add_feature_differences();
+      if (compareComponents(catalog, *feat.feature, *feature2, featDiff)) {
+        assign(featDiff->mutable_feature_name(), feat.key);
+        featDiff->set_difference_type(DifferenceType::MODIFIED);
+        hasChanges = true;
       } else {
-        diff->set_difference_type(DifferenceType::UNCHANGED);
-        // Remove the diff if nothing changed
-        differences->RemoveLast();
+        diff->mutable_feature_differences()->RemoveLast();
       }
     }
+
+    // Recursively compare children
+    int childAdded = 0, childRemoved = 0, childModified = 0;
+    compareNodes(catalog, catalog.childNodeIdsByKeyOf(node1),
+                 catalog.childNodeIdsByKeyOf(node2), languageCode,
+                 diff->mutable_child_differences(), childAdded, childRemoved,
+                 childModified);
+
+    if (hasChanges || childAdded > 0 || childRemoved > 0 ||
+        childModified > 0) {
+      diff->set_difference_type(DifferenceType::MODIFIED);
+      modified++;
+    } else {
+      // Only translations differ, which this diff does not report
+      differences->RemoveLast();
+    }
   }
 
   // Find services added in tree2
-  for (const auto &[key, node2] : tree2) {
-    if (tree1.find(key) == tree1.end()) {
-      ServiceDifference *diff = differences->Add();
-      diff->set_description_key(node2.description_key);
-      diff->set_display_name(node2.display_name);
-      diff->set_difference_type(DifferenceType::ADDED);
+  const int32_t *it1 = nodes1.begin();
+  for (int32_t sfId2 : nodes2) {
+    const auto &node2 = *catalog.node(sfId2);
+    std::string_view key = catalog.string(node2.descriptionKey);
+    while (it1 != nodes1.end() && keyOf(*it1) < key) {
+      ++it1;
+    }
+    if (it1 != nodes1.end() && keyOf(*it1) == key) {
+      continue;
+    }
 
-      // Add all features as new
-      for (const auto &feat : node2.features) {
-        FeatureDifference *featDiff = diff->add_feature_differences();
-        featDiff->set_feature_name(feat);
-        featDiff->set_difference_type(DifferenceType::ADDED);
-      }
+    ServiceDifference *diff = differences->Add();
+    setDisplay(diff, node2);
+    diff->set_difference_type(DifferenceType::ADDED);
 
-      added++;
+    // Add all features as new
+    for (const auto &feat : featuresByKey(catalog, node2)) {
+      FeatureDifference *featDiff = diff->add_feature_differences();
+      assign(featDiff->mutable_feature_name(), feat.key);
+      featDiff->set_difference_type(DifferenceType::ADDED);
     }
+
+    added++;
   }
 }
 
@@ -259,10 +1014,14 @@ RecloserServiceImpl::GetScreenLayout(grpc::ServerContext *context,
   std::cout << "GetScreenLayout called for service_id=" << serviceId
             << std::endl;
 
-  auto layoutResult = manager_->getScreenLayout(serviceId);
+  auto catalog = catalog_->current();
+  const auto *entry = catalog->node(serviceId);
 
-  if (layoutResult) {
-    populateServiceLayout(*layoutResult, response->mutable_service_layout());
+  if (entry) {
+    TreeFilter filter(request->language_codes(), request->max_depth());
+    populateServiceLayout(*catalog, *entry, response->mutable_service_layout(),
+                          filter, 1);
+    logPayload("GetScreenLayout", filter, response->ByteSizeLong());
     return grpc::Status::OK;
   } else {
     return grpc::Status(grpc::StatusCode::NOT_FOUND,
@@ -271,47 +1030,61 @@ RecloserServiceImpl::GetScreenLayout(grpc::ServerContext *context,
 }
 
 void RecloserServiceImpl::populateServiceLayout(
-    const RecloserManager::ServiceLayoutRecord &rec, ServiceLayout *layout) {
-
-  layout->set_service_id(rec.service_id);
-  layout->set_description_key(rec.description_key);
-
-  for (const auto &t : rec.translations) {
-    auto *trans = layout->add_translations();
-    trans->set_language_code(t.language_code);
-    trans->set_value(t.value);
-  }
-
-  for (const auto &feat : rec.features) {
-    FeatureComponentDetail *detail = layout->add_features();
-    detail->set_feature_id(feat.feature_id);
-    detail->set_feature_key(feat.feature_key);
-
-    for (const auto &t : feat.translations) {
-      auto *trans = detail->add_translations();
-      trans->set_language_code(t.language_code);
-      trans->set_value(t.value);
-    }
-
-    detail->set_component_type(feat.component_type);
+    const CatalogSnapshot &catalog,
+    const CatalogSnapshot::ServiceNodeEntry &entry, ServiceLayout *layout,
+    TreeFilter &filter, int depth) {
+
+  layout->set_service_id(entry.serviceId);
+  assign(layout->mutable_description_key(),
+         catalog.string(entry.descriptionKey));
+  addTranslations(catalog, entry.descriptionKey,
+                  layout->mutable_translations(), filter);
+
+  // One detail per feature component; features without a component still
+  // get a single detail with an empty component type
+  for (const auto &feat : catalog.featuresOf(entry)) {
+    auto components = catalog.componentsOf(feat);
+    size_t detailCount = components.size() > 0 ? components.size() : 1;
+
+    for (size_t i = 0; i < detailCount; ++i) {
+      FeatureComponentDetail *detail = layout->add_features();
+      detail->set_feature_id(feat.id);
+      assign(detail->mutable_feature_key(), catalog.string(feat.descriptionKey));
+      addTranslations(catalog, feat.descriptionKey,
+                      detail->mutable_translations(), filter);
+
+      if (components.size() == 0) {
+        continue;
+      }
+      const auto &comp = components.begin()[i];
+      assign(detail->mutable_component_type(), catalog.string(comp.type));
 
-    for (const auto &lim : feat.limits) {
-      ComponentLimit *limit = detail->add_limits();
-      limit->set_key(lim.key);
-      limit->set_value(lim.value);
+      for (const auto &lim : catalog.limitsOf(comp)) {
+        ComponentLimit *limit = detail->add_limits();
+        assign(limit->mutable_key(), catalog.string(lim.key));
+        assign(limit->mutable_value(), catalog.string(lim.value));
+      }
     }
   }
 
-  for (const auto &childRec : rec.children) {
-    ServiceLayout *childLayout = layout->add_children();
-    populateServiceLayout(childRec, childLayout);
+  if (!filter.expandsBelow(depth)) {
+    filter.omitNodes(descendantCount(catalog, entry));
+    return;
+  }
+  for (int32_t childId : catalog.childNodeIdsOf(entry)) {
+    populateServiceLayout(catalog, *catalog.node(childId),
+                          layout->add_children(), filter, depth + 1);
   }
 }
 
 grpc::Status RecloserServiceImpl::CreateRecloser(grpc::ServerContext *context,
                                                  const RecloserRecord *request,
                                                  GenericResponse *response) {
-  bool success = manager_->addRecloser(request->description_key());
+  StatementActivity activity("CreateRecloser");
+  bool success = manager_->addRecloser(request->description_key()) > 0;
+  if (success) {
+    catalog_->publish();
+  }
   response->set_success(success);
   response->set_message(success ? "Recloser created"
                                 : "Failed to create recloser");
@@ -321,8 +1094,12 @@ grpc::Status RecloserServiceImpl::CreateRecloser(grpc::ServerContext *context,
 grpc::Status RecloserServiceImpl::UpdateRecloser(grpc::ServerContext *context,
                                                  const RecloserRecord *request,
                                                  GenericResponse *response) {
+  StatementActivity activity("UpdateRecloser");
   bool success =
       manager_->updateRecloser(request->id(), request->description_key());
+  if (success) {
+    catalog_->publish();
+  }
   response->set_success(success);
   response->set_message(success ? "Recloser updated"
                                 : "Failed to update recloser");
@@ -332,7 +1109,11 @@ grpc::Status RecloserServiceImpl::UpdateRecloser(grpc::ServerContext *context,
 grpc::Status RecloserServiceImpl::DeleteRecloser(grpc::ServerContext *context,
                                                  const DeleteRequest *request,
                                                  GenericResponse *response) {
+  StatementActivity activity("DeleteRecloser");
   bool success = manager_->deleteRecloser(request->id());
+  if (success) {
+    catalog_->publish();
+  }
   response->set_success(success);
   response->set_message(success ? "Recloser deleted"
                                 : "Failed to delete recloser");
@@ -342,8 +1123,12 @@ grpc::Status RecloserServiceImpl::DeleteRecloser(grpc::ServerContext *context,
 grpc::Status RecloserServiceImpl::CreateFirmware(grpc::ServerContext *context,
                                                  const FirmwareRecord *request,
                                                  GenericResponse *response) {
-  bool success =
-      manager_->addFirmwareVersion(request->version(), request->recloser_id());
+  StatementActivity activity("CreateFirmware");
+  bool success = manager_->addFirmwareVersion(request->version(),
+                                              request->recloser_id()) > 0;
+  if (success) {
+    catalog_->publish();
+  }
   response->set_success(success);
   response->set_message(success ? "Firmware created"
                                 : "Failed to create firmware");
@@ -353,8 +1138,12 @@ grpc::Status RecloserServiceImpl::CreateFirmware(grpc::ServerContext *context,
 grpc::Status RecloserServiceImpl::UpdateFirmware(grpc::ServerContext *context,
                                                  const FirmwareRecord *request,
                                                  GenericResponse *response) {
+  StatementActivity activity("UpdateFirmware");
   bool success = manager_->updateFirmwareVersion(
       request->id(), request->version(), request->recloser_id());
+  if (success) {
+    catalog_->publish();
+  }
   response->set_success(success);
   response->set_message(success ? "Firmware updated"
                                 : "Failed to update firmware");
@@ -364,24 +1153,69 @@ grpc::Status RecloserServiceImpl::UpdateFirmware(grpc::ServerContext *context,
 grpc::Status RecloserServiceImpl::DeleteFirmware(grpc::ServerContext *context,
                                                  const DeleteRequest *request,
                                                  GenericResponse *response) {
+  StatementActivity activity("DeleteFirmware");
   bool success = manager_->deleteFirmwareVersion(request->id());
+  if (success) {
+    catalog_->publish();
+  }
   response->set_success(success);
   response->set_message(success ? "Firmware deleted"
                                 : "Failed to delete firmware");
   return grpc::Status::OK;
 }
 
+grpc::Status
+RecloserServiceImpl::CloneFirmware(grpc::ServerContext *context,
+                                   const CloneFirmwareRequest *request,
+                                   CloneFirmwareResponse *response) {
+  StatementActivity activity("CloneFirmware");
+  auto start = std::chrono::steady_clock::now();
+  FirmwareCloneRecord clone = manager_->cloneFirmware(
+      request->source_firmware_id(), request->version(),
+      request->recloser_id());
+  bool success = clone.firmware_id > 0;
+  if (success) {
+    catalog_->publish();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    std::cout << "Cloned firmware " << request->source_firmware_id()
+              << " as " << clone.firmware_id << ": " << clone.services
+              << " services, " << clone.features << " features, "
+              << clone.components << " components, " << clone.limits
+              << " limits in " << elapsed.count() << " us" << std::endl;
+  }
+  response->set_success(success);
+  response->set_message(success ? "Firmware cloned"
+                                : "Failed to clone firmware");
+  response->set_firmware_id(clone.firmware_id);
+  response->set_services(clone.services);
+  response->set_features(clone.features);
+  response->set_components(clone.components);
+  response->set_limits(clone.limits);
+  return grpc::Status::OK;
+}
+
 grpc::Status RecloserServiceImpl::AddServiceNode(grpc::ServerContext *context,
                                                  const ServiceRecord *request,
                                                  GenericResponse *response) {
-  int serviceId =
-      manager_->addService(request->description_key(), request->parent_id());
-  bool success = (serviceId > 0);
-  if (success && request->firmware_id() > 0) {
-    success =
-        manager_->linkServiceToFirmware(serviceId, request->firmware_id());
+  StatementActivity activity("AddServiceNode");
+  bool success;
+  {
+    // The service and its firmware link are created together or not at all
+    RecloserManager::Transaction transaction(*manager_);
+    int serviceId =
+        manager_->addService(request->description_key(), request->parent_id());
+    success = (serviceId > 0);
+    if (success && request->firmware_id() > 0) {
+      success =
+          manager_->linkServiceToFirmware(serviceId, request->firmware_id());
+    }
+    success = success && transaction.commit();
   }
 
+  if (success) {
+    catalog_->publish();
+  }
   response->set_success(success);
   response->set_message(success ? "Service created"
                                 : "Failed to create service");
@@ -392,8 +1226,12 @@ grpc::Status
 RecloserServiceImpl::UpdateServiceNode(grpc::ServerContext *context,
                                        const ServiceRecord *request,
                                        GenericResponse *response) {
+  StatementActivity activity("UpdateServiceNode");
   bool success = manager_->updateService(
       request->id(), request->description_key(), request->parent_id());
+  if (success) {
+    catalog_->publish();
+  }
   response->set_success(success);
   response->set_message(success ? "Service updated"
                                 : "Failed to update service");
@@ -404,7 +1242,11 @@ grpc::Status
 RecloserServiceImpl::DeleteServiceNode(grpc::ServerContext *context,
                                        const DeleteRequest *request,
                                        GenericResponse *response) {
+  StatementActivity activity("DeleteServiceNode");
   bool success = manager_->deleteService(request->id());
+  if (success) {
+    catalog_->publish();
+  }
   response->set_success(success);
   response->set_message(success ? "Service deleted"
                                 : "Failed to delete service");
@@ -414,8 +1256,12 @@ RecloserServiceImpl::DeleteServiceNode(grpc::ServerContext *context,
 grpc::Status RecloserServiceImpl::CreateFeature(grpc::ServerContext *context,
                                                 const FeatureRecord *request,
                                                 GenericResponse *response) {
+  StatementActivity activity("CreateFeature");
   bool success =
       manager_->addFeature(request->description_key(), request->service_id());
+  if (success) {
+    catalog_->publish();
+  }
   response->set_success(success);
   response->set_message(success ? "Feature created"
                                 : "Failed to create feature");
@@ -425,8 +1271,12 @@ grpc::Status RecloserServiceImpl::CreateFeature(grpc::ServerContext *context,
 grpc::Status RecloserServiceImpl::UpdateFeature(grpc::ServerContext *context,
                                                 const FeatureRecord *request,
                                                 GenericResponse *response) {
+  StatementActivity activity("UpdateFeature");
   bool success = manager_->updateFeature(
       request->id(), request->description_key(), request->service_id());
+  if (success) {
+    catalog_->publish();
+  }
   response->set_success(success);
   response->set_message(success ? "Feature updated"
                                 : "Failed to update feature");
@@ -436,13 +1286,64 @@ grpc::Status RecloserServiceImpl::UpdateFeature(grpc::ServerContext *context,
 grpc::Status RecloserServiceImpl::DeleteFeature(grpc::ServerContext *context,
                                                 const DeleteRequest *request,
                                                 GenericResponse *response) {
+  StatementActivity activity("DeleteFeature");
   bool success = manager_->deleteFeature(request->id());
+  if (success) {
+    catalog_->publish();
+  }
   response->set_success(success);
   response->set_message(success ? "Feature deleted"
                                 : "Failed to delete feature");
   return grpc::Status::OK;
 }
 
+grpc::Status
+RecloserServiceImpl::ApplyChangeSet(grpc::ServerContext *context,
+                                    const ChangeSetRequest *request,
+                                    ChangeSetResponse *response) {
+  StatementActivity activity("ApplyChangeSet");
+  std::cout << "ApplyChangeSet called with " << request->operations_size()
+            << " operation(s)" << std::endl;
+
+  bool success;
+  {
+    RecloserManager::Transaction transaction(*manager_);
+    ChangeSetApplier applier(*manager_);
+    success = transaction.active();
+    for (int i = 0; success && i < request->operations_size(); ++i) {
+      success = applier.apply(request->operations(i), response->add_results());
+    }
+    success = success && transaction.commit();
+  }
+
+  if (success) {
+    catalog_->publish();
+    response->set_message(std::to_string(request->operations_size()) +
+                          " operation(s) applied");
+  } else if (response->results_size() > 0 &&
+             !response->results().rbegin()->success()) {
+    response->set_message("Change set rolled back at operation " +
+                          std::to_string(response->results_size()) + ": " +
+                          response->results().rbegin()->message());
+  } else {
+    response->set_message("Failed to apply change set");
+  }
+  response->set_success(success);
+  return grpc::Status::OK;
+}
+
+grpc::Status
+RecloserServiceImpl::GetServerStats(grpc::ServerContext *context,
+                                    const ServerStatsRequest *request,
+                                    ServerStatsResponse *response) {
+  if (!metrics_) {
+    return grpc::Status(grpc::StatusCode::UNIMPLEMENTED,
+                        "Server metrics are disabled");
+  }
+  metrics_->fill(response);
+  return grpc::Status::OK;
+}
+
 grpc::Status
 RecloserServiceImpl::GetFullInventory(grpc::ServerContext *context,
                                       const FullInventoryRequest *request,
@@ -450,66 +1351,154 @@ RecloserServiceImpl::GetFullInventory(grpc::ServerContext *context,
 
   std::cout << "GetFullInventory called" << std::endl;
 
-  auto reclosers = manager_->getAllReclosers();
-  for (const auto &r : reclosers) {
+  auto catalog = catalog_->current();
+  TreeFilter filter(request->language_codes(), request->max_depth());
+  for (const auto &r : catalog->reclosers()) {
     auto *ri = response->add_reclosers();
     ri->set_id(r.id);
-    ri->set_description_key(r.description_key);
+    assign(ri->mutable_description_key(), catalog->string(r.descriptionKey));
+    addTranslations(*catalog, r.descriptionKey, ri->mutable_translations(),
+                    filter);
 
-    auto rTranslations = manager_->getTranslationsForKey(r.description_key);
-    for (const auto &t : rTranslations) {
-      auto *trans = ri->add_translations();
-      trans->set_language_code(t.language_code);
-      trans->set_value(t.value);
-    }
-
-    auto firmwares = manager_->getFirmwareVersionsForRecloser(r.id);
-    for (const auto &f : firmwares) {
+    for (int32_t firmwareId : catalog->firmwareIdsOf(r)) {
+      const auto &f = *catalog->firmware(firmwareId);
       auto *fi = ri->add_firmwares();
       fi->set_id(f.id);
-      fi->set_version(f.version);
-
-      // Fetch top level services for this firmware
-      auto topServices = manager_->getServicesByParentAndFirmware(0, f.id);
-      for (const auto &s : topServices) {
-        auto *sn = fi->add_services();
-        int sfId = manager_->getServiceFirmwareId(s.id, f.id);
-        sn->set_id(sfId);
-        sn->set_description_key(s.description_key);
-
-        auto sTranslations = manager_->getTranslationsForKey(s.description_key);
-        for (const auto &t : sTranslations) {
-          auto *trans = sn->add_translations();
-          trans->set_language_code(t.language_code);
-          trans->set_value(t.value);
-        }
-
-        // Get features for this top service-firmware
-        // combination
-        if (sfId > 0) {
-          auto features = manager_->getFeaturesByServiceFirmware(sfId);
-          for (const auto &feat : features) {
-            Feature *feature = sn->add_features();
-            feature->set_id(feat.id);
-            feature->set_feature_key(feat.description_key);
-
-            auto fTranslations =
-                manager_->getTranslationsForKey(feat.description_key);
-            for (const auto &t : fTranslations) {
-              auto *trans = feature->add_translations();
-              trans->set_language_code(t.language_code);
-              trans->set_value(t.value);
-            }
-          }
-        }
-
-        // Recursively build children
-        buildServiceNode(s.id, f.id, sn);
+      assign(fi->mutable_version(), catalog->string(f.version));
+
+      // Top level services of this firmware, children recursively
+      for (int32_t sfId : catalog->topLevelNodeIdsOf(f)) {
+        buildServiceNode(*catalog, *catalog->node(sfId), fi->add_services(),
+                         filter, 1);
       }
     }
   }
 
+  logPayload("GetFullInventory", filter, response->ByteSizeLong());
+  return grpc::Status::OK;
+}
+
+grpc::Status
+RecloserServiceImpl::SearchCatalog(grpc::ServerContext *context,
+                                   const SearchCatalogRequest *request,
+                                   SearchCatalogResponse *response) {
+  StatementActivity activity("SearchCatalog");
+  auto start = std::chrono::steady_clock::now();
+  int pageSize = request->page_size() > 0
+                     ? std::min(request->page_size(), MAX_SEARCH_PAGE)
+                     : DEFAULT_SEARCH_PAGE;
+  int offset = std::max(request->offset(), 0);
+
+  // One hit more than the page tells whether another page follows
+  auto result = manager_->searchCatalog(
+      request->query(), request->language_code(), pageSize + 1, offset);
+  bool more = static_cast<int>(result.hits.size()) > pageSize;
+  if (more) {
+    result.hits.pop_back();
+  }
+
+  for (auto &rec : result.hits) {
+    auto *hit = response->add_hits();
+    hit->set_kind(rec.is_service ? SERVICE : FEATURE);
+    hit->set_id(rec.id);
+    hit->set_description_key(std::move(rec.description_key));
+    hit->set_language_code(std::move(rec.language_code));
+    hit->set_matched_text(std::move(rec.matched_text));
+    hit->set_service_id(rec.service_id);
+    hit->set_firmware_id(rec.firmware_id);
+    hit->set_firmware_version(std::move(rec.firmware_version));
+    hit->set_recloser_id(rec.recloser_id);
+    hit->set_recloser_key(std::move(rec.recloser_key));
+    hit->set_score(rec.score);
+  }
+  response->set_next_offset(more ? offset + pageSize : 0);
+  response->set_truncated(result.truncated);
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  std::cout << "SearchCatalog \"" << request->query() << "\": "
+            << response->hits_size() << " hits"
+            << (result.truncated ? " (truncated)" : "") << " in "
+            << elapsed.count() << " us" << std::endl;
+  return grpc::Status::OK;
+}
+
+grpc::Status
+RecloserServiceImpl::StreamFullInventory(
+    grpc::ServerContext *context, const FullInventoryRequest *request,
+    grpc::ServerWriter<InventoryChunk> *writer) {
+
+  std::cout << "StreamFullInventory called" << std::endl;
+
+  // Write() blocks until the transport accepts the message, so at most one
+  // firmware tree is held here while a slow client drains the stream
+  InventoryCursor cursor = startInventory(*request);
+  InventoryChunk chunk;
+  while (nextInventoryChunk(cursor, &chunk)) {
+    if (context->IsCancelled() || !writer->Write(chunk)) {
+      return grpc::Status(grpc::StatusCode::CANCELLED,
+                          "Inventory stream cancelled");
+    }
+    chunk.Clear();
+  }
   return grpc::Status::OK;
 }
 
+InventoryCursor
+RecloserServiceImpl::startInventory(const FullInventoryRequest &request) {
+  return InventoryCursor{catalog_->current(),
+                         TreeFilter(request.language_codes(),
+                                    request.max_depth())};
+}
+
+bool RecloserServiceImpl::nextInventoryChunk(InventoryCursor &cursor,
+                                             InventoryChunk *chunk) {
+  const auto &catalog = *cursor.catalog;
+  const auto &reclosers = catalog.reclosers();
+
+  while (cursor.recloser < reclosers.size()) {
+    const auto &r = reclosers[cursor.recloser];
+
+    // The recloser itself, without its firmwares
+    if (!cursor.recloserSent) {
+      auto *ri = chunk->mutable_recloser();
+      ri->set_id(r.id);
+      assign(ri->mutable_description_key(), catalog.string(r.descriptionKey));
+      addTranslations(catalog, r.descriptionKey, ri->mutable_translations(),
+                      cursor.filter);
+      cursor.recloserSent = true;
+      if (cursor.filter.active()) {
+        cursor.payloadBytes += chunk->ByteSizeLong();
+      }
+      return true;
+    }
+
+    // Then one firmware at a time
+    auto firmwareIds = catalog.firmwareIdsOf(r);
+    if (cursor.firmware < firmwareIds.size()) {
+      const auto &f =
+          *catalog.firmware(firmwareIds.begin()[cursor.firmware++]);
+      chunk->set_recloser_id(r.id);
+      auto *fi = chunk->mutable_firmware();
+      fi->set_id(f.id);
+      assign(fi->mutable_version(), catalog.string(f.version));
+      for (int32_t sfId : catalog.topLevelNodeIdsOf(f)) {
+        buildServiceNode(catalog, *catalog.node(sfId), fi->add_services(),
+                         cursor.filter, 1);
+      }
+      if (cursor.filter.active()) {
+        cursor.payloadBytes += chunk->ByteSizeLong();
+      }
+      return true;
+    }
+
+    cursor.recloser++;
+    cursor.firmware = 0;
+    cursor.recloserSent = false;
+  }
+
+  logPayload("StreamFullInventory", cursor.filter, cursor.payloadBytes);
+  return false;
+}
+
 } // namespace recloser
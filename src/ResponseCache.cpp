@@ -0,0 +1,79 @@
+#include "ResponseCache.hpp"
+#include <iterator>
+
+namespace {
+
+// List node, map node (with its copy of the key) and slice refcount of one
+// entry
+constexpr size_t ENTRY_OVERHEAD = 160;
+
+} // namespace
+
+ResponseCache::ResponseCache(size_t capacityBytes)
+    : capacityBytes(capacityBytes) {}
+
+std::optional<grpc::Slice> ResponseCache::lookup(const std::string &key,
+                                                 uint64_t version) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = index.find(key);
+  if (it == index.end()) {
+    misses++;
+    return std::nullopt;
+  }
+
+  auto entry = it->second;
+  if (entry->version != version) {
+    // The catalog changed since this response was built
+    invalidations++;
+    misses++;
+    erase(entry);
+    return std::nullopt;
+  }
+
+  hits++;
+  lru.splice(lru.begin(), lru, entry);
+  return entry->payload;
+}
+
+void ResponseCache::store(const std::string &key, uint64_t version,
+                          grpc::Slice payload) {
+  size_t entryBytes =
+      payload.size() + 2 * key.size() + sizeof(Entry) + ENTRY_OVERHEAD;
+  if (entryBytes > capacityBytes) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto existing = index.find(key);
+  if (existing != index.end()) {
+    erase(existing->second);
+  }
+
+  while (!lru.empty() && bytes + entryBytes > capacityBytes) {
+    erase(std::prev(lru.end()));
+    evictions++;
+  }
+
+  lru.push_front(Entry{key, version, std::move(payload), entryBytes});
+  index.emplace(key, lru.begin());
+  bytes += entryBytes;
+}
+
+void ResponseCache::erase(EntryList::iterator entry) {
+  bytes -= entry->bytes;
+  index.erase(entry->key);
+  lru.erase(entry);
+}
+
+ResponseCacheStats ResponseCache::stats() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  ResponseCacheStats s;
+  s.hits = hits;
+  s.misses = misses;
+  s.invalidations = invalidations;
+  s.evictions = evictions;
+  s.entries = index.size();
+  s.bytes = bytes;
+  s.capacityBytes = capacityBytes;
+  return s;
+}
@@ -0,0 +1,169 @@
+#include "ScreenLayoutEngine.hpp"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Every ServiceFirmware row below (and including) the requested one, read
+// from the ServiceClosure range of its service along with the parent's row
+// for the same firmware. The CROSS JOINs keep SQLite walking that range
+// rather than every service linked to the firmware.
+const std::string SUBTREE_CTE =
+    "WITH subtree(sf_id, service_id, description_key, parent_sf_id, depth) "
+    "AS (SELECT csf.id, s.id, s.description_key, IFNULL(psf.id, 0), c.depth "
+    "FROM ServiceFirmware root "
+    "CROSS JOIN ServiceClosure c ON c.ancestor_id = root.service_id "
+    "CROSS JOIN Services s ON s.id = c.descendant_id "
+    "JOIN ServiceFirmware csf ON csf.service_id = s.id "
+    "AND csf.firmware_id = root.firmware_id "
+    "LEFT JOIN ServiceFirmware psf ON c.depth > 0 "
+    "AND psf.service_id = s.parent_id AND psf.firmware_id = root.firmware_id "
+    "WHERE root.id = ?1) ";
+
+const std::string SERVICES_SQL =
+    SUBTREE_CTE + "SELECT sf_id, service_id, description_key, parent_sf_id "
+                  "FROM subtree ORDER BY depth, service_id;";
+
+const std::string FEATURES_SQL =
+    SUBTREE_CTE +
+    "SELECT f.service_firmware_id, f.id, f.description_key, c.type, fc.id, "
+    "l.key, fcl.value "
+    "FROM subtree t JOIN Features f ON f.service_firmware_id = t.sf_id "
+    "LEFT JOIN FeatureComponent fc ON fc.feature_id = f.id "
+    "LEFT JOIN Component c ON c.id = fc.component_id "
+    "LEFT JOIN FeatureComponentLimits fcl ON fcl.feature_component_id = fc.id "
+    "LEFT JOIN Limits l ON l.id = fcl.limit_id "
+    "ORDER BY f.service_firmware_id, f.id, fc.id, fcl.id;";
+
+std::string columnText(sqlite3_stmt *stmt, int col) {
+  const unsigned char *text = sqlite3_column_text(stmt, col);
+  return text ? reinterpret_cast<const char *>(text) : "";
+}
+
+struct LayoutNode {
+  RecloserManager::ServiceLayoutRecord record;
+  std::vector<size_t> children;
+};
+
+RecloserManager::ServiceLayoutRecord assemble(std::vector<LayoutNode> &nodes,
+                                              size_t index) {
+  RecloserManager::ServiceLayoutRecord record =
+      std::move(nodes[index].record);
+  for (size_t child : nodes[index].children) {
+    record.children.push_back(assemble(nodes, child));
+  }
+  return record;
+}
+
+} // namespace
+
+ScreenLayoutEngine::ScreenLayoutEngine(ConnectionPool &connections,
+                                       const TranslationDictionary &translations)
+    : connections(connections), translations(translations) {}
+
+std::optional<RecloserManager::ServiceLayoutRecord>
+ScreenLayoutEngine::build(int serviceFirmwareId) {
+  auto lease = connections.acquireReader();
+  StatementCache &statements = lease.statements();
+
+  std::vector<LayoutNode> nodes;
+  std::unordered_map<int, size_t> nodeBySfId;
+
+  // 1. Service skeleton, parents always before their children. Like a walk
+  // down parent_id, it stops at children not linked to the same firmware:
+  // a service whose parent was not kept is skipped along with its features.
+  {
+    auto stmt = statements.acquire(SERVICES_SQL);
+    if (!stmt)
+      return std::nullopt;
+
+    sqlite3_bind_int(stmt.get(), 1, serviceFirmwareId);
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      int sfId = sqlite3_column_int(stmt.get(), 0);
+      int parentSfId = sqlite3_column_int(stmt.get(), 3);
+      auto parent = nodeBySfId.find(parentSfId);
+      if (!nodes.empty() && parent == nodeBySfId.end())
+        continue;
+
+      LayoutNode node;
+      node.record.service_id = sqlite3_column_int(stmt.get(), 1);
+      node.record.description_key = columnText(stmt.get(), 2);
+
+      size_t index = nodes.size();
+      nodes.push_back(std::move(node));
+      if (index > 0) {
+        nodes[parent->second].children.push_back(index);
+      }
+      nodeBySfId[sfId] = index;
+    }
+  }
+
+  if (nodes.empty())
+    return std::nullopt;
+
+  // 2. Features, their components and limits, one row per limit
+  {
+    auto stmt = statements.acquire(FEATURES_SQL);
+    if (stmt) {
+      sqlite3_bind_int(stmt.get(), 1, serviceFirmwareId);
+
+      RecloserManager::FeatureComponentRecord *current = nullptr;
+      int currentFeatureId = 0;
+      int currentFcId = 0;
+
+      while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+        int sfId = sqlite3_column_int(stmt.get(), 0);
+        int featureId = sqlite3_column_int(stmt.get(), 1);
+        bool hasComponent = sqlite3_column_type(stmt.get(), 3) != SQLITE_NULL;
+        int fcId = sqlite3_column_int(stmt.get(), 4);
+
+        auto owner = nodeBySfId.find(sfId);
+        if (owner == nodeBySfId.end())
+          continue;
+
+        if (!current || featureId != currentFeatureId || fcId != currentFcId) {
+          auto &features = nodes[owner->second].record.features;
+          RecloserManager::FeatureComponentRecord rec;
+          rec.feature_id = featureId;
+          rec.feature_key = columnText(stmt.get(), 2);
+          if (hasComponent) {
+            rec.component_type = columnText(stmt.get(), 3);
+          }
+          features.push_back(std::move(rec));
+          current = &features.back();
+          currentFeatureId = featureId;
+          currentFcId = fcId;
+        }
+
+        if (hasComponent &&
+            sqlite3_column_type(stmt.get(), 5) != SQLITE_NULL) {
+          RecloserManager::ComponentLimitRecord lim;
+          lim.key = columnText(stmt.get(), 5);
+          lim.value = columnText(stmt.get(), 6);
+          current->limits.push_back(std::move(lim));
+        }
+      }
+    }
+  }
+
+  // 3. Translations of every service and feature key in one bulk lookup
+  std::vector<std::string> keys;
+  for (const auto &node : nodes) {
+    keys.push_back(node.record.description_key);
+    for (const auto &feature : node.record.features) {
+      keys.push_back(feature.feature_key);
+    }
+  }
+  auto resolved = translations.resolve(keys);
+
+  size_t next = 0;
+  for (auto &node : nodes) {
+    node.record.translations = std::move(resolved[next++]);
+    for (auto &feature : node.record.features) {
+      feature.translations = std::move(resolved[next++]);
+    }
+  }
+
+  return assemble(nodes, 0);
+}
@@ -0,0 +1,352 @@
+#include "ServerMetrics.hpp"
+#include <cstdio>
+#include <utility>
+
+namespace recloser {
+
+namespace {
+
+using Hook = grpc::experimental::InterceptionHookPoints;
+
+// Times one call; gRPC creates it as the call starts
+class RpcTimer : public grpc::experimental::Interceptor {
+public:
+  explicit RpcTimer(RpcMetrics *metrics)
+      : metrics(metrics), start(LatencyHistogram::Clock::now()) {}
+
+  void Intercept(grpc::experimental::InterceptorBatchMethods *methods)
+      override {
+    if (methods->QueryInterceptionHookPoint(Hook::PRE_SEND_STATUS)) {
+      if (!methods->GetSendStatus().ok()) {
+        metrics->errors.fetch_add(1, std::memory_order_relaxed);
+      }
+      metrics->latency.recordSince(start);
+    }
+    methods->Proceed();
+  }
+
+private:
+  RpcMetrics *metrics;
+  LatencyHistogram::Clock::time_point start;
+};
+
+class RpcTimerFactory
+    : public grpc::experimental::ServerInterceptorFactoryInterface {
+public:
+  explicit RpcTimerFactory(ServerMetrics *metrics) : metrics(metrics) {}
+
+  grpc::experimental::Interceptor *
+  CreateServerInterceptor(grpc::experimental::ServerRpcInfo *info) override {
+    RpcMetrics *rpc = metrics->rpc(info->method());
+    return rpc ? new RpcTimer(rpc) : nullptr;
+  }
+
+private:
+  ServerMetrics *metrics;
+};
+
+void setLatency(LatencyStats *stats, const std::string &name,
+                const LatencySummary &latency) {
+  stats->set_name(name);
+  stats->set_count(latency.count);
+  stats->set_total_us(latency.totalNanos / 1e3);
+  stats->set_p50_us(latency.p50Nanos / 1e3);
+  stats->set_p90_us(latency.p90Nanos / 1e3);
+  stats->set_p99_us(latency.p99Nanos / 1e3);
+  stats->set_max_us(latency.maxNanos / 1e3);
+}
+
+void appendNumber(std::string &out, double value) {
+  char buffer[32];
+  int length = std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+  out.append(buffer, static_cast<size_t>(length));
+}
+
+void appendSeconds(std::string &out, uint64_t nanos) {
+  appendNumber(out, nanos / 1e9);
+}
+
+// Label value with Prometheus escapes, runs of whitespace (the indentation
+// of multi-line SQL) folded into one space
+void appendLabelValue(std::string &out, std::string_view value) {
+  out += '"';
+  size_t begin = out.size();
+  bool space = false;
+  for (char c : value) {
+    if (c == ' ' || c == '\n' || c == '\t' || c == '\r') {
+      space = true;
+      continue;
+    }
+    if (space && out.size() > begin) {
+      out += ' ';
+    }
+    space = false;
+    if (c == '\\' || c == '"') {
+      out += '\\';
+    }
+    out += c;
+  }
+  out += '"';
+}
+
+void appendHeader(std::string &out, const char *name, const char *type,
+                  const char *help) {
+  out += "# HELP ";
+  out += name;
+  out += ' ';
+  out += help;
+  out += "\n# TYPE ";
+  out += name;
+  out += ' ';
+  out += type;
+  out += '\n';
+}
+
+void appendSample(std::string &out, const char *name, const char *suffix,
+                  const char *label, std::string_view labelValue,
+                  const char *quantile = nullptr) {
+  out += name;
+  out += suffix;
+  out += '{';
+  out += label;
+  out += '=';
+  appendLabelValue(out, labelValue);
+  if (quantile) {
+    out += ",quantile=\"";
+    out += quantile;
+    out += '"';
+  }
+  out += "} ";
+}
+
+using NamedLatency = std::pair<std::string, LatencySummary>;
+
+// A summary family plus a gauge family with each maximum
+void appendLatencyFamilies(std::string &out, const char *name,
+                           const char *maxName, const char *label,
+                           const char *help,
+                           const std::vector<NamedLatency> &entries) {
+  appendHeader(out, name, "summary", help);
+  for (const auto &[labelValue, latency] : entries) {
+    const std::pair<const char *, uint64_t> quantiles[] = {
+        {"0.5", latency.p50Nanos},
+        {"0.9", latency.p90Nanos},
+        {"0.99", latency.p99Nanos}};
+    for (const auto &[quantile, nanos] : quantiles) {
+      appendSample(out, name, "", label, labelValue, quantile);
+      appendSeconds(out, nanos);
+      out += '\n';
+    }
+    appendSample(out, name, "_sum", label, labelValue);
+    appendSeconds(out, latency.totalNanos);
+    out += '\n';
+    appendSample(out, name, "_count", label, labelValue);
+    appendNumber(out, static_cast<double>(latency.count));
+    out += '\n';
+  }
+
+  appendHeader(out, maxName, "gauge", "Longest single duration so far");
+  for (const auto &[labelValue, latency] : entries) {
+    appendSample(out, maxName, "", label, labelValue);
+    appendSeconds(out, latency.maxNanos);
+    out += '\n';
+  }
+}
+
+} // namespace
+
+ServerMetrics::ServerMetrics(RecloserManager *manager, CatalogStore *catalog,
+                             CompareCache *compareCache,
+                             ResponseCache *responseCache)
+    : manager_(manager), catalog_(catalog), compareCache_(compareCache),
+      responseCache_(responseCache),
+      started_(std::chrono::steady_clock::now()) {
+  const google::protobuf::ServiceDescriptor *service =
+      GenericResponse::descriptor()->file()->FindServiceByName(
+          "RecloserService");
+  for (int i = 0; service && i < service->method_count(); ++i) {
+    const std::string &name = service->method(i)->name();
+    auto metrics = std::make_unique<RpcMetrics>();
+    metrics->name = name;
+    rpcsByPath_.emplace("/" + service->full_name() + "/" + name,
+                        metrics.get());
+    rpcs_.push_back(std::move(metrics));
+  }
+}
+
+std::unique_ptr<grpc::experimental::ServerInterceptorFactoryInterface>
+ServerMetrics::interceptorFactory() {
+  return std::make_unique<RpcTimerFactory>(this);
+}
+
+RpcMetrics *ServerMetrics::rpc(std::string_view method) {
+  auto it = rpcsByPath_.find(method);
+  return it == rpcsByPath_.end() ? nullptr : it->second;
+}
+
+double ServerMetrics::uptimeSeconds() const {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       started_)
+      .count();
+}
+
+std::vector<ServerMetrics::Gauge> ServerMetrics::gauges() const {
+  auto count = [](auto value) { return static_cast<double>(value); };
+  std::vector<Gauge> g;
+
+  g.push_back({"recloser_catalog_version",
+               "Version of the catalog snapshot being served",
+               count(catalog_->version())});
+
+  CompareCacheStats compare = compareCache_->stats();
+  g.push_back({"recloser_compare_cache_hits_total",
+               "CompareServiceTrees results served from the cache",
+               count(compare.hits)});
+  g.push_back({"recloser_compare_cache_misses_total",
+               "CompareServiceTrees results computed", count(compare.misses)});
+  g.push_back({"recloser_compare_cache_invalidations_total",
+               "Cached comparisons dropped for an outdated catalog",
+               count(compare.invalidations)});
+  g.push_back({"recloser_compare_cache_evictions_total",
+               "Cached comparisons evicted for space",
+               count(compare.evictions)});
+  g.push_back({"recloser_compare_cache_entries", "Cached comparisons",
+               count(compare.entries)});
+  g.push_back({"recloser_compare_cache_bytes", "Memory used by the cache",
+               count(compare.bytes)});
+  g.push_back({"recloser_compare_cache_capacity_bytes",
+               "Memory budget of the cache", count(compare.capacityBytes)});
+
+  ResponseCacheStats response = responseCache_->stats();
+  g.push_back({"recloser_response_cache_hits_total",
+               "Reads answered with cached bytes", count(response.hits)});
+  g.push_back({"recloser_response_cache_misses_total",
+               "Reads that built their response", count(response.misses)});
+  g.push_back({"recloser_response_cache_invalidations_total",
+               "Cached responses dropped for an outdated catalog",
+               count(response.invalidations)});
+  g.push_back({"recloser_response_cache_evictions_total",
+               "Cached responses evicted for space",
+               count(response.evictions)});
+  g.push_back({"recloser_response_cache_entries", "Cached responses",
+               count(response.entries)});
+  g.push_back({"recloser_response_cache_bytes", "Memory used by the cache",
+               count(response.bytes)});
+  g.push_back({"recloser_response_cache_capacity_bytes",
+               "Memory budget of the cache", count(response.capacityBytes)});
+
+  StatementStats statements = manager_->statementStats();
+  g.push_back({"recloser_statement_cache_hits_total",
+               "Statements reused from a connection's cache",
+               count(statements.hits)});
+  g.push_back({"recloser_statement_cache_prepares_total",
+               "Statements prepared", count(statements.prepares)});
+
+  ConnectionPoolStats pool = manager_->connectionPoolStats();
+  g.push_back({"recloser_read_pool_connections",
+               "Read-only connections in the pool", count(pool.readers)});
+  g.push_back({"recloser_read_pool_leased", "Read connections in use",
+               count(pool.leased)});
+  g.push_back({"recloser_read_pool_leases_total",
+               "Read connections handed out", count(pool.leases)});
+  g.push_back({"recloser_read_pool_waits_total",
+               "Leases that waited for a connection", count(pool.waits)});
+
+  if (const DatabaseExecutor *executor =
+          executor_.load(std::memory_order_acquire)) {
+    DatabaseExecutorStats e = executor->stats();
+    g.push_back({"recloser_executor_workers", "Executor threads",
+                 count(e.workers)});
+    g.push_back({"recloser_executor_busy_workers",
+                 "Executor threads running a handler",
+                 count(e.busyWorkers)});
+    g.push_back({"recloser_executor_queue_depth", "Calls waiting for a worker",
+                 count(e.queueDepth)});
+    g.push_back({"recloser_executor_queue_peak",
+                 "Most calls ever waiting at once", count(e.maxQueueDepth)});
+    g.push_back({"recloser_executor_queue_capacity",
+                 "Calls allowed to wait", count(e.queueCapacity)});
+    g.push_back({"recloser_executor_completed_total", "Handlers run",
+                 count(e.completed)});
+    g.push_back({"recloser_executor_rejected_total",
+                 "Calls rejected with a full queue", count(e.rejected)});
+    g.push_back({"recloser_executor_wait_seconds_total",
+                 "Time calls spent queued", e.totalWaitMicros / 1e6});
+    g.push_back({"recloser_executor_wait_max_seconds",
+                 "Longest time a call spent queued", e.maxWaitMicros / 1e6});
+  }
+  return g;
+}
+
+void ServerMetrics::fill(ServerStatsResponse *response) const {
+  response->set_uptime_seconds(uptimeSeconds());
+  for (const auto &rpc : rpcs_) {
+    LatencySummary latency = rpc->latency.summary();
+    if (latency.count == 0) {
+      continue;
+    }
+    LatencyStats *stats = response->add_rpcs();
+    setLatency(stats, rpc->name, latency);
+    stats->set_errors(rpc->errors.load(std::memory_order_relaxed));
+  }
+  for (const auto &timing : manager_->statementTimings()) {
+    setLatency(response->add_statements(), timing.sql, timing.latency);
+  }
+  for (const auto &gauge : gauges()) {
+    ServerGauge *entry = response->add_gauges();
+    entry->set_name(gauge.name);
+    entry->set_value(gauge.value);
+  }
+}
+
+std::string ServerMetrics::prometheusText() const {
+  std::string out;
+
+  std::vector<NamedLatency> rpcs;
+  rpcs.reserve(rpcs_.size());
+  for (const auto &rpc : rpcs_) {
+    rpcs.emplace_back(rpc->name, rpc->latency.summary());
+  }
+  appendLatencyFamilies(out, "recloser_rpc_duration_seconds",
+                        "recloser_rpc_duration_max_seconds", "method",
+                        "Time from the start of an RPC until its status is "
+                        "sent",
+                        rpcs);
+  appendHeader(out, "recloser_rpc_errors_total", "counter",
+               "RPCs that ended with a non-OK status");
+  for (const auto &rpc : rpcs_) {
+    appendSample(out, "recloser_rpc_errors_total", "", "method", rpc->name);
+    appendNumber(out, static_cast<double>(
+                          rpc->errors.load(std::memory_order_relaxed)));
+    out += '\n';
+  }
+
+  std::vector<NamedLatency> statements;
+  for (auto &timing : manager_->statementTimings()) {
+    statements.emplace_back(std::move(timing.sql), timing.latency);
+  }
+  appendLatencyFamilies(out, "recloser_sql_duration_seconds",
+                        "recloser_sql_duration_max_seconds", "statement",
+                        "Time a prepared statement was checked out, from "
+                        "binding to its last row",
+                        statements);
+
+  appendHeader(out, "recloser_uptime_seconds", "gauge",
+               "Time since the server started");
+  out += "recloser_uptime_seconds ";
+  appendNumber(out, uptimeSeconds());
+  out += '\n';
+
+  for (const auto &gauge : gauges()) {
+    std::string_view name = gauge.name;
+    bool counter = name.size() > 6 && name.substr(name.size() - 6) == "_total";
+    appendHeader(out, gauge.name, counter ? "counter" : "gauge", gauge.help);
+    out += gauge.name;
+    out += ' ';
+    appendNumber(out, gauge.value);
+    out += '\n';
+  }
+  return out;
+}
+
+} // namespace recloser
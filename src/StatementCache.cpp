@@ -0,0 +1,112 @@
+#include "StatementCache.hpp"
+#include <iostream>
+
+namespace {
+thread_local StatementStats threadCounters;
+}
+
+StatementCache::CachedStatement &
+StatementCache::CachedStatement::operator=(CachedStatement &&other) noexcept {
+  if (this != &other) {
+    finish();
+    owner = other.owner;
+    stmt = other.stmt;
+    timing = other.timing;
+    start = other.start;
+    other.stmt = nullptr;
+  }
+  return *this;
+}
+
+StatementCache::CachedStatement::~CachedStatement() { finish(); }
+
+void StatementCache::CachedStatement::finish() {
+  if (!stmt) {
+    return;
+  }
+  if (timing) {
+    timing->recordSince(start);
+  }
+  owner->release(stmt, timing);
+  stmt = nullptr;
+}
+
+StatementCache::StatementCache(sqlite3 *db, StatementMetrics *metrics,
+                               size_t maxIdlePerSql)
+    : db(db), metrics(metrics), maxIdlePerSql(maxIdlePerSql) {}
+
+StatementCache::~StatementCache() { clear(); }
+
+StatementCache::CachedStatement StatementCache::acquire(std::string_view sql) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = idle.find(sql);
+    if (it != idle.end() && !it->second.stmts.empty()) {
+      sqlite3_stmt *stmt = it->second.stmts.back();
+      it->second.stmts.pop_back();
+      hits.fetch_add(1, std::memory_order_relaxed);
+      threadCounters.hits++;
+      return CachedStatement(this, stmt, it->second.timing);
+    }
+  }
+
+  sqlite3_stmt *stmt = nullptr;
+  if (sqlite3_prepare_v3(db, sql.data(), static_cast<int>(sql.size()),
+                         SQLITE_PREPARE_PERSISTENT, &stmt,
+                         nullptr) != SQLITE_OK) {
+    std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
+              << std::endl;
+    sqlite3_finalize(stmt);
+    return CachedStatement();
+  }
+  prepares.fetch_add(1, std::memory_order_relaxed);
+  threadCounters.prepares++;
+  return CachedStatement(this, stmt,
+                         metrics ? metrics->histogram(sql) : nullptr);
+}
+
+void StatementCache::release(sqlite3_stmt *stmt, LatencyHistogram *timing) {
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+
+  std::string_view sql = sqlite3_sql(stmt);
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = idle.find(sql);
+  if (it == idle.end()) {
+    it = idle.emplace(std::string(sql), IdleStatements{{}, timing}).first;
+  }
+  if (it->second.stmts.size() < maxIdlePerSql) {
+    it->second.stmts.push_back(stmt);
+    return;
+  }
+  sqlite3_finalize(stmt);
+}
+
+void StatementCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &[sql, entry] : idle) {
+    for (auto *stmt : entry.stmts) {
+      sqlite3_finalize(stmt);
+    }
+  }
+  idle.clear();
+}
+
+std::vector<std::string> StatementCache::sqlTexts() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<std::string> texts;
+  texts.reserve(idle.size());
+  for (const auto &entry : idle) {
+    texts.push_back(entry.first);
+  }
+  return texts;
+}
+
+StatementStats StatementCache::stats() const {
+  StatementStats s;
+  s.hits = hits.load(std::memory_order_relaxed);
+  s.prepares = prepares.load(std::memory_order_relaxed);
+  return s;
+}
+
+StatementStats StatementCache::threadStats() { return threadCounters; }
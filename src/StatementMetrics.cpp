@@ -0,0 +1,32 @@
+#include "StatementMetrics.hpp"
+#include <algorithm>
+
+LatencyHistogram *StatementMetrics::histogram(std::string_view sql) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = histograms.find(sql);
+  if (it == histograms.end()) {
+    it = histograms
+             .emplace(std::string(sql), std::make_unique<LatencyHistogram>())
+             .first;
+  }
+  return it->second.get();
+}
+
+std::vector<StatementTiming> StatementMetrics::timings() const {
+  std::vector<StatementTiming> result;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    result.reserve(histograms.size());
+    for (const auto &[sql, histogram] : histograms) {
+      LatencySummary latency = histogram->summary();
+      if (latency.count > 0) {
+        result.push_back(StatementTiming{sql, latency});
+      }
+    }
+  }
+  std::sort(result.begin(), result.end(),
+            [](const StatementTiming &a, const StatementTiming &b) {
+              return a.latency.totalNanos > b.latency.totalNanos;
+            });
+  return result;
+}
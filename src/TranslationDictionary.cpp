@@ -0,0 +1,139 @@
+#include "TranslationDictionary.hpp"
+#include "RecloserManager.hpp"
+#include <algorithm>
+#include <mutex>
+
+bool TranslationDictionary::load(StatementCache &statements) {
+  auto stmt = statements.acquire(
+      "SELECT description_key, language_code, value FROM Translations;");
+  if (!stmt)
+    return false;
+
+  std::unique_lock lock(mutex);
+  keyIds.clear();
+  keys.clear();
+  languageIds.clear();
+  languages.clear();
+  entries.clear();
+
+  int rc;
+  while ((rc = sqlite3_step(stmt.get())) == SQLITE_ROW) {
+    KeyId key = internKey(
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 0)));
+    LanguageId language = internLanguage(
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt.get(), 1)));
+    upsertLocked(key, language,
+                 reinterpret_cast<const char *>(
+                     sqlite3_column_text(stmt.get(), 2)));
+  }
+  return rc == SQLITE_DONE;
+}
+
+void TranslationDictionary::upsert(const std::string &key,
+                                   const std::string &langCode,
+                                   const std::string &value) {
+  std::unique_lock lock(mutex);
+  upsertLocked(internKey(key), internLanguage(langCode), value);
+}
+
+void TranslationDictionary::upsert(
+    const std::vector<TranslationRecord> &records) {
+  std::unique_lock lock(mutex);
+  for (const auto &r : records) {
+    upsertLocked(internKey(r.description_key), internLanguage(r.language_code),
+                 r.value);
+  }
+}
+
+std::vector<TranslationRecord>
+TranslationDictionary::lookup(const std::string &key) const {
+  std::vector<TranslationRecord> results;
+  std::shared_lock lock(mutex);
+  auto it = keyIds.find(key);
+  if (it != keyIds.end()) {
+    appendRecords(it->second, results);
+  }
+  return results;
+}
+
+std::string TranslationDictionary::lookup(const std::string &key,
+                                          const std::string &langCode) const {
+  std::shared_lock lock(mutex);
+  auto keyIt = keyIds.find(key);
+  auto langIt = languageIds.find(langCode);
+  if (keyIt == keyIds.end() || langIt == languageIds.end()) {
+    return "";
+  }
+  for (const auto &entry : entries[keyIt->second]) {
+    if (entry.language == langIt->second) {
+      return entry.value;
+    }
+  }
+  return "";
+}
+
+std::vector<std::vector<TranslationRecord>>
+TranslationDictionary::resolve(const std::vector<std::string> &requested) const {
+  std::vector<std::vector<TranslationRecord>> results(requested.size());
+  std::shared_lock lock(mutex);
+  for (size_t i = 0; i < requested.size(); ++i) {
+    auto it = keyIds.find(requested[i]);
+    if (it != keyIds.end()) {
+      appendRecords(it->second, results[i]);
+    }
+  }
+  return results;
+}
+
+size_t TranslationDictionary::keyCount() const {
+  std::shared_lock lock(mutex);
+  return keys.size();
+}
+
+size_t TranslationDictionary::languageCount() const {
+  std::shared_lock lock(mutex);
+  return languages.size();
+}
+
+TranslationDictionary::KeyId
+TranslationDictionary::internKey(const std::string &key) {
+  auto [it, inserted] = keyIds.try_emplace(key, static_cast<KeyId>(keys.size()));
+  if (inserted) {
+    keys.push_back(key);
+    entries.emplace_back();
+  }
+  return it->second;
+}
+
+TranslationDictionary::LanguageId
+TranslationDictionary::internLanguage(const std::string &langCode) {
+  auto [it, inserted] =
+      languageIds.try_emplace(langCode, static_cast<LanguageId>(languages.size()));
+  if (inserted) {
+    languages.push_back(langCode);
+  }
+  return it->second;
+}
+
+void TranslationDictionary::upsertLocked(KeyId key, LanguageId language,
+                                         const std::string &value) {
+  auto &list = entries[key];
+  auto pos = std::lower_bound(list.begin(), list.end(), language,
+                              [this](const Entry &entry, LanguageId lang) {
+                                return languages[entry.language] <
+                                       languages[lang];
+                              });
+  if (pos != list.end() && pos->language == language) {
+    pos->value = value;
+  } else {
+    list.insert(pos, Entry{language, value});
+  }
+}
+
+void TranslationDictionary::appendRecords(
+    KeyId key, std::vector<TranslationRecord> &out) const {
+  for (const auto &entry : entries[key]) {
+    out.push_back(
+        TranslationRecord{keys[key], languages[entry.language], entry.value});
+  }
+}
@@ -1,17 +1,41 @@
+#include "CatalogStore.hpp"
+#include "DatabaseExecutor.hpp"
+#include "MetricsEndpoint.hpp"
+#include "RecloserCallbackService.hpp"
 #include "RecloserManager.hpp"
 #include "RecloserServiceImpl.hpp"
+#include "ServerMetrics.hpp"
+#include <chrono>
+#include <clipp.h>
+#include <condition_variable>
 #include <filesystem>
 #include <grpcpp/grpcpp.h>
 #include <iostream>
+#include <mutex>
 #include <thread>
 #include <vector>
 
-void RunServer(RecloserManager *manager, const std::string &server_address) {
-  recloser::RecloserServiceImpl service(manager);
+// Times every call for GetServerStats and the metrics endpoint
+void AddRpcTimer(grpc::ServerBuilder &builder,
+                 recloser::ServerMetrics *metrics) {
+  std::vector<
+      std::unique_ptr<grpc::experimental::ServerInterceptorFactoryInterface>>
+      interceptors;
+  interceptors.push_back(metrics->interceptorFactory());
+  builder.experimental().SetInterceptorCreators(std::move(interceptors));
+}
+
+void RunServer(RecloserManager *manager, CatalogStore *catalog,
+               CompareCache *compareCache, ResponseCache *responseCache,
+               recloser::ServerMetrics *metrics,
+               const std::string &server_address) {
+  recloser::RecloserServiceImpl service(manager, catalog, compareCache,
+                                        responseCache, metrics);
 
   grpc::ServerBuilder builder;
   builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
   builder.RegisterService(&service);
+  AddRpcTimer(builder, metrics);
 
   std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
   std::cout << "gRPC Server listening on " << server_address << std::endl;
@@ -19,14 +43,141 @@ void RunServer(RecloserManager *manager, const std::string &server_address) {
   server->Wait();
 }
 
-int main() {
+// Logs the executor's queue whenever it saw traffic in the last interval,
+// until destroyed; must not outlive the executor
+class ExecutorReporter {
+public:
+  explicit ExecutorReporter(const DatabaseExecutor *executor)
+      : executor(executor), thread(&ExecutorReporter::run, this) {}
+
+  ~ExecutorReporter() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+  }
+
+private:
+  void run() {
+    uint64_t lastSubmitted = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wake.wait_for(lock, std::chrono::seconds(10),
+                          [this] { return stopping; })) {
+      DatabaseExecutorStats stats = executor->stats();
+      if (stats.submitted == lastSubmitted && stats.rejected == 0) {
+        continue;
+      }
+      lastSubmitted = stats.submitted;
+      uint64_t avgWait =
+          stats.completed > 0 ? stats.totalWaitMicros / stats.completed : 0;
+      std::cout << "DB executor: " << stats.queueDepth << " queued (peak "
+                << stats.maxQueueDepth << "/" << stats.queueCapacity << "), "
+                << stats.busyWorkers << "/" << stats.workers << " busy, "
+                << stats.completed << " done, " << stats.rejected
+                << " rejected, wait avg " << avgWait << " us max "
+                << stats.maxWaitMicros << " us" << std::endl;
+    }
+  }
+
+  const DatabaseExecutor *executor;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+  std::thread thread; // last, so it starts after the members it reads
+};
+
+void RunCallbackServer(RecloserManager *manager, CatalogStore *catalog,
+                       CompareCache *compareCache,
+                       ResponseCache *responseCache,
+                       recloser::ServerMetrics *metrics,
+                       const std::string &server_address, size_t dbWorkers,
+                       size_t dbQueueDepth) {
+  recloser::RecloserServiceImpl handlers(manager, catalog, compareCache,
+                                         responseCache, metrics);
+  DatabaseExecutor executor(dbWorkers, dbQueueDepth);
+  recloser::RecloserCallbackService service(&handlers, &executor);
+  metrics->setExecutor(&executor);
+
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+  builder.RegisterService(&service);
+  AddRpcTimer(builder, metrics);
+
+  std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
+  std::cout << "gRPC Server (callback API, " << dbWorkers
+            << " DB workers, queue " << dbQueueDepth << ") listening on "
+            << server_address << std::endl;
+
+  ExecutorReporter reporter(&executor);
+  server->Wait();
+  metrics->setExecutor(nullptr);
+}
+
+int main(int argc, char *argv[]) {
   std::cout << "--- 3P Recloser Management System ---" << std::endl;
 
+  int readConnections = 4;
+  std::string profileName = "balanced";
+  int compareCacheMb = 64;
+  int responseCacheMb = 64;
+  std::string serverMode = "sync";
+  int dbWorkers = 4;
+  int dbQueueDepth = 256;
+  std::string snapshotFile = "data/catalog.snapshot";
+  int metricsPort = 9464;
+  auto cli = ((clipp::option("--read-connections") &
+               clipp::value("count", readConnections)) %
+                  "read-only SQLite connections in the pool (default 4)",
+              (clipp::option("--db-profile") &
+               clipp::value("name", profileName)) %
+                  "durable, balanced or throughput (default balanced)",
+              (clipp::option("--compare-cache-mb") &
+               clipp::value("size", compareCacheMb)) %
+                  "memory for cached CompareServiceTrees results (default 64)",
+              (clipp::option("--response-cache-mb") &
+               clipp::value("size", responseCacheMb)) %
+                  "memory for serialized GetServiceTree and GetScreenLayout "
+                  "responses (default 64)",
+              (clipp::option("--server-mode") &
+               clipp::value("mode", serverMode)) %
+                  "sync or callback (default sync)",
+              (clipp::option("--db-workers") &
+               clipp::value("count", dbWorkers)) %
+                  "callback mode: threads running handlers (default 4)",
+              (clipp::option("--db-queue") &
+               clipp::value("depth", dbQueueDepth)) %
+                  "callback mode: calls allowed to wait for a worker before "
+                  "new ones are rejected (default 256)",
+              (clipp::option("--snapshot-file") &
+               clipp::value("path", snapshotFile)) %
+                  "mapped catalog snapshot, rewritten on every change; none "
+                  "to disable (default data/catalog.snapshot)",
+              (clipp::option("--metrics-port") &
+               clipp::value("port", metricsPort)) %
+                  "Prometheus metrics on 127.0.0.1; 0 to disable (default "
+                  "9464)");
+  if (!clipp::parse(argc, argv, cli) || readConnections < 0 ||
+      compareCacheMb < 0 || responseCacheMb < 0 ||
+      (serverMode != "sync" && serverMode != "callback") ||
+      dbWorkers < 1 || dbQueueDepth < 1 || metricsPort < 0 ||
+      metricsPort > 65535) {
+    std::cerr << clipp::make_man_page(cli, argv[0]);
+    return 1;
+  }
+  auto profile = ConnectionProfile::byName(profileName);
+  if (!profile) {
+    std::cerr << "Unknown database profile: " << profileName << std::endl;
+    return 1;
+  }
+
   // Ensure data directory exists
   std::filesystem::create_directories("data");
 
   // Use a clearer name for the management database
-  RecloserManager manager("data/management.db");
+  RecloserManager manager("data/management.db",
+                          static_cast<size_t>(readConnections), *profile);
 
   if (!manager.initialize()) {
     std::cerr << "Failed to initialize database." << std::endl;
@@ -38,6 +189,9 @@ int main() {
   if (manager.getAllReclosers().empty()) {
     std::cout << "Database is empty. Populating initial data..." << std::endl;
 
+    // One transaction for the whole sample catalog instead of one per row
+    RecloserManager::Transaction seed(manager);
+
     // Setup Languages
     manager.addLanguage("enUs", "English");
     manager.addLanguage("ptBr", "Português");
@@ -155,13 +309,50 @@ int main() {
     manager.addComponentLimit(fcNmTpV2, "MAX_VALUE", "20000");
     manager.addComponentLimit(fcDnTpV2, "MIN_VALUE", "1");
     manager.addComponentLimit(fcDnTpV2, "MAX_VALUE", "10000");
+
+    if (!seed.commit()) {
+      std::cerr << "Failed to populate initial data." << std::endl;
+      return 1;
+    }
+  }
+
+  // Read RPCs are served from an in-memory snapshot of the catalog, mapped
+  // from the snapshot file when it is still current
+  CatalogStore catalog(&manager,
+                       snapshotFile == "none" ? std::string() : snapshotFile);
+  if (!catalog.load()) {
+    std::cerr << "Failed to load catalog snapshot." << std::endl;
+    return 1;
+  }
+
+  CompareCache compareCache(static_cast<size_t>(compareCacheMb) * 1024 * 1024);
+  ResponseCache responseCache(static_cast<size_t>(responseCacheMb) * 1024 *
+                              1024);
+
+  recloser::ServerMetrics metrics(&manager, &catalog, &compareCache,
+                                  &responseCache);
+  MetricsEndpoint metricsEndpoint(static_cast<uint16_t>(metricsPort), [&] {
+    return metrics.prometheusText();
+  });
+  if (metricsPort > 0) {
+    // GetServerStats still works without the endpoint
+    metricsEndpoint.start();
   }
 
   // Start gRPC server in a separate thread
   std::cout << "\n--- Starting gRPC Server ---" << std::endl;
   std::string server_address("0.0.0.0:50051");
 
-  std::thread server_thread(RunServer, &manager, server_address);
+  std::thread server_thread;
+  if (serverMode == "callback") {
+    server_thread = std::thread(RunCallbackServer, &manager, &catalog,
+                                &compareCache, &responseCache, &metrics,
+                                server_address, static_cast<size_t>(dbWorkers),
+                                static_cast<size_t>(dbQueueDepth));
+  } else {
+    server_thread = std::thread(RunServer, &manager, &catalog, &compareCache,
+                                &responseCache, &metrics, server_address);
+  }
 
   std::cout << "\nPress Ctrl+C to stop the server..." << std::endl;
 
@@ -0,0 +1,301 @@
+#include "RecloserManager.hpp"
+#include <chrono>
+#include <clipp.h>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+// Imports a catalog document into the management database:
+//
+//   {
+//     "languages":    [{"code": "enUs", "name": "English"}],
+//     "descriptions": [{"key": "DATE", "translations": {"enUs": "Date"}}],
+//     "reclosers":    [{"key": "ZEUS_NG_3P4W"}],
+//     "firmwares":    [{"recloser": "ZEUS_NG_3P4W", "version": "v1.0.0",
+//                       "services": [{"key": "DATE_TIME",
+//                                     "features": [{"key": "DATE",
+//                                                   "component": "Date",
+//                                                   "limits": {"STEP": "1"}}],
+//                                     "children": []}]}]
+//   }
+//
+// The document is parsed as a stream: each element of a top-level array is
+// imported as soon as it is complete and then dropped, so memory stays
+// bounded by the largest single element (typically one firmware). Rows go
+// in through RecloserManager in transactions of about --batch-rows rows with
+// foreign-key checks deferred to each commit. Services are shared across
+// firmwares by description key, as the schema requires. Stop the server
+// while importing; it picks up the new catalog when it starts.
+
+namespace {
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+class CatalogImporter {
+public:
+  CatalogImporter(RecloserManager &manager, size_t batchRows)
+      : manager(manager), batchRows(batchRows) {
+    // Existing rows that documents may refer to by key
+    for (const auto &r : manager.getAllReclosers()) {
+      recloserIds[r.description_key] = r.id;
+    }
+    for (const auto &s : manager.getAllServices()) {
+      serviceIds[s.description_key] = s.id;
+    }
+  }
+
+  // Imports one element of a top-level array; throws on a bad element
+  void import(const std::string &section, const json &element) {
+    if (!batch) {
+      batch.emplace(manager);
+      if (!batch->deferForeignKeys()) {
+        throw std::runtime_error("cannot start a batch transaction");
+      }
+      batchStart = Clock::now();
+    }
+
+    if (section == "languages") {
+      importLanguage(element);
+    } else if (section == "descriptions") {
+      importDescription(element);
+    } else if (section == "reclosers") {
+      importRecloser(element);
+    } else if (section == "firmwares") {
+      importFirmware(element);
+    } else {
+      throw std::runtime_error("unknown section '" + section + "'");
+    }
+
+    if (batchRowCount >= batchRows) {
+      commitBatch();
+    }
+  }
+
+  void finish() {
+    if (batch) {
+      commitBatch();
+    }
+  }
+
+  size_t rows() const { return totalRows; }
+
+private:
+  void count(size_t rows = 1) {
+    batchRowCount += rows;
+    totalRows += rows;
+  }
+
+  static void require(bool ok, const std::string &what) {
+    if (!ok) {
+      throw std::runtime_error("failed to insert " + what);
+    }
+  }
+
+  void commitBatch() {
+    // Deferred foreign keys are checked here, so a dangling reference
+    // anywhere in the batch fails the commit and rolls the batch back
+    if (!batch->commit()) {
+      throw std::runtime_error("batch commit failed, nothing in it was kept");
+    }
+    batch.reset();
+    double seconds = secondsSince(batchStart);
+    std::cout << "Committed " << batchRowCount << " rows in " << seconds
+              << " s (" << static_cast<size_t>(batchRowCount / seconds)
+              << " rows/s)" << std::endl;
+    batchRowCount = 0;
+  }
+
+  void importLanguage(const json &language) {
+    std::string code = language.at("code").get<std::string>();
+    require(manager.addLanguage(code, language.at("name").get<std::string>()),
+            "language " + code);
+    count();
+  }
+
+  void importDescription(const json &description) {
+    std::string key = description.at("key").get<std::string>();
+    std::vector<std::pair<std::string, std::string>> values;
+    if (description.contains("translations")) {
+      for (const auto &[languageCode, value] :
+           description["translations"].items()) {
+        values.emplace_back(languageCode, value.get<std::string>());
+      }
+    }
+    require(manager.addKeyWithTranslations(key, values), "description " + key);
+    count(1 + values.size());
+  }
+
+  void importRecloser(const json &recloser) {
+    std::string key = recloser.at("key").get<std::string>();
+    if (recloserIds.count(key)) {
+      return;
+    }
+    int id = manager.addRecloser(key);
+    require(id > 0, "recloser " + key);
+    recloserIds[key] = id;
+    count();
+  }
+
+  void importFirmware(const json &firmware) {
+    std::string recloserKey = firmware.at("recloser").get<std::string>();
+    std::string version = firmware.at("version").get<std::string>();
+    auto recloser = recloserIds.find(recloserKey);
+    if (recloser == recloserIds.end()) {
+      throw std::runtime_error("firmware " + version +
+                               " refers to unknown recloser " + recloserKey);
+    }
+
+    int firmwareId = manager.addFirmwareVersion(version, recloser->second);
+    require(firmwareId > 0, "firmware " + version);
+    count();
+
+    if (firmware.contains("services")) {
+      for (const auto &service : firmware["services"]) {
+        importService(service, 0, firmwareId);
+      }
+    }
+  }
+
+  void importService(const json &service, int parentId, int firmwareId) {
+    std::string key = service.at("key").get<std::string>();
+    auto existing = serviceIds.find(key);
+    int serviceId;
+    if (existing != serviceIds.end()) {
+      serviceId = existing->second;
+    } else {
+      serviceId = manager.addService(key, parentId);
+      require(serviceId > 0, "service " + key);
+      serviceIds[key] = serviceId;
+      count();
+    }
+
+    int serviceFirmwareId =
+        manager.linkServiceToFirmware(serviceId, firmwareId);
+    require(serviceFirmwareId > 0, "firmware link of service " + key);
+    count();
+
+    if (service.contains("features")) {
+      for (const auto &feature : service["features"]) {
+        importFeature(feature, serviceFirmwareId);
+      }
+    }
+    if (service.contains("children")) {
+      for (const auto &child : service["children"]) {
+        importService(child, serviceId, firmwareId);
+      }
+    }
+  }
+
+  void importFeature(const json &feature, int serviceFirmwareId) {
+    std::string key = feature.at("key").get<std::string>();
+    int featureId = manager.addFeature(key, serviceFirmwareId);
+    require(featureId > 0, "feature " + key);
+    count();
+
+    if (!feature.contains("component")) {
+      return;
+    }
+    std::string type = feature["component"].get<std::string>();
+    int featureComponentId = manager.linkFeatureToComponent(featureId, type);
+    require(featureComponentId > 0, "component " + type + " of feature " + key);
+    count();
+
+    if (feature.contains("limits")) {
+      for (const auto &[limitKey, value] : feature["limits"].items()) {
+        require(manager.addComponentLimit(featureComponentId, limitKey,
+                                          value.get<std::string>()),
+                "limit " + limitKey + " of feature " + key);
+        count();
+      }
+    }
+  }
+
+  RecloserManager &manager;
+  size_t batchRows;
+  std::optional<RecloserManager::Transaction> batch;
+  Clock::time_point batchStart;
+  size_t batchRowCount = 0;
+  size_t totalRows = 0;
+  std::unordered_map<std::string, int> recloserIds;
+  std::unordered_map<std::string, int> serviceIds;
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string catalogPath;
+  std::string dbPath = "data/management.db";
+  std::string profileName = "balanced";
+  int batchRows = 50000;
+  auto cli = (clipp::value("catalog.json", catalogPath),
+              (clipp::option("--db") & clipp::value("path", dbPath)) %
+                  "database to import into (default data/management.db)",
+              (clipp::option("--db-profile") &
+               clipp::value("name", profileName)) %
+                  "durable, balanced or throughput (default balanced)",
+              (clipp::option("--batch-rows") &
+               clipp::value("count", batchRows)) %
+                  "rows per transaction (default 50000)");
+  if (!clipp::parse(argc, argv, cli) || batchRows < 1) {
+    std::cerr << clipp::make_man_page(cli, argv[0]);
+    return 1;
+  }
+  auto profile = ConnectionProfile::byName(profileName);
+  if (!profile) {
+    std::cerr << "Unknown database profile: " << profileName << std::endl;
+    return 1;
+  }
+
+  std::ifstream in(catalogPath);
+  if (!in) {
+    std::cerr << "Cannot open " << catalogPath << std::endl;
+    return 1;
+  }
+
+  RecloserManager manager(dbPath, 0, *profile);
+  if (!manager.initialize()) {
+    std::cerr << "Failed to initialize database." << std::endl;
+    return 1;
+  }
+
+  CatalogImporter importer(manager, static_cast<size_t>(batchRows));
+  std::string section;
+  size_t element = 0;
+  auto start = Clock::now();
+  try {
+    // What is left is the document skeleton with every array emptied
+    json skeleton = json::parse(in, [&](int depth, json::parse_event_t event,
+                                        json &parsed) {
+      if (depth == 1 && event == json::parse_event_t::key) {
+        section = parsed.get<std::string>();
+        element = 0;
+      } else if (depth == 2 && event == json::parse_event_t::object_end) {
+        importer.import(section, parsed);
+        element++;
+        return false; // imported, drop it from the document
+      }
+      return true;
+    });
+    importer.finish();
+  } catch (const std::exception &e) {
+    std::cerr << "Import stopped at " << section << "[" << element
+              << "]: " << e.what() << std::endl;
+    std::cerr << "Batches committed before that point are kept." << std::endl;
+    return 1;
+  }
+
+  double seconds = secondsSince(start);
+  std::cout << "Imported " << importer.rows() << " rows in " << seconds
+            << " s (" << static_cast<size_t>(importer.rows() / seconds)
+            << " rows/s)" << std::endl;
+  return 0;
+}
@@ -0,0 +1,693 @@
+#include "recloser.grpc.pb.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <clipp.h>
+#include <cmath>
+#include <fstream>
+#include <grpcpp/grpcpp.h>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Drives a running server with the calls the Configurator and the HMIs
+// make, and reports throughput and latency histograms as JSON:
+//
+//   load_generator --mode closed --clients 16 --duration 30
+//   load_generator --mode open --rate 2000 --clients 64 --mix tree=3,layout=1
+//
+// closed: each of --clients threads makes one call after another, so the
+//   offered load falls as the server slows down. A call's latency is the
+//   time from sending it to its reply.
+// open:   calls are scheduled at --rate per second whatever the server does,
+//   and --clients threads send them. A call's latency runs from the time
+//   it was scheduled, not from when a thread got round to sending it, so
+//   waiting behind slow calls counts against the server (the correction
+//   for coordinated omission). The time from send to reply is reported
+//   separately as service_time.
+//
+// --mix weighs tree (GetServiceTree), layout (GetScreenLayout), compare
+// (CompareServiceTrees), inventory (GetFullInventory) and crud. Each crud
+// draw makes the next call of a create, update, delete cycle on one feature
+// per thread, so the catalog ends as it started: ApplyChangeSet creates the
+// feature, since CreateFeature does not return its id, then UpdateFeature
+// and DeleteFeature. The calls target the first recloser with two
+// firmwares, or --recloser: its first firmware, compared with its second,
+// and the first top-level service of that firmware, whose first feature key
+// the crud cycle reuses. Calls during --warmup are made but not reported.
+
+namespace {
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+// Latency histogram in the manner of HdrHistogram: log-linear buckets with
+// 128 per power of two, so every recorded value is kept to within 1/128.
+// Values past MAX_BITS (about 137 seconds) count as the largest bucket.
+class HdrHistogram {
+public:
+  void record(uint64_t nanos) {
+    ++counts[bucketOf(nanos)];
+    ++n;
+    total += nanos;
+    minNanos = std::min(minNanos, nanos);
+    maxNanos = std::max(maxNanos, nanos);
+  }
+
+  uint64_t count() const { return n; }
+
+  // Highest value equivalent to the one at the percentile, as HdrHistogram
+  // reports it
+  uint64_t valueAt(double percentile) const {
+    if (n == 0) {
+      return 0;
+    }
+    auto rank = static_cast<uint64_t>(
+        std::ceil(static_cast<double>(n) * percentile / 100.0));
+    rank = std::clamp<uint64_t>(rank, 1, n);
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+      seen += counts[i];
+      if (seen >= rank) {
+        return std::min(highestEquivalent(i), maxNanos);
+      }
+    }
+    return maxNanos;
+  }
+
+  json toJson() const {
+    json out = {{"count", n}};
+    if (n == 0) {
+      return out;
+    }
+    out["min_us"] = micros(minNanos);
+    out["mean_us"] = micros(total / n);
+    out["max_us"] = micros(maxNanos);
+    json percentiles = json::object();
+    for (const char *p : {"50", "75", "90", "95", "99", "99.9", "99.99"}) {
+      percentiles[p] = micros(valueAt(std::stod(p)));
+    }
+    out["percentiles_us"] = percentiles;
+
+    // The percentile distribution HdrHistogram prints: TICKS steps over
+    // each halving of the remaining distance to 100%, until one step is
+    // less than one call, then the maximum
+    constexpr int TICKS = 2;
+    json distribution = json::array();
+    for (int k = 0; std::ldexp(static_cast<double>(n), -k) >= 1.0; ++k) {
+      double remaining = 100.0 * std::ldexp(1.0, -k);
+      for (int t = 0; t < TICKS; ++t) {
+        double percentile = 100.0 - remaining + remaining / 2 * t / TICKS;
+        uint64_t value = valueAt(percentile);
+        distribution.push_back({{"percentile", percentile},
+                                {"value_us", micros(value)},
+                                {"count", countAtOrBelow(value)}});
+      }
+    }
+    distribution.push_back(
+        {{"percentile", 100.0}, {"value_us", micros(maxNanos)}, {"count", n}});
+    out["distribution"] = distribution;
+    return out;
+  }
+
+private:
+  static constexpr int SUB_BUCKET_BITS = 7;
+  static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static constexpr int MAX_BITS = 37;
+  static constexpr int BUCKETS = (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  static int bucketOf(uint64_t nanos) {
+    nanos = std::min(nanos, (uint64_t{1} << MAX_BITS) - 1);
+    if (nanos < 2 * SUB_BUCKETS) {
+      return static_cast<int>(nanos);
+    }
+    int shift = std::bit_width(nanos) - 1 - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKETS +
+           static_cast<int>((nanos >> shift) & (SUB_BUCKETS - 1));
+  }
+
+  static uint64_t highestEquivalent(int bucket) {
+    if (bucket < 2 * SUB_BUCKETS) {
+      return static_cast<uint64_t>(bucket);
+    }
+    int shift = bucket / SUB_BUCKETS - 1;
+    uint64_t lower = static_cast<uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS)
+                     << shift;
+    return lower + (uint64_t{1} << shift) - 1;
+  }
+
+  static double micros(uint64_t nanos) {
+    return std::round(static_cast<double>(nanos) / 10.0) / 100.0;
+  }
+
+  uint64_t countAtOrBelow(uint64_t nanos) const {
+    uint64_t seen = 0;
+    for (int i = 0; i <= bucketOf(nanos); ++i) {
+      seen += counts[i];
+    }
+    return seen;
+  }
+
+  std::vector<uint64_t> counts = std::vector<uint64_t>(BUCKETS);
+  uint64_t n = 0;
+  uint64_t total = 0;
+  uint64_t minNanos = UINT64_MAX;
+  uint64_t maxNanos = 0;
+};
+
+uint64_t nanosBetween(Clock::time_point from, Clock::time_point to) {
+  return to > from ? static_cast<uint64_t>(
+                         std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             to - from)
+                             .count())
+                   : 0;
+}
+
+enum class Operation { TREE, LAYOUT, COMPARE, INVENTORY, CRUD };
+
+const char *const OPERATION_NAMES[] = {"tree", "layout", "compare",
+                                       "inventory", "crud"};
+constexpr int OPERATIONS = 5;
+
+// Parses "tree=40,layout=30,..."; operations left out get no calls
+std::optional<std::vector<int>> parseMix(const std::string &text) {
+  std::vector<int> weights(OPERATIONS, 0);
+  std::stringstream items(text);
+  std::string item;
+  while (std::getline(items, item, ',')) {
+    auto eq = item.find('=');
+    auto name = item.substr(0, eq);
+    auto *found = std::find(std::begin(OPERATION_NAMES),
+                            std::end(OPERATION_NAMES), name);
+    if (eq == std::string::npos || found == std::end(OPERATION_NAMES)) {
+      return std::nullopt;
+    }
+    try {
+      weights[found - std::begin(OPERATION_NAMES)] =
+          std::stoi(item.substr(eq + 1));
+    } catch (const std::exception &) {
+      return std::nullopt;
+    }
+  }
+  bool any = std::any_of(weights.begin(), weights.end(),
+                         [](int w) { return w > 0; });
+  bool negative = std::any_of(weights.begin(), weights.end(),
+                              [](int w) { return w < 0; });
+  if (!any || negative) {
+    return std::nullopt;
+  }
+  return weights;
+}
+
+struct Options {
+  std::string target = "localhost:50051";
+  std::string mode = "closed";
+  int clients = 8;
+  int channels = 1;
+  int rate = 1000;
+  int duration = 30;
+  int warmup = 5;
+  std::string mix = "tree=40,layout=30,compare=10,inventory=5,crud=15";
+  std::string languages;
+  int maxDepth = 0;
+  int recloserId = 0;
+  int timeoutMs = 10000;
+  int seed = 1;
+  std::string output;
+};
+
+// Rows the calls read and write, found through GetFullInventory
+struct Targets {
+  int recloserId = 0;
+  int firmwareId = 0;
+  int compareFirmwareId = 0;
+  int serviceNodeId = 0; // service-firmware id of a top-level service
+  std::string featureKey;
+};
+
+std::optional<Targets> findTargets(recloser::RecloserService::Stub &stub,
+                                   const Options &options) {
+  grpc::ClientContext context;
+  context.set_deadline(std::chrono::system_clock::now() +
+                       std::chrono::milliseconds(options.timeoutMs));
+  recloser::FullInventoryRequest request;
+  request.set_max_depth(1);
+  recloser::FullInventoryResponse response;
+  auto status = stub.GetFullInventory(&context, request, &response);
+  if (!status.ok()) {
+    std::cerr << "GetFullInventory failed: " << status.error_message()
+              << std::endl;
+    return std::nullopt;
+  }
+
+  for (const auto &recloser : response.reclosers()) {
+    if ((options.recloserId != 0 && recloser.id() != options.recloserId) ||
+        recloser.firmwares_size() < 2) {
+      continue;
+    }
+    const auto &firmware = recloser.firmwares(0);
+    Targets targets;
+    targets.recloserId = recloser.id();
+    targets.firmwareId = firmware.id();
+    targets.compareFirmwareId = recloser.firmwares(1).id();
+    for (const auto &service : firmware.services()) {
+      if (service.features_size() > 0) {
+        targets.serviceNodeId = service.id();
+        targets.featureKey = service.features(0).feature_key();
+        return targets;
+      }
+    }
+  }
+  std::cerr << "No recloser with two firmwares and a service with features"
+            << std::endl;
+  return std::nullopt;
+}
+
+struct CallResult {
+  const char *rpc = "";
+  Clock::time_point sent;
+  Clock::time_point done;
+  // Status code, or FAILED for an OK status whose response reports failure
+  std::string error;
+};
+
+// One thread's connection to the server and its share of the mix
+class Client {
+public:
+  Client(std::shared_ptr<grpc::Channel> channel, const Options &options,
+         const Targets &targets, const std::vector<int> &weights,
+         uint64_t seed)
+      : stub(recloser::RecloserService::NewStub(std::move(channel))),
+        options(options), targets(targets),
+        pick(weights.begin(), weights.end()), random(seed) {
+    std::stringstream codes(options.languages);
+    std::string code;
+    while (std::getline(codes, code, ',')) {
+      if (!code.empty()) {
+        languages.push_back(code);
+      }
+    }
+  }
+
+  Operation next() { return static_cast<Operation>(pick(random)); }
+
+  CallResult call(Operation operation) {
+    switch (operation) {
+    case Operation::TREE:
+      return getServiceTree();
+    case Operation::LAYOUT:
+      return getScreenLayout();
+    case Operation::COMPARE:
+      return compareServiceTrees();
+    case Operation::INVENTORY:
+      return getFullInventory();
+    case Operation::CRUD:
+      break;
+    }
+    return crudStep();
+  }
+
+  // Deletes the feature of an unfinished crud cycle
+  void finish() {
+    if (featureId > 0) {
+      deleteFeature();
+    }
+  }
+
+private:
+  template <typename Request> void addLanguages(Request &request) const {
+    for (const auto &code : languages) {
+      request.add_language_codes(code);
+    }
+  }
+
+  template <typename Invoke>
+  CallResult timed(const char *rpc, Invoke invoke) {
+    grpc::ClientContext context;
+    context.set_deadline(std::chrono::system_clock::now() +
+                         std::chrono::milliseconds(options.timeoutMs));
+    CallResult result;
+    result.rpc = rpc;
+    result.sent = Clock::now();
+    grpc::Status status;
+    bool succeeded = invoke(context, status);
+    result.done = Clock::now();
+    if (!status.ok()) {
+      result.error = std::to_string(status.error_code());
+    } else if (!succeeded) {
+      result.error = "FAILED";
+    }
+    return result;
+  }
+
+  CallResult getServiceTree() {
+    recloser::ServiceTreeRequest request;
+    request.set_firmware_id(targets.firmwareId);
+    addLanguages(request);
+    request.set_max_depth(options.maxDepth);
+    recloser::ServiceTreeResponse response;
+    return timed("GetServiceTree", [&](auto &context, auto &status) {
+      status = stub->GetServiceTree(&context, request, &response);
+      return true;
+    });
+  }
+
+  CallResult getScreenLayout() {
+    recloser::ScreenLayoutRequest request;
+    request.set_service_id(targets.serviceNodeId);
+    addLanguages(request);
+    request.set_max_depth(options.maxDepth);
+    recloser::ScreenLayoutResponse response;
+    return timed("GetScreenLayout", [&](auto &context, auto &status) {
+      status = stub->GetScreenLayout(&context, request, &response);
+      return true;
+    });
+  }
+
+  CallResult compareServiceTrees() {
+    recloser::CompareServiceTreesRequest request;
+    request.set_firmware_id_1(targets.firmwareId);
+    request.set_firmware_id_2(targets.compareFirmwareId);
+    request.set_language_code(languages.empty() ? "enUs" : languages[0]);
+    recloser::CompareServiceTreesResponse response;
+    return timed("CompareServiceTrees", [&](auto &context, auto &status) {
+      status = stub->CompareServiceTrees(&context, request, &response);
+      return true;
+    });
+  }
+
+  CallResult getFullInventory() {
+    recloser::FullInventoryRequest request;
+    addLanguages(request);
+    request.set_max_depth(options.maxDepth);
+    recloser::FullInventoryResponse response;
+    return timed("GetFullInventory", [&](auto &context, auto &status) {
+      status = stub->GetFullInventory(&context, request, &response);
+      return true;
+    });
+  }
+
+  CallResult crudStep() {
+    if (featureId == 0) {
+      return createFeature();
+    }
+    if (!updated) {
+      updated = true;
+      return updateFeature();
+    }
+    return deleteFeature();
+  }
+
+  CallResult createFeature() {
+    recloser::ChangeSetRequest request;
+    auto *op = request.add_operations();
+    op->set_action(recloser::CHANGE_CREATE);
+    op->mutable_feature()->set_description_key(targets.featureKey);
+    op->mutable_feature()->set_service_id(targets.serviceNodeId);
+    recloser::ChangeSetResponse response;
+    auto result = timed("ApplyChangeSet", [&](auto &context, auto &status) {
+      status = stub->ApplyChangeSet(&context, request, &response);
+      return response.success();
+    });
+    if (result.error.empty() && response.results_size() > 0) {
+      featureId = response.results(0).id();
+      updated = false;
+    }
+    return result;
+  }
+
+  CallResult updateFeature() {
+    recloser::FeatureRecord request;
+    request.set_id(featureId);
+    request.set_description_key(targets.featureKey);
+    request.set_service_id(targets.serviceNodeId);
+    recloser::GenericResponse response;
+    return timed("UpdateFeature", [&](auto &context, auto &status) {
+      status = stub->UpdateFeature(&context, request, &response);
+      return response.success();
+    });
+  }
+
+  CallResult deleteFeature() {
+    recloser::DeleteRequest request;
+    request.set_id(featureId);
+    featureId = 0;
+    recloser::GenericResponse response;
+    return timed("DeleteFeature", [&](auto &context, auto &status) {
+      status = stub->DeleteFeature(&context, request, &response);
+      return response.success();
+    });
+  }
+
+  std::unique_ptr<recloser::RecloserService::Stub> stub;
+  const Options &options;
+  const Targets &targets;
+  std::vector<std::string> languages;
+  std::discrete_distribution<int> pick;
+  std::mt19937_64 random;
+  int featureId = 0; // of the crud cycle in progress
+  bool updated = false;
+};
+
+struct RpcStats {
+  HdrHistogram latency;
+  HdrHistogram serviceTime; // open loop only
+  uint64_t requests = 0;
+  std::map<std::string, uint64_t> errors;
+
+  void record(const CallResult &call, Clock::time_point intended) {
+    ++requests;
+    if (!call.error.empty()) {
+      ++errors[call.error];
+      return;
+    }
+    latency.record(nanosBetween(intended, call.done));
+    serviceTime.record(nanosBetween(call.sent, call.done));
+  }
+
+  json toJson(bool openLoop, double seconds) const {
+    uint64_t failed = 0;
+    for (const auto &[code, count] : errors) {
+      failed += count;
+    }
+    json out = {{"requests", requests},
+                {"errors", failed},
+                {"throughput_per_second",
+                 seconds > 0 ? static_cast<double>(requests) / seconds : 0.0},
+                {"latency", latency.toJson()}};
+    if (failed > 0) {
+      out["errors_by_code"] = errors;
+    }
+    if (openLoop) {
+      out["service_time"] = serviceTime.toJson();
+    }
+    return out;
+  }
+};
+
+// Shared by the client threads; calls made before measureStart are dropped
+class Recorder {
+public:
+  explicit Recorder(Clock::time_point measureStart)
+      : measureStart(measureStart) {}
+
+  void record(const CallResult &call, Clock::time_point intended) {
+    if (intended < measureStart) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    all.record(call, intended);
+    rpcs[call.rpc].record(call, intended);
+    lastDone = std::max(lastDone, call.done);
+  }
+
+  // Seconds from the end of the warmup to the last reply
+  double elapsedSeconds() const {
+    return lastDone > measureStart
+               ? std::chrono::duration<double>(lastDone - measureStart).count()
+               : 0.0;
+  }
+
+  json toJson(bool openLoop) const {
+    double seconds = elapsedSeconds();
+    json out = all.toJson(openLoop, seconds);
+    out["elapsed_seconds"] = seconds;
+    json perRpc = json::object();
+    for (const auto &[name, stats] : rpcs) {
+      perRpc[name] = stats.toJson(openLoop, seconds);
+    }
+    out["rpcs"] = perRpc;
+    return out;
+  }
+
+private:
+  Clock::time_point measureStart;
+  std::mutex mutex;
+  RpcStats all;
+  std::map<std::string, RpcStats> rpcs;
+  Clock::time_point lastDone;
+};
+
+std::shared_ptr<grpc::Channel> openChannel(const std::string &target) {
+  grpc::ChannelArguments args;
+  args.SetMaxReceiveMessageSize(-1); // full inventories run to megabytes
+  // A connection of its own rather than one shared with the other channels
+  args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+  return grpc::CreateCustomChannel(target, grpc::InsecureChannelCredentials(),
+                                   args);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  auto cli = ((clipp::option("--target") &
+               clipp::value("host:port", options.target)) %
+                  "server address (default localhost:50051)",
+              (clipp::option("--mode") & clipp::value("mode", options.mode)) %
+                  "closed or open (default closed)",
+              (clipp::option("--clients") &
+               clipp::value("count", options.clients)) %
+                  "client threads, and calls in flight at most (default 8)",
+              (clipp::option("--channels") &
+               clipp::value("count", options.channels)) %
+                  "connections the clients share (default 1)",
+              (clipp::option("--rate") & clipp::value("calls", options.rate)) %
+                  "open loop: calls scheduled per second (default 1000)",
+              (clipp::option("--duration") &
+               clipp::value("seconds", options.duration)) %
+                  "measured time (default 30)",
+              (clipp::option("--warmup") &
+               clipp::value("seconds", options.warmup)) %
+                  "unmeasured time before it (default 5)",
+              (clipp::option("--mix") & clipp::value("weights", options.mix)) %
+                  "e.g. tree=40,layout=30,compare=10,inventory=5,crud=15",
+              (clipp::option("--languages") &
+               clipp::value("codes", options.languages)) %
+                  "comma-separated language codes to request (default all)",
+              (clipp::option("--max-depth") &
+               clipp::value("levels", options.maxDepth)) %
+                  "tree, layout and inventory depth (default 0, all)",
+              (clipp::option("--recloser") &
+               clipp::value("id", options.recloserId)) %
+                  "recloser to target (default: first with two firmwares)",
+              (clipp::option("--timeout-ms") &
+               clipp::value("ms", options.timeoutMs)) %
+                  "deadline of each call (default 10000)",
+              (clipp::option("--seed") & clipp::value("n", options.seed)) %
+                  "seed of the mix (default 1)",
+              (clipp::option("--output") &
+               clipp::value("path", options.output)) %
+                  "file for the JSON report (default standard output)");
+  bool parsed = clipp::parse(argc, argv, cli);
+  auto weights = parseMix(options.mix);
+  bool openLoop = options.mode == "open";
+  if (!parsed || !weights || (!openLoop && options.mode != "closed") ||
+      options.clients < 1 || options.channels < 1 || options.rate < 1 ||
+      options.duration < 1 || options.warmup < 0 || options.timeoutMs < 1) {
+    std::cerr << clipp::make_man_page(cli, argv[0]);
+    return 1;
+  }
+
+  std::vector<std::shared_ptr<grpc::Channel>> channels;
+  for (int i = 0; i < options.channels; ++i) {
+    channels.push_back(openChannel(options.target));
+  }
+  auto stub = recloser::RecloserService::NewStub(channels[0]);
+  auto targets = findTargets(*stub, options);
+  if (!targets) {
+    return 1;
+  }
+  std::cerr << "Targeting recloser " << targets->recloserId << ": firmware "
+            << targets->firmwareId << " against "
+            << targets->compareFirmwareId << ", service node "
+            << targets->serviceNodeId << std::endl;
+
+  std::vector<std::unique_ptr<Client>> clients;
+  for (int i = 0; i < options.clients; ++i) {
+    clients.push_back(std::make_unique<Client>(
+        channels[i % channels.size()], options, *targets, *weights,
+        static_cast<uint64_t>(options.seed) * 1000003 + i));
+  }
+
+  auto start = Clock::now();
+  auto measureStart = start + std::chrono::seconds(options.warmup);
+  auto end = measureStart + std::chrono::seconds(options.duration);
+  Recorder recorder(measureStart);
+  // Open loop: call i is due at start + i * interval
+  auto interval = std::chrono::nanoseconds(1000000000LL / options.rate);
+  std::atomic<int64_t> nextCall{0};
+
+  std::vector<std::thread> threads;
+  for (auto &client : clients) {
+    threads.emplace_back([&, c = client.get()] {
+      while (true) {
+        Clock::time_point intended;
+        if (openLoop) {
+          intended = start + interval * nextCall.fetch_add(1);
+          if (intended >= end) {
+            break;
+          }
+          std::this_thread::sleep_until(intended);
+        } else {
+          intended = Clock::now();
+          if (intended >= end) {
+            break;
+          }
+        }
+        auto call = c->call(c->next());
+        recorder.record(call, openLoop ? intended : call.sent);
+      }
+      c->finish();
+    });
+  }
+  std::cerr << "Running " << options.mode << " loop for " << options.warmup
+            << " s warmup and " << options.duration << " s measured"
+            << std::endl;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  json mix = json::object();
+  for (int i = 0; i < OPERATIONS; ++i) {
+    if ((*weights)[i] > 0) {
+      mix[OPERATION_NAMES[i]] = (*weights)[i];
+    }
+  }
+  json report = {{"mode", options.mode},
+                 {"target", options.target},
+                 {"clients", options.clients},
+                 {"channels", options.channels},
+                 {"warmup_seconds", options.warmup},
+                 {"duration_seconds", options.duration},
+                 {"mix", mix},
+                 {"targets",
+                  {{"recloser_id", targets->recloserId},
+                   {"firmware_id", targets->firmwareId},
+                   {"compare_firmware_id", targets->compareFirmwareId},
+                   {"service_node_id", targets->serviceNodeId}}}};
+  if (openLoop) {
+    report["rate_per_second"] = options.rate;
+  }
+  report.update(recorder.toJson(openLoop));
+
+  if (options.output.empty()) {
+    std::cout << report.dump(2) << std::endl;
+  } else {
+    std::ofstream file(options.output);
+    file << report.dump(2) << std::endl;
+    if (!file) {
+      std::cerr << "Cannot write " << options.output << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
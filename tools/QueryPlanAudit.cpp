@@ -0,0 +1,200 @@
+#include "DatabaseSchema.hpp"
+#include "RecloserManager.hpp"
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Runs every RecloserManager operation against a scratch database, then
+// checks the EXPLAIN QUERY PLAN of each distinct statement that was issued.
+// A parameterized statement (a keyed lookup, insert or update) must never
+// SCAN one of the large catalog tables, nor search it through an AUTOMATIC
+// index (which SQLite builds with a full scan on every execution); whole-table
+// loads without parameters, such as the catalog snapshot queries, may scan.
+//
+// Exits with 1 if any statement violates the rule; run through the
+// check-query-plans target.
+
+namespace {
+
+const std::set<std::string> LARGE_TABLES = {
+    "Descriptions",    "Translations",     "Reclosers",
+    "FirmwareVersions", "Services",        "ServiceFirmware",
+    "Features",        "FeatureComponent", "FeatureComponentLimits",
+    "ServiceClosure"};
+
+// Maps every table alias in the statement (and every table name) to the
+// table it refers to; EXPLAIN QUERY PLAN reports aliases
+std::map<std::string, std::string> tableAliases(const std::string &sql) {
+  static const std::set<std::string> KEYWORDS = {
+      "WHERE", "JOIN",  "LEFT", "INNER", "ON",     "ORDER", "GROUP",
+      "LIMIT", "UNION", "AS",   "SET",   "VALUES", "SELECT"};
+  static const std::regex FROM_JOIN(
+      R"((?:FROM|JOIN|UPDATE|INTO)\s+(\w+)(?:\s+(?:AS\s+)?(\w+))?)",
+      std::regex::icase);
+
+  std::map<std::string, std::string> aliases;
+  for (std::sregex_iterator it(sql.begin(), sql.end(), FROM_JOIN), end;
+       it != end; ++it) {
+    std::string table = (*it)[1];
+    aliases[table] = table;
+    std::string alias = (*it)[2];
+    std::string upper = alias;
+    for (auto &c : upper) {
+      c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    if (!alias.empty() && !KEYWORDS.count(upper)) {
+      aliases[alias] = table;
+    }
+  }
+  return aliases;
+}
+
+void exerciseManager(RecloserManager &manager) {
+  manager.addLanguage("enUs", "English");
+  manager.addKeyWithTranslations("AUDIT_RECLOSER", {{"enUs", "Recloser"}});
+  manager.addKeyWithTranslations("AUDIT_PARENT", {{"enUs", "Parent"}});
+  manager.addKeyWithTranslations("AUDIT_CHILD", {{"enUs", "Child"}});
+  manager.addKeyWithTranslations("AUDIT_FEATURE", {{"enUs", "Feature"}});
+
+  manager.addRecloser("AUDIT_RECLOSER");
+  manager.updateRecloser(1, "AUDIT_RECLOSER");
+  manager.getAllReclosers();
+  manager.getRecloserById(1);
+
+  manager.addFirmwareVersion("v1.0.0", 1);
+  manager.updateFirmwareVersion(1, "v1.0.1", 1);
+  manager.getFirmwareVersionsForRecloser(1);
+  manager.getFirmwareVersionById(1);
+
+  int parent = manager.addService("AUDIT_PARENT");
+  int child = manager.addService("AUDIT_CHILD", parent);
+  manager.updateService(child, "AUDIT_CHILD", parent);
+  int sfParent = manager.linkServiceToFirmware(parent, 1);
+  int sfChild = manager.linkServiceToFirmware(child, 1);
+  manager.linkServiceToFirmware(child, 1); // existing link, looked up
+  manager.getServiceFirmwareId(child, 1);
+  manager.getAllServices();
+  manager.getServicesByParentAndFirmware(0, 1);
+  manager.getServicesByParentAndFirmware(parent, 1);
+  manager.getServiceById(child);
+  manager.getServiceSubtree(parent);
+  manager.getServiceAncestors(child);
+  manager.getServiceDepth(child);
+  manager.moveService(child, 0);
+  manager.moveService(child, parent);
+
+  int feature = manager.addFeature("AUDIT_FEATURE", sfChild);
+  manager.updateFeature(feature, "AUDIT_FEATURE", sfChild);
+  manager.getFeaturesByServiceFirmware(sfChild);
+  manager.getFeatureById(feature);
+  int fc = manager.linkFeatureToComponent(feature, "Integer");
+  manager.addComponentLimit(fc, "MIN_VALUE", "1");
+  manager.updateComponentLimit(fc, "MIN_VALUE", "2");
+
+  manager.getScreenLayout(sfParent);
+  manager.searchCatalog("Feat", "enUs", 10);
+  manager.searchCatalog("audit_child", "", 10, 1);
+  manager.buildCatalogSnapshot(1);
+  manager.catalogRevision();
+  int clone = manager.cloneFirmware(1, "v1.0.2").firmware_id;
+
+  manager.deleteComponentLimit(fc, "MIN_VALUE");
+  manager.deleteFeatureComponent(fc);
+  manager.deleteFeature(feature);
+  manager.unlinkServiceFromFirmware(child, 1);
+  manager.deleteService(child);
+  manager.deleteFirmwareVersion(clone);
+  manager.deleteFirmwareVersion(1);
+  manager.deleteRecloser(1);
+}
+
+} // namespace
+
+int main() {
+  auto path = std::filesystem::temp_directory_path() / "recloser_plan_audit.db";
+  for (const char *suffix : {"", "-wal", "-shm"}) {
+    std::error_code ec;
+    std::filesystem::remove(path.string() + suffix, ec);
+  }
+
+  RecloserManager manager(path.string(), 1);
+  if (!manager.initialize()) {
+    std::cerr << "Failed to initialize the audit database." << std::endl;
+    return 1;
+  }
+  exerciseManager(manager);
+
+  sqlite3 *db = nullptr;
+  if (sqlite3_open_v2(path.string().c_str(), &db, SQLITE_OPEN_READONLY,
+                      nullptr) != SQLITE_OK) {
+    std::cerr << "Cannot open database: " << sqlite3_errmsg(db) << std::endl;
+    sqlite3_close(db);
+    return 1;
+  }
+  // Statements may refer to RecloserManager's temp tables
+  sqlite3_exec(db, Schema::CLONE_MAPS_SQL.c_str(), nullptr, nullptr, nullptr);
+
+  auto statements = manager.preparedSql();
+  int violations = 0;
+  for (const auto &sql : statements) {
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+      std::cerr << "Cannot prepare: " << sql << std::endl;
+      violations++;
+      continue;
+    }
+    bool parameterized = sqlite3_bind_parameter_count(stmt) > 0;
+    sqlite3_finalize(stmt);
+
+    std::string explain = "EXPLAIN QUERY PLAN " + sql;
+    if (sqlite3_prepare_v2(db, explain.c_str(), -1, &stmt, nullptr) !=
+        SQLITE_OK) {
+      std::cerr << "Cannot explain: " << sql << std::endl;
+      violations++;
+      continue;
+    }
+
+    auto aliases = tableAliases(sql);
+    std::vector<std::string> plan;
+    std::vector<std::string> scans;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      std::string detail =
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
+      plan.push_back(detail);
+
+      bool scan = detail.rfind("SCAN ", 0) == 0;
+      bool automatic = detail.rfind("SEARCH ", 0) == 0 &&
+                       detail.find("AUTOMATIC") != std::string::npos;
+      if (!scan && !automatic) {
+        continue;
+      }
+      size_t start = detail.find(' ') + 1;
+      std::string name = detail.substr(start, detail.find(' ', start) - start);
+      auto table = aliases.find(name);
+      if (table != aliases.end() && LARGE_TABLES.count(table->second)) {
+        scans.push_back(table->second);
+      }
+    }
+    sqlite3_finalize(stmt);
+
+    bool failed = parameterized && !scans.empty();
+    std::cout << (failed ? "FAIL " : "ok   ") << sql << std::endl;
+    for (const auto &detail : plan) {
+      std::cout << "       " << detail << std::endl;
+    }
+    if (failed) {
+      violations++;
+    }
+  }
+  sqlite3_close(db);
+
+  std::cout << "\n"
+            << statements.size() << " statements audited, " << violations
+            << " keyed statement(s) scanning a large table" << std::endl;
+  return violations == 0 ? 0 : 1;
+}